@@ -0,0 +1,561 @@
+﻿/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Philippe Groarke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "fea_flat_unsigned_hashmap.hpp"
+
+/*
+A map with packed values that picks its lookup from how dense the keys are.
+
+- Dense keys use a direct index table, like unsigned_map. The table is as
+big as the biggest key.
+- Sparse keys use a hashed lookup, like flat_unsigned_hashmap.
+
+Density is size() / key_span(), where the key span is the biggest key + 1.
+When it drops under min_density(), the map migrates to a hashed lookup. When
+it climbs over max_density(), it migrates back to a direct table. Keep some
+room between the two, so a map doesn't keep migrating back and forth.
+
+Migrating only rebuilds the lookup. Values don't move, iterators and
+pointers to values stay valid.
+
+Like flat_unsigned_hashmap, iterators are on values. Use keys() to get the
+key of each value.
+*/
+
+namespace fea {
+namespace detail {
+// Stands in for values in the hashed lookup, the map holds the values.
+struct adaptive_map_slot {};
+} // namespace detail
+
+template <class Key, class T>
+struct adaptive_unsigned_map {
+	static_assert(std::is_unsigned<Key>::value,
+			"adaptive_unsigned_map : key must be unsigned integer");
+
+	using key_type = Key;
+	using mapped_type = T;
+	using value_type = mapped_type;
+	using size_type = std::size_t;
+	using difference_type = std::ptrdiff_t;
+	using pos_type = key_type;
+
+	using reference = value_type&;
+	using const_reference = const value_type&;
+	using pointer = value_type*;
+	using const_pointer = const value_type*;
+
+	using iterator = typename std::vector<value_type>::iterator;
+	using const_iterator = typename std::vector<value_type>::const_iterator;
+
+	adaptive_unsigned_map() = default;
+	explicit adaptive_unsigned_map(size_type reserve_count) {
+		reserve(reserve_count);
+	}
+
+
+	// Iterators
+
+	// returns an iterator to the beginning
+	iterator begin() noexcept {
+		return _values.begin();
+	}
+	const_iterator begin() const noexcept {
+		return _values.begin();
+	}
+	const_iterator cbegin() const noexcept {
+		return begin();
+	}
+
+	// returns an iterator to the end (one past last)
+	iterator end() noexcept {
+		return _values.end();
+	}
+	const_iterator end() const noexcept {
+		return _values.end();
+	}
+	const_iterator cend() const noexcept {
+		return end();
+	}
+
+	// returns the keys, in value order
+	detail::flat_hashmap_range<const key_type*> keys() const noexcept {
+		if (!_direct) {
+			return _lookup.keys();
+		}
+		return { _keys.data(), _keys.data() + _keys.size() };
+	}
+
+
+	// Capacity
+
+	// checks whether the container is empty
+	bool empty() const noexcept {
+		return _values.empty();
+	}
+
+	// returns the number of elements
+	size_type size() const noexcept {
+		return _values.size();
+	}
+
+	// returns the maximum possible number of elements
+	size_type max_size() const noexcept {
+		// -1 due to sentinel
+		return pos_sentinel() - 1;
+	}
+
+	// reserves storage for values
+	// the direct table grows with the keys, not the values
+	void reserve(size_type new_cap) {
+		_values.reserve(new_cap);
+		if (_direct) {
+			_keys.reserve(new_cap);
+		} else {
+			_lookup.reserve(new_cap);
+		}
+	}
+
+	// returns the number of elements that can be held in currently
+	// allocated storage
+	size_type capacity() const noexcept {
+		return _values.capacity();
+	}
+
+	// reduces memory usage by freeing unused memory
+	void shrink_to_fit() {
+		_values.shrink_to_fit();
+		_keys.shrink_to_fit();
+		_value_indexes.shrink_to_fit();
+		_lookup.shrink_to_fit();
+	}
+
+
+	// Layout
+
+	// returns true when using a direct index table, false when hashed
+	bool is_direct() const noexcept {
+		return _direct;
+	}
+
+	// returns the biggest key + 1
+	// when the biggest key of a hashed map is erased, it is updated lazily
+	size_type key_span() const noexcept {
+		return _key_span;
+	}
+
+	// returns the density under which the map migrates to a hashed lookup
+	float min_density() const noexcept {
+		return _min_density;
+	}
+
+	// returns the density over which the map migrates to a direct table
+	float max_density() const noexcept {
+		return _max_density;
+	}
+
+	// sets the migration thresholds, 0 <= min_d <= max_d
+	// a min_d of 0 never migrates to a hashed lookup, a max_d over 1 never
+	// migrates back to a direct table
+	void density_thresholds(float min_d, float max_d) {
+		if (!(min_d >= 0.f && min_d <= max_d)) {
+			throw std::invalid_argument{
+				"adaptive_unsigned_map : min density must be between 0 and "
+				"max density"
+			};
+		}
+		_min_density = min_d;
+		_max_density = max_d;
+	}
+
+
+	// Modifiers
+
+	// clears the contents, the map is direct again
+	void clear() noexcept {
+		_values.clear();
+		_keys.clear();
+		_value_indexes.clear();
+		_lookup.clear();
+		_key_span = 0;
+		_span_recheck = 0;
+		_direct = true;
+	}
+
+	// inserts an element, if the key doesn't exist
+	std::pair<iterator, bool> insert(key_type key, const value_type& value) {
+		return try_emplace(key, value);
+	}
+	std::pair<iterator, bool> insert(key_type key, value_type&& value) {
+		return try_emplace(key, std::move(value));
+	}
+
+	// inserts an element or assigns to the current element if the key
+	// already exists
+	template <class M>
+	std::pair<iterator, bool> insert_or_assign(key_type key, M&& obj) {
+		auto ret = try_emplace(key, std::forward<M>(obj));
+		if (!ret.second) {
+			*ret.first = std::forward<M>(obj);
+		}
+		return ret;
+	}
+
+	// inserts in-place if the key does not exist, does nothing if the key
+	// exists
+	template <class... Args>
+	std::pair<iterator, bool> try_emplace(key_type key, Args&&... args) {
+		if (_direct && !fits_direct(key)) {
+			migrate_to_hashed();
+		}
+
+		if (_direct) {
+			return direct_emplace(key, std::forward<Args>(args)...);
+		}
+		return hashed_emplace(key, std::forward<Args>(args)...);
+	}
+
+	// erases an element
+	// moves the last value into its position
+	// returns the number of erased elements
+	size_type erase(key_type key) {
+		if (!_direct) {
+			// The lookup swaps and pops, the values follow.
+			std::pair<size_type, bool> ret = _lookup.erase_index(key);
+			if (!ret.second) {
+				return 0;
+			}
+
+			erase_value(ret.first);
+			if (span_of(key) == _key_span && _span_recheck == 0) {
+				// Recomputing the span on every erase would be quadratic,
+				// recompute it after as many inserts as there are keys.
+				_span_recheck = size() + 1;
+			}
+			return 1;
+		}
+
+		size_type pos = position(key);
+		if (pos == size()) {
+			return 0;
+		}
+
+		erase_value(pos);
+		key_type last = _keys.back();
+		_keys[pos] = last;
+		_keys.pop_back();
+		_value_indexes[size_t(last)] = pos_type(pos);
+		_value_indexes[size_t(key)] = pos_sentinel();
+
+		// Trims the trailing empty slots, so the span follows the biggest
+		// key. Every slot is trimmed at most once per growth.
+		while (!_value_indexes.empty()
+				&& _value_indexes.back() == pos_sentinel()) {
+			_value_indexes.pop_back();
+		}
+		_key_span = _value_indexes.size();
+
+		if (too_sparse(size(), double(_key_span))) {
+			migrate_to_hashed();
+		}
+		return 1;
+	}
+
+	// swaps the contents
+	void swap(adaptive_unsigned_map& other) noexcept {
+		_values.swap(other._values);
+		_keys.swap(other._keys);
+		_value_indexes.swap(other._value_indexes);
+		_lookup.swap(other._lookup);
+		std::swap(_key_span, other._key_span);
+		std::swap(_span_recheck, other._span_recheck);
+		std::swap(_min_density, other._min_density);
+		std::swap(_max_density, other._max_density);
+		std::swap(_direct, other._direct);
+	}
+
+
+	// Lookup
+
+	// direct access to the packed values
+	const value_type* data() const noexcept {
+		return _values.data();
+	}
+	value_type* data() noexcept {
+		return _values.data();
+	}
+
+	// access specified element with bounds checking
+	const mapped_type& at(key_type key) const {
+		size_type pos = position(key);
+		if (pos == size()) {
+			throw std::out_of_range{
+				"adaptive_unsigned_map : value doesn't exist"
+			};
+		}
+		return _values[pos];
+	}
+	mapped_type& at(key_type key) {
+		return const_cast<mapped_type&>(
+				static_cast<const adaptive_unsigned_map*>(this)->at(key));
+	}
+
+	// access specified element without any bounds checking
+	const mapped_type& at_unchecked(key_type key) const {
+		return _values[position(key)];
+	}
+	mapped_type& at_unchecked(key_type key) {
+		return _values[position(key)];
+	}
+
+	// access or insert specified element
+	mapped_type& operator[](key_type key) {
+		return *try_emplace(key).first;
+	}
+
+	// returns the number of elements matching specific key (which is 1 or 0,
+	// since there are no duplicates)
+	size_type count(key_type key) const {
+		return position(key) != size() ? 1 : 0;
+	}
+
+	// finds element with specific key
+	const_iterator find(key_type key) const {
+		return begin() + difference_type(position(key));
+	}
+	iterator find(key_type key) {
+		return begin() + difference_type(position(key));
+	}
+
+	// checks if the container contains element with specific key
+	bool contains(key_type key) const {
+		return position(key) != size();
+	}
+
+private:
+	using lookup_type
+			= flat_unsigned_hashmap<key_type, detail::adaptive_map_slot>;
+
+	static constexpr pos_type pos_sentinel() noexcept {
+		return (std::numeric_limits<pos_type>::max)();
+	}
+
+	// Direct tables up to this span are always allowed, they're tiny.
+	static constexpr size_type min_direct_span() noexcept {
+		return 1'024;
+	}
+
+	// Moves the last value into pos.
+	void erase_value(size_type pos) {
+		if (pos != _values.size() - 1) {
+			_values[pos] = detail::flathashmap_maybe_move(_values.back());
+		}
+		_values.pop_back();
+	}
+
+	// Returns the position of key in the values, or size().
+	size_type position(key_type key) const noexcept {
+		if (!_direct) {
+			return size_type(_lookup.find(key) - _lookup.begin());
+		}
+
+		if (size_t(key) >= _value_indexes.size()) {
+			return size();
+		}
+		pos_type pos = _value_indexes[size_t(key)];
+		return pos == pos_sentinel() ? size() : size_type(pos);
+	}
+
+	// The span of key, saturated for the biggest key_type.
+	static size_t span_of(key_type key) noexcept {
+		size_t k = size_t(key);
+		return k == (std::numeric_limits<size_t>::max)() ? k : k + 1;
+	}
+
+	// Returns the exact key span, in O(n).
+	static size_t span_of(const key_type* first, const key_type* last) {
+		size_t ret = 0;
+		for (; first != last; ++first) {
+			ret = (std::max)(ret, span_of(*first));
+		}
+		return ret;
+	}
+
+	// Spans are compared as doubles, the biggest key + 1 may overflow.
+	bool too_sparse(size_type count, double span) const noexcept {
+		return span > double(min_direct_span())
+				&& double(count) < span * double(_min_density);
+	}
+	bool dense_enough(size_type count, double span) const noexcept {
+		return span <= double(min_direct_span())
+				|| double(count) >= span * double(_max_density);
+	}
+
+	// Whether inserting key keeps the direct table dense enough.
+	bool fits_direct(key_type key) const noexcept {
+		if (size_t(key) < _value_indexes.size()) {
+			return true;
+		}
+		if (size_t(key) >= _value_indexes.max_size()) {
+			return false;
+		}
+		return !too_sparse(size() + 1, double(key) + 1.0);
+	}
+
+	template <class... Args>
+	std::pair<iterator, bool> direct_emplace(key_type key, Args&&... args) {
+		size_t k = size_t(key);
+		if (k < _value_indexes.size() && _value_indexes[k] != pos_sentinel()) {
+			return { begin() + difference_type(_value_indexes[k]), false };
+		}
+		if (size() == max_size()) {
+			throw std::out_of_range{
+				"adaptive_unsigned_map : maximum size reached"
+			};
+		}
+
+		// Grows the table first, extra sentinels are harmless if the value
+		// throws.
+		if (k >= _value_indexes.size()) {
+			_value_indexes.resize(k + 1, pos_sentinel());
+			_key_span = _value_indexes.size();
+		}
+
+		_keys.push_back(key);
+		try {
+			_values.emplace_back(std::forward<Args>(args)...);
+		} catch (...) {
+			_keys.pop_back();
+			throw;
+		}
+		_value_indexes[k] = pos_type(_values.size() - 1);
+		return { _values.end() - 1, true };
+	}
+
+	template <class... Args>
+	std::pair<iterator, bool> hashed_emplace(key_type key, Args&&... args) {
+		auto ret = _lookup.insert(key, detail::adaptive_map_slot{});
+		if (!ret.second) {
+			return { begin() + (ret.first - _lookup.begin()), false };
+		}
+
+		try {
+			_values.emplace_back(std::forward<Args>(args)...);
+		} catch (...) {
+			_lookup.erase(key);
+			throw;
+		}
+
+		if (span_of(key) > _key_span) {
+			_key_span = span_of(key);
+		}
+		if (_span_recheck != 0 && --_span_recheck == 0) {
+			_key_span = span_of(_lookup.keys().begin(), _lookup.keys().end());
+		}
+		if (dense_enough(size(), double(_key_span))) {
+			migrate_to_direct();
+		}
+		return { _values.end() - 1, true };
+	}
+
+	// Moves the keys into a hashed lookup and frees the direct table. The
+	// lookup's positions match the values, since keys go in in value order.
+	// The lookup is built aside, the map is unchanged if it throws.
+	void migrate_to_hashed() {
+		assert(_direct);
+		assert(_lookup.empty());
+		lookup_type lookup;
+		lookup.reserve(_keys.size());
+		for (key_type k : _keys) {
+			lookup.insert(k, detail::adaptive_map_slot{});
+		}
+
+		_lookup.swap(lookup);
+		_key_span = span_of(_keys.data(), _keys.data() + _keys.size());
+		_span_recheck = 0;
+		_keys = std::vector<key_type>{};
+		_value_indexes = std::vector<pos_type>{};
+		_direct = false;
+	}
+
+	// Builds a direct table sized to the biggest key, and frees the hashed
+	// lookup. The table is built aside, like migrate_to_hashed.
+	void migrate_to_direct() {
+		assert(!_direct);
+		std::vector<key_type> keys(
+				_lookup.keys().begin(), _lookup.keys().end());
+
+		size_t span = span_of(keys.data(), keys.data() + keys.size());
+		std::vector<pos_type> value_indexes(span, pos_sentinel());
+		for (size_t i = 0; i < keys.size(); ++i) {
+			value_indexes[size_t(keys[i])] = pos_type(i);
+		}
+
+		_keys.swap(keys);
+		_value_indexes.swap(value_indexes);
+		_lookup = lookup_type{};
+		_key_span = span;
+		_span_recheck = 0;
+		_direct = true;
+	}
+
+	// Packed values, in the order of keys().
+	std::vector<value_type> _values;
+
+	// Direct layout, the keys of values and the position of each key.
+	std::vector<key_type> _keys;
+	std::vector<pos_type> _value_indexes;
+
+	// Hashed layout, the key of each value is at the same position in the
+	// lookup's packed slots.
+	lookup_type _lookup;
+
+	// The biggest key + 1. Hashed, it can be bigger once the biggest key is
+	// erased, see _span_recheck.
+	size_t _key_span = 0;
+	// Hashed inserts left until a stale key span is recomputed, 0 when it is
+	// up to date.
+	size_t _span_recheck = 0;
+	float _min_density = 1.f / 16.f;
+	float _max_density = 1.f / 8.f;
+	bool _direct = true;
+};
+} // namespace fea
@@ -0,0 +1,198 @@
+﻿/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Philippe Groarke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+/*
+A monotonic arena and its allocator.
+
+The arena hands out memory linearly from a caller supplied buffer. When the
+buffer runs out, it allocates bigger overflow blocks from the global heap.
+Deallocation does nothing, memory is reclaimed all at once with release() or
+when the arena is destroyed.
+
+Use it for short-lived maps, ex. all the maps built during a request :
+	std::array<char, 16'384> buf;
+	fea::monotonic_arena arena{ buf.data(), buf.size() };
+	fea::flat_unsigned_hashmap<unsigned, float, fea::arena_allocator<float>>
+			map{ fea::arena_allocator<float>{ arena } };
+
+With c++17, std::pmr::monotonic_buffer_resource and the fea::pmr maps are
+equivalent.
+*/
+
+namespace fea {
+struct monotonic_arena {
+	monotonic_arena() noexcept = default;
+	monotonic_arena(void* buffer, size_t size) noexcept
+			: _buffer(static_cast<char*>(buffer))
+			, _buffer_size(size)
+			, _current(_buffer)
+			, _end(_buffer + size) {
+		if (size > min_block_size()) {
+			_next_block_size = size * 2;
+		}
+	}
+	~monotonic_arena() {
+		release();
+	}
+
+	monotonic_arena(const monotonic_arena&) = delete;
+	monotonic_arena(monotonic_arena&&) = delete;
+	monotonic_arena& operator=(const monotonic_arena&) = delete;
+	monotonic_arena& operator=(monotonic_arena&&) = delete;
+
+	// returns size bytes aligned to alignment
+	void* allocate(size_t size, size_t alignment) {
+		void* ret = bump(size, alignment);
+		if (ret != nullptr) {
+			return ret;
+		}
+
+		add_block(size + alignment);
+		ret = bump(size, alignment);
+		assert(ret != nullptr);
+		return ret;
+	}
+
+	// frees the overflow blocks and rewinds to the start of the caller buffer
+	// all memory previously handed out is invalidated
+	void release() noexcept {
+		while (_blocks != nullptr) {
+			block_header* next = _blocks->next;
+			::operator delete(_blocks);
+			_blocks = next;
+		}
+
+		_current = _buffer;
+		_end = _buffer + _buffer_size;
+	}
+
+	// returns true if the arena had to allocate from the global heap
+	bool overflowed() const noexcept {
+		return _blocks != nullptr;
+	}
+
+private:
+	struct block_header {
+		block_header* next;
+	};
+
+	static constexpr size_t min_block_size() noexcept {
+		return 4'096;
+	}
+
+	void* bump(size_t size, size_t alignment) noexcept {
+		void* ptr = _current;
+		size_t space = size_t(_end - _current);
+		if (std::align(alignment, size, ptr, space) == nullptr) {
+			return nullptr;
+		}
+
+		_current = static_cast<char*>(ptr) + size;
+		return ptr;
+	}
+
+	void add_block(size_t min_size) {
+		size_t block_size = sizeof(block_header) + min_size;
+		if (block_size < _next_block_size) {
+			block_size = _next_block_size;
+		}
+
+		block_header* block
+				= static_cast<block_header*>(::operator new(block_size));
+		block->next = _blocks;
+		_blocks = block;
+
+		_current = reinterpret_cast<char*>(block + 1);
+		_end = reinterpret_cast<char*>(block) + block_size;
+		_next_block_size = block_size * 2;
+	}
+
+	char* _buffer = nullptr;
+	size_t _buffer_size = 0;
+
+	char* _current = nullptr;
+	char* _end = nullptr;
+
+	// Overflow blocks, most recent first.
+	block_header* _blocks = nullptr;
+	size_t _next_block_size = min_block_size();
+};
+
+// Allocates from a monotonic_arena, deallocate is a no-op.
+// The allocator propagates with its container, the arena must outlive all
+// containers using it.
+template <class T>
+struct arena_allocator {
+	using value_type = T;
+	using propagate_on_container_copy_assignment = std::true_type;
+	using propagate_on_container_move_assignment = std::true_type;
+	using propagate_on_container_swap = std::true_type;
+
+	arena_allocator(monotonic_arena& arena) noexcept
+			: _arena(&arena) {
+	}
+	template <class U>
+	arena_allocator(const arena_allocator<U>& other) noexcept
+			: _arena(other.arena()) {
+	}
+
+	T* allocate(size_t n) {
+		return static_cast<T*>(_arena->allocate(n * sizeof(T), alignof(T)));
+	}
+	void deallocate(T*, size_t) noexcept {
+	}
+
+	monotonic_arena* arena() const noexcept {
+		return _arena;
+	}
+
+private:
+	monotonic_arena* _arena;
+};
+
+template <class T, class U>
+inline bool operator==(
+		const arena_allocator<T>& lhs, const arena_allocator<U>& rhs) noexcept {
+	return lhs.arena() == rhs.arena();
+}
+template <class T, class U>
+inline bool operator!=(
+		const arena_allocator<T>& lhs, const arena_allocator<U>& rhs) noexcept {
+	return !(lhs == rhs);
+}
+} // namespace fea
@@ -0,0 +1,581 @@
+﻿/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Philippe Groarke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+A vector made of fixed size chunks, found through a chunk table.
+
+Growing never moves existing elements, pointers and references stay valid
+until the element is erased. Iterators are invalidated by growth, like
+std::vector. Elements aren't contiguous, iterate_chunks() provides the
+contiguous spans.
+
+The maps use it through the chunked_values storage policy :
+	fea::flat_unsigned_hashmap<unsigned, big_obj, std::allocator<big_obj>,
+			fea::chunked_values<256>> map;
+*/
+
+namespace fea {
+namespace detail {
+template <class T, size_t ChunkSize>
+struct chunked_iterator {
+	using iterator_category = std::random_access_iterator_tag;
+	using value_type = typename std::remove_const<T>::type;
+	using difference_type = std::ptrdiff_t;
+	using pointer = T*;
+	using reference = T&;
+
+	chunked_iterator() noexcept = default;
+	chunked_iterator(T* const* chunks, size_t idx) noexcept
+			: _chunks(chunks)
+			, _idx(idx) {
+	}
+
+	// iterator to const_iterator
+	template <class U,
+			class = typename std::enable_if<!std::is_same<U, T>::value
+					&& std::is_same<const U, T>::value>::type>
+	chunked_iterator(const chunked_iterator<U, ChunkSize>& other) noexcept
+			: _chunks(other.chunks())
+			, _idx(other.index()) {
+	}
+
+	reference operator*() const noexcept {
+		return _chunks[_idx / ChunkSize][_idx % ChunkSize];
+	}
+	pointer operator->() const noexcept {
+		return &**this;
+	}
+	reference operator[](difference_type n) const noexcept {
+		return *(*this + n);
+	}
+
+	chunked_iterator& operator++() noexcept {
+		++_idx;
+		return *this;
+	}
+	chunked_iterator operator++(int) noexcept {
+		chunked_iterator ret = *this;
+		++_idx;
+		return ret;
+	}
+	chunked_iterator& operator--() noexcept {
+		--_idx;
+		return *this;
+	}
+	chunked_iterator operator--(int) noexcept {
+		chunked_iterator ret = *this;
+		--_idx;
+		return ret;
+	}
+	chunked_iterator& operator+=(difference_type n) noexcept {
+		_idx = size_t(difference_type(_idx) + n);
+		return *this;
+	}
+	chunked_iterator& operator-=(difference_type n) noexcept {
+		_idx = size_t(difference_type(_idx) - n);
+		return *this;
+	}
+
+	friend chunked_iterator operator+(
+			chunked_iterator it, difference_type n) noexcept {
+		return it += n;
+	}
+	friend chunked_iterator operator+(
+			difference_type n, chunked_iterator it) noexcept {
+		return it += n;
+	}
+	friend chunked_iterator operator-(
+			chunked_iterator it, difference_type n) noexcept {
+		return it -= n;
+	}
+	friend difference_type operator-(const chunked_iterator& lhs,
+			const chunked_iterator& rhs) noexcept {
+		return difference_type(lhs._idx) - difference_type(rhs._idx);
+	}
+
+	friend bool operator==(const chunked_iterator& lhs,
+			const chunked_iterator& rhs) noexcept {
+		return lhs._idx == rhs._idx;
+	}
+	friend bool operator!=(const chunked_iterator& lhs,
+			const chunked_iterator& rhs) noexcept {
+		return lhs._idx != rhs._idx;
+	}
+	friend bool operator<(const chunked_iterator& lhs,
+			const chunked_iterator& rhs) noexcept {
+		return lhs._idx < rhs._idx;
+	}
+	friend bool operator>(const chunked_iterator& lhs,
+			const chunked_iterator& rhs) noexcept {
+		return lhs._idx > rhs._idx;
+	}
+	friend bool operator<=(const chunked_iterator& lhs,
+			const chunked_iterator& rhs) noexcept {
+		return lhs._idx <= rhs._idx;
+	}
+	friend bool operator>=(const chunked_iterator& lhs,
+			const chunked_iterator& rhs) noexcept {
+		return lhs._idx >= rhs._idx;
+	}
+
+	T* const* chunks() const noexcept {
+		return _chunks;
+	}
+	size_t index() const noexcept {
+		return _idx;
+	}
+
+private:
+	T* const* _chunks = nullptr;
+	size_t _idx = 0;
+};
+} // namespace detail
+
+template <class T, size_t ChunkSize = 1024, class Alloc = std::allocator<T>>
+struct chunked_vector {
+	static_assert(ChunkSize != 0 && (ChunkSize & (ChunkSize - 1)) == 0,
+			"chunked_vector : ChunkSize must be a power of 2");
+	static_assert(std::is_same<typename std::allocator_traits<
+									   Alloc>::value_type,
+						  T>::value,
+			"chunked_vector : allocator value_type must be T");
+
+	using value_type = T;
+	using allocator_type = Alloc;
+	using size_type = std::size_t;
+	using difference_type = std::ptrdiff_t;
+
+	using reference = value_type&;
+	using const_reference = const value_type&;
+	using pointer = value_type*;
+	using const_pointer = const value_type*;
+
+	using iterator = detail::chunked_iterator<value_type, ChunkSize>;
+	using const_iterator
+			= detail::chunked_iterator<const value_type, ChunkSize>;
+	using reverse_iterator = std::reverse_iterator<iterator>;
+	using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+
+	// Constructors, destructors and assignement
+
+	chunked_vector() = default;
+	explicit chunked_vector(const allocator_type& alloc) noexcept
+			: _alloc(alloc)
+			, _chunks(alloc) {
+	}
+
+	chunked_vector(const chunked_vector& other)
+			: chunked_vector(other,
+					alloc_traits::select_on_container_copy_construction(
+							other._alloc)) {
+	}
+	chunked_vector(const chunked_vector& other, const allocator_type& alloc)
+			: chunked_vector(alloc) {
+		reserve(other.size());
+		for (const value_type& v : other) {
+			emplace_back(v);
+		}
+	}
+
+	chunked_vector(chunked_vector&& other) noexcept
+			: _alloc(std::move(other._alloc))
+			, _chunks(std::move(other._chunks))
+			, _size(other._size) {
+		other._chunks.clear();
+		other._size = 0;
+	}
+	chunked_vector(chunked_vector&& other, const allocator_type& alloc)
+			: chunked_vector(alloc) {
+		if (_alloc == other._alloc) {
+			_chunks.swap(other._chunks);
+			std::swap(_size, other._size);
+			return;
+		}
+
+		reserve(other.size());
+		for (value_type& v : other) {
+			emplace_back(std::move(v));
+		}
+	}
+
+	~chunked_vector() {
+		clear();
+		for (pointer chunk : _chunks) {
+			alloc_traits::deallocate(_alloc, chunk, ChunkSize);
+		}
+	}
+
+	chunked_vector& operator=(const chunked_vector& other) {
+		if (this == &other) {
+			return *this;
+		}
+
+		chunked_vector tmp(other,
+				alloc_traits::propagate_on_container_copy_assignment::value
+						? other._alloc
+						: _alloc);
+		swap_imp(tmp);
+		return *this;
+	}
+	chunked_vector& operator=(chunked_vector&& other) {
+		if (this == &other) {
+			return *this;
+		}
+
+		if (alloc_traits::propagate_on_container_move_assignment::value
+				|| _alloc == other._alloc) {
+			chunked_vector tmp(std::move(other));
+			swap_imp(tmp);
+			return *this;
+		}
+
+		chunked_vector tmp(std::move(other), _alloc);
+		swap_imp(tmp);
+		return *this;
+	}
+
+	// returns the allocator associated with the container
+	allocator_type get_allocator() const noexcept {
+		return _alloc;
+	}
+
+
+	// Element access
+
+	reference operator[](size_type i) noexcept {
+		assert(i < _size);
+		return *slot(i);
+	}
+	const_reference operator[](size_type i) const noexcept {
+		assert(i < _size);
+		return *slot(i);
+	}
+
+	reference front() noexcept {
+		return (*this)[0];
+	}
+	const_reference front() const noexcept {
+		return (*this)[0];
+	}
+	reference back() noexcept {
+		return (*this)[_size - 1];
+	}
+	const_reference back() const noexcept {
+		return (*this)[_size - 1];
+	}
+
+	// calls func(first, last) on every chunk's contiguous span of elements,
+	// in order
+	template <class Func>
+	void iterate_chunks(Func&& func) {
+		for (size_type i = 0; i < _size; i += ChunkSize) {
+			pointer first = _chunks[i / ChunkSize];
+			size_type count = _size - i < ChunkSize ? _size - i : ChunkSize;
+			func(first, first + count);
+		}
+	}
+	template <class Func>
+	void iterate_chunks(Func&& func) const {
+		for (size_type i = 0; i < _size; i += ChunkSize) {
+			const_pointer first = _chunks[i / ChunkSize];
+			size_type count = _size - i < ChunkSize ? _size - i : ChunkSize;
+			func(first, first + count);
+		}
+	}
+
+
+	// Iterators
+
+	iterator begin() noexcept {
+		return { _chunks.data(), 0 };
+	}
+	const_iterator begin() const noexcept {
+		return { _chunks.data(), 0 };
+	}
+	const_iterator cbegin() const noexcept {
+		return begin();
+	}
+
+	iterator end() noexcept {
+		return { _chunks.data(), _size };
+	}
+	const_iterator end() const noexcept {
+		return { _chunks.data(), _size };
+	}
+	const_iterator cend() const noexcept {
+		return end();
+	}
+
+	reverse_iterator rbegin() noexcept {
+		return reverse_iterator(end());
+	}
+	const_reverse_iterator rbegin() const noexcept {
+		return const_reverse_iterator(end());
+	}
+	const_reverse_iterator crbegin() const noexcept {
+		return rbegin();
+	}
+
+	reverse_iterator rend() noexcept {
+		return reverse_iterator(begin());
+	}
+	const_reverse_iterator rend() const noexcept {
+		return const_reverse_iterator(begin());
+	}
+	const_reverse_iterator crend() const noexcept {
+		return rend();
+	}
+
+
+	// Capacity
+
+	bool empty() const noexcept {
+		return _size == 0;
+	}
+	size_type size() const noexcept {
+		return _size;
+	}
+	size_type max_size() const noexcept {
+		return (std::numeric_limits<difference_type>::max)()
+				/ sizeof(value_type);
+	}
+
+	// allocates chunks until new_cap elements fit
+	void reserve(size_type new_cap) {
+		if (capacity() >= new_cap) {
+			return;
+		}
+
+		_chunks.reserve((new_cap + ChunkSize - 1) / ChunkSize);
+		while (capacity() < new_cap) {
+			add_chunk();
+		}
+	}
+	size_type capacity() const noexcept {
+		return _chunks.size() * ChunkSize;
+	}
+
+	// returns the bytes held by the chunks and the chunk table
+	size_t memory_reserved() const noexcept {
+		return capacity() * sizeof(T) + _chunks.capacity() * sizeof(pointer);
+	}
+
+	// frees the unused chunks
+	void shrink_to_fit() {
+		size_type used_chunks = (_size + ChunkSize - 1) / ChunkSize;
+		while (_chunks.size() > used_chunks) {
+			alloc_traits::deallocate(_alloc, _chunks.back(), ChunkSize);
+			_chunks.pop_back();
+		}
+		_chunks.shrink_to_fit();
+	}
+
+
+	// Modifiers
+
+	// destroys the elements, keeps the chunks
+	void clear() noexcept {
+		destroy_range(0, _size);
+		_size = 0;
+	}
+
+	// erases [first, last), moves the following elements down
+	iterator erase(const_iterator first, const_iterator last) {
+		size_type dst = first.index();
+		size_type src = last.index();
+		if (dst == src) {
+			return begin() + difference_type(dst);
+		}
+
+		for (; src < _size; ++src, ++dst) {
+			(*this)[dst] = std::move((*this)[src]);
+		}
+		destroy_range(dst, _size);
+		_size = dst;
+		return begin() + difference_type(first.index());
+	}
+
+	void push_back(const value_type& value) {
+		emplace_back(value);
+	}
+	void push_back(value_type&& value) {
+		emplace_back(std::move(value));
+	}
+
+	template <class... Args>
+	reference emplace_back(Args&&... args) {
+		if (_size == capacity()) {
+			add_chunk();
+		}
+
+		pointer ptr = slot(_size);
+		alloc_traits::construct(_alloc, ptr, std::forward<Args>(args)...);
+		++_size;
+		return *ptr;
+	}
+
+	void pop_back() noexcept {
+		assert(!empty());
+		--_size;
+		alloc_traits::destroy(_alloc, slot(_size));
+	}
+
+	void resize(size_type count) {
+		if (count < _size) {
+			destroy_range(count, _size);
+			_size = count;
+			return;
+		}
+
+		reserve(count);
+		while (_size < count) {
+			emplace_back();
+		}
+	}
+
+	void swap(chunked_vector& other) noexcept {
+		swap_imp(other);
+	}
+
+private:
+	using alloc_traits = std::allocator_traits<allocator_type>;
+	using chunk_table = std::vector<pointer,
+			typename alloc_traits::template rebind_alloc<pointer>>;
+
+	pointer slot(size_type i) const noexcept {
+		return _chunks[i / ChunkSize] + i % ChunkSize;
+	}
+
+	// The table grows geometrically first, so a throwing push_back
+	// doesn't leak the new chunk.
+	void add_chunk() {
+		_chunks.push_back(nullptr);
+		try {
+			_chunks.back() = alloc_traits::allocate(_alloc, ChunkSize);
+		} catch (...) {
+			_chunks.pop_back();
+			throw;
+		}
+	}
+
+	void destroy_range(size_type first, size_type last) noexcept {
+		if (std::is_trivially_destructible<value_type>::value) {
+			return;
+		}
+		for (size_type i = first; i < last; ++i) {
+			alloc_traits::destroy(_alloc, slot(i));
+		}
+	}
+
+	void swap_imp(chunked_vector& other) noexcept {
+		using std::swap;
+		swap(_alloc, other._alloc);
+		_chunks.swap(other._chunks);
+		swap(_size, other._size);
+	}
+
+	allocator_type _alloc;
+
+	// Each chunk holds ChunkSize elements.
+	chunk_table _chunks;
+	size_type _size = 0;
+};
+
+template <class T, size_t N, class A>
+inline void swap(chunked_vector<T, N, A>& lhs, chunked_vector<T, N, A>& rhs) {
+	lhs.swap(rhs);
+}
+
+
+// Value storage policies of the maps.
+
+// Values are stored in a single std::vector. Growth moves all the values.
+// Provides data().
+struct contiguous_values {
+	template <class T, class Alloc>
+	using container = std::vector<T, Alloc>;
+
+	// returns the bytes reserved by the container
+	template <class T, class Alloc>
+	static size_t memory_reserved(const container<T, Alloc>& c) noexcept {
+		return c.capacity() * sizeof(T);
+	}
+};
+
+// Values are stored in a chunked_vector of ChunkSize values per chunk.
+// Growth never moves existing values. There is no data(), use
+// iterate_chunks().
+template <size_t ChunkSize = 1024>
+struct chunked_values {
+	template <class T, class Alloc>
+	using container = chunked_vector<T, ChunkSize, Alloc>;
+
+	// returns the bytes reserved by the container, chunk table included
+	template <class T, class Alloc>
+	static size_t memory_reserved(const container<T, Alloc>& c) noexcept {
+		return c.memory_reserved();
+	}
+};
+
+namespace detail {
+template <class T, class A, class Func>
+void iterate_chunks(std::vector<T, A>& vec, Func& func) {
+	if (!vec.empty()) {
+		func(vec.data(), vec.data() + vec.size());
+	}
+}
+template <class T, class A, class Func>
+void iterate_chunks(const std::vector<T, A>& vec, Func& func) {
+	if (!vec.empty()) {
+		func(vec.data(), vec.data() + vec.size());
+	}
+}
+template <class T, size_t N, class A, class Func>
+void iterate_chunks(chunked_vector<T, N, A>& vec, Func& func) {
+	vec.iterate_chunks(func);
+}
+template <class T, size_t N, class A, class Func>
+void iterate_chunks(const chunked_vector<T, N, A>& vec, Func& func) {
+	vec.iterate_chunks(func);
+}
+} // namespace detail
+} // namespace fea
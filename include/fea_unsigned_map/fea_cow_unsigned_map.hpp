@@ -0,0 +1,243 @@
+﻿/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Philippe Groarke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+/*
+A copy-on-write handle on an unsigned_map or a flat_unsigned_hashmap.
+Copies and snapshots share the map and are O(1). The map is copied on the
+first write, only if it is still shared.
+
+	fea::cow_unsigned_map<fea::unsigned_map<unsigned, int>> map;
+	map.write().insert({ 0, 42 });
+
+	// Hand an immutable snapshot to a reader thread.
+	auto snap = map.snapshot();
+	std::thread t{ [snap]() { read(*snap); } };
+
+	// Copies the map, the reader keeps its version.
+	map.write().insert({ 1, 43 });
+
+Handles can be copied, read and destroyed from many threads. A single handle
+isn't thread safe, like any container : give each thread its own snapshot.
+
+The whole map is shared and copied at once. Write to the map returned by
+write() as often as needed, it is only copied the first time after a
+snapshot.
+*/
+
+namespace fea {
+namespace detail {
+template <class Map>
+struct cow_unsigned_map_block {
+	template <class... Args>
+	explicit cow_unsigned_map_block(Args&&... args)
+			: map(std::forward<Args>(args)...) {
+	}
+
+	std::atomic<size_t> refs{ 1 };
+	Map map;
+};
+} // namespace detail
+
+template <class Map>
+struct cow_unsigned_map {
+	using map_type = Map;
+	using key_type = typename map_type::key_type;
+	using mapped_type = typename map_type::mapped_type;
+	using value_type = typename map_type::value_type;
+	using size_type = typename map_type::size_type;
+	using const_iterator = typename map_type::const_iterator;
+
+	cow_unsigned_map()
+			: _block(new block_type{}) {
+	}
+	explicit cow_unsigned_map(const map_type& map)
+			: _block(new block_type{ map }) {
+	}
+	explicit cow_unsigned_map(map_type&& map)
+			: _block(new block_type{ std::move(map) }) {
+	}
+
+	// shares the map
+	cow_unsigned_map(const cow_unsigned_map& other) noexcept
+			: _block(other._block) {
+		acquire();
+	}
+	// the moved from handle reads as an empty map, write() gives it a new
+	// one
+	cow_unsigned_map(cow_unsigned_map&& other) noexcept
+			: _block(other._block) {
+		other._block = nullptr;
+	}
+	~cow_unsigned_map() {
+		release();
+	}
+
+	cow_unsigned_map& operator=(const cow_unsigned_map& other) noexcept {
+		cow_unsigned_map tmp{ other };
+		swap(tmp);
+		return *this;
+	}
+	cow_unsigned_map& operator=(cow_unsigned_map&& other) noexcept {
+		cow_unsigned_map tmp{ std::move(other) };
+		swap(tmp);
+		return *this;
+	}
+
+
+	// Sharing
+
+	// returns a handle sharing this map, O(1)
+	// it never sees the writes made through this handle
+	cow_unsigned_map snapshot() const noexcept {
+		return *this;
+	}
+
+	// returns the map for writing, copies it first if it is shared
+	// don't keep the reference after taking a snapshot, call write() again
+	map_type& write() {
+		if (_block == nullptr) {
+			_block = new block_type{};
+		} else if (shared()) {
+			detach();
+		}
+		return _block->map;
+	}
+
+	// checks whether other handles share the map
+	bool shared() const noexcept {
+		return _block != nullptr
+				&& _block->refs.load(std::memory_order_acquire) != 1;
+	}
+
+	// returns the number of handles sharing the map, 0 once moved from
+	size_t use_count() const noexcept {
+		if (_block == nullptr) {
+			return 0;
+		}
+		return _block->refs.load(std::memory_order_acquire);
+	}
+
+	void swap(cow_unsigned_map& other) noexcept {
+		std::swap(_block, other._block);
+	}
+
+
+	// Read only access
+
+	const map_type& get() const noexcept {
+		if (_block == nullptr) {
+			return empty_map();
+		}
+		return _block->map;
+	}
+	const map_type& operator*() const noexcept {
+		return get();
+	}
+	const map_type* operator->() const noexcept {
+		return &get();
+	}
+
+	const_iterator begin() const noexcept {
+		return get().begin();
+	}
+	const_iterator end() const noexcept {
+		return get().end();
+	}
+	bool empty() const noexcept {
+		return get().empty();
+	}
+	size_type size() const noexcept {
+		return get().size();
+	}
+	bool contains(key_type k) const {
+		return get().contains(k);
+	}
+	size_type count(key_type k) const {
+		return get().count(k);
+	}
+	const_iterator find(key_type k) const {
+		return get().find(k);
+	}
+	const mapped_type& at(key_type k) const {
+		return get().at(k);
+	}
+	const mapped_type& at_unchecked(key_type k) const {
+		return get().at_unchecked(k);
+	}
+
+private:
+	using block_type = detail::cow_unsigned_map_block<map_type>;
+
+	// Moved from handles read this map.
+	static const map_type& empty_map() noexcept {
+		static const map_type ret{};
+		return ret;
+	}
+
+	void acquire() noexcept {
+		if (_block == nullptr) {
+			return;
+		}
+		_block->refs.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void release() noexcept {
+		if (_block == nullptr) {
+			return;
+		}
+
+		// Acquire the other handles' reads before deleting.
+		if (_block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			delete _block;
+		}
+		_block = nullptr;
+	}
+
+	// Gives this handle its own copy of the map.
+	void detach() {
+		block_type* new_block = new block_type{ _block->map };
+		release();
+		_block = new_block;
+	}
+
+	block_type* _block;
+};
+
+template <class Map>
+inline void swap(cow_unsigned_map<Map>& lhs, cow_unsigned_map<Map>& rhs) {
+	lhs.swap(rhs);
+}
+} // namespace fea
@@ -0,0 +1,344 @@
+﻿/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Philippe Groarke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <cstddef>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "fea_flat_unsigned_hashmap.hpp"
+
+/*
+A flat_unsigned_hashmap that stores each component of its values in its own
+packed array, one column per component type. Loops that only read one
+component only touch that component's memory.
+
+	struct transform { float x, y, z, w; };
+	struct physics { ... }; // 200 bytes, rarely read
+
+	fea::flat_unsigned_column_hashmap<unsigned, transform, physics> map;
+	map.insert(42, transform{}, physics{});
+
+	// Only reads the transforms.
+	for (transform& t : map.column<0>()) {
+		t.x += 1.f;
+	}
+
+	map.at<1>(42).mass = 2.f;
+
+All columns share one lookup. Position i of every column belongs to key
+keys()[i]. Erasing moves the last element of every column into the hole,
+like flat_unsigned_hashmap does with its values.
+*/
+
+namespace fea {
+namespace detail {
+// Stands in for values in the shared lookup, the columns hold the values.
+struct flat_column_slot {};
+
+template <class Tuple, class Func, size_t... Is>
+void flat_column_for_each(Tuple& t, Func& func, std::index_sequence<Is...>) {
+	int unused[] = { 0, (func(std::get<Is>(t)), 0)... };
+	(void)unused;
+}
+} // namespace detail
+
+template <class Key, class... Ts>
+struct flat_unsigned_column_hashmap {
+	static_assert(sizeof...(Ts) > 0,
+			"flat_unsigned_column_hashmap : needs at least one column");
+
+	using key_type = Key;
+	using size_type = std::size_t;
+
+	// the value type of column I
+	template <size_t I>
+	using column_type = std::tuple_element_t<I, std::tuple<Ts...>>;
+
+	// the number of columns
+	static constexpr size_t column_count() noexcept {
+		return sizeof...(Ts);
+	}
+
+	flat_unsigned_column_hashmap() = default;
+	explicit flat_unsigned_column_hashmap(size_type reserve_count) {
+		reserve(reserve_count);
+	}
+
+
+	// Iterators
+
+	// returns the keys, in column order
+	detail::flat_hashmap_range<const key_type*> keys() const noexcept {
+		return _lookup.keys();
+	}
+
+	// returns the values of column I, in value order, matching keys()
+	template <size_t I>
+	detail::flat_hashmap_range<column_type<I>*> column() noexcept {
+		return { data<I>(), data<I>() + size() };
+	}
+	template <size_t I>
+	detail::flat_hashmap_range<const column_type<I>*> column() const noexcept {
+		return { data<I>(), data<I>() + size() };
+	}
+
+
+	// Capacity
+
+	// checks whether the container is empty
+	bool empty() const noexcept {
+		return _lookup.empty();
+	}
+
+	// returns the number of elements
+	size_type size() const noexcept {
+		return _lookup.size();
+	}
+
+	// returns the maximum possible number of elements
+	size_type max_size() const noexcept {
+		return _lookup.max_size();
+	}
+
+	// reserves storage
+	void reserve(size_type new_cap) {
+		_lookup.reserve(new_cap);
+		auto func = [&](auto& col) { col.reserve(new_cap); };
+		for_each_column(func);
+	}
+
+	// returns the number of elements that can be held in currently
+	// allocated storage
+	size_type capacity() const noexcept {
+		return _lookup.capacity();
+	}
+
+	// reduces memory usage by freeing unused memory
+	void shrink_to_fit() {
+		_lookup.shrink_to_fit();
+		auto func = [](auto& col) { col.shrink_to_fit(); };
+		for_each_column(func);
+	}
+
+
+	// Modifiers
+
+	// clears the contents
+	void clear() noexcept {
+		_lookup.clear();
+		auto func = [](auto& col) { col.clear(); };
+		for_each_column(func);
+	}
+
+	// inserts an element with one value per column, if the key doesn't exist
+	// returns the element's position in the columns and whether it was
+	// inserted
+	template <class... Args>
+	std::pair<size_type, bool> insert(key_type key, Args&&... values) {
+		static_assert(sizeof...(Args) == sizeof...(Ts),
+				"flat_unsigned_column_hashmap : insert needs one value per "
+				"column");
+
+		auto ret = _lookup.insert(key, detail::flat_column_slot{});
+		size_type pos = size_type(ret.first - _lookup.begin());
+		if (!ret.second) {
+			return { pos, false };
+		}
+
+		try {
+			mappend(std::index_sequence_for<Ts...>{},
+					std::forward<Args>(values)...);
+		} catch (...) {
+			// Drop the values appended before the throw, and the key.
+			auto func = [&](auto& col) {
+				if (col.size() > pos) {
+					col.pop_back();
+				}
+			};
+			for_each_column(func);
+			_lookup.erase(key);
+			throw;
+		}
+		return { pos, true };
+	}
+
+	// inserts an element or assigns all its values if the key exists
+	template <class... Args>
+	std::pair<size_type, bool> insert_or_assign(
+			key_type key, Args&&... values) {
+		size_type pos = index_of(key);
+		if (pos == size()) {
+			return insert(key, std::forward<Args>(values)...);
+		}
+
+		massign(pos, std::index_sequence_for<Ts...>{},
+				std::forward<Args>(values)...);
+		return { pos, false };
+	}
+
+	// erases an element
+	// moves the last element of every column into its position
+	// returns the number of erased elements
+	size_type erase(key_type key) {
+		// The lookup moves its last element to pos, the columns follow.
+		std::pair<size_type, bool> ret = _lookup.erase_index(key);
+		if (!ret.second) {
+			return 0;
+		}
+
+		size_type pos = ret.first;
+		auto func = [pos](auto& col) {
+			if (pos != col.size() - 1) {
+				col[pos] = detail::flathashmap_maybe_move(col.back());
+			}
+			col.pop_back();
+		};
+		for_each_column(func);
+		return 1;
+	}
+
+	// swaps the contents
+	void swap(flat_unsigned_column_hashmap& other) noexcept {
+		_lookup.swap(other._lookup);
+		_columns.swap(other._columns);
+	}
+
+
+	// Lookup
+
+	// direct access to the packed values of column I
+	template <size_t I>
+	const column_type<I>* data() const noexcept {
+		return std::get<I>(_columns).data();
+	}
+	template <size_t I>
+	column_type<I>* data() noexcept {
+		return std::get<I>(_columns).data();
+	}
+
+	// returns the position of key in the columns, or size() if it doesn't
+	// exist
+	size_type index_of(key_type key) const {
+		return size_type(_lookup.find(key) - _lookup.begin());
+	}
+
+	// access the value of key in column I, with bounds checking
+	template <size_t I>
+	const column_type<I>& at(key_type key) const {
+		size_type pos = index_of(key);
+		if (pos == size()) {
+			throw std::out_of_range{
+				"flat_unsigned_column_hashmap : value doesn't exist"
+			};
+		}
+		return std::get<I>(_columns)[pos];
+	}
+	template <size_t I>
+	column_type<I>& at(key_type key) {
+		return const_cast<column_type<I>&>(
+				static_cast<const flat_unsigned_column_hashmap*>(this)
+						->template at<I>(key));
+	}
+
+	// access the value of key in column I, without any bounds checking
+	template <size_t I>
+	const column_type<I>& at_unchecked(key_type key) const {
+		return std::get<I>(_columns)[index_of(key)];
+	}
+	template <size_t I>
+	column_type<I>& at_unchecked(key_type key) {
+		return std::get<I>(_columns)[index_of(key)];
+	}
+
+	// returns the number of elements matching specific key (which is 1 or 0,
+	// since there are no duplicates)
+	size_type count(key_type key) const {
+		return _lookup.count(key);
+	}
+
+	// checks if the container contains element with specific key
+	bool contains(key_type key) const {
+		return _lookup.contains(key);
+	}
+
+
+	// Hash policy
+
+	// returns average number of elements per bucket
+	float load_factor() const noexcept {
+		return _lookup.load_factor();
+	}
+
+	// manages maximum average number of elements per bucket
+	float max_load_factor() const noexcept {
+		return _lookup.max_load_factor();
+	}
+	void max_load_factor(float ml) noexcept {
+		_lookup.max_load_factor(ml);
+	}
+
+	// reserves at least the specified number of buckets
+	// this regenerates the hash table
+	void rehash(size_type count) {
+		_lookup.rehash(count);
+	}
+
+private:
+	template <class Func>
+	void for_each_column(Func& func) {
+		detail::flat_column_for_each(
+				_columns, func, std::index_sequence_for<Ts...>{});
+	}
+
+	// Appends one value to each column, in column order.
+	template <size_t... Is, class... Args>
+	void mappend(std::index_sequence<Is...>, Args&&... values) {
+		int unused[] = { 0,
+			(std::get<Is>(_columns).emplace_back(std::forward<Args>(values)),
+					0)... };
+		(void)unused;
+	}
+
+	template <size_t... Is, class... Args>
+	void massign(size_type pos, std::index_sequence<Is...>, Args&&... values) {
+		int unused[] = { 0,
+			(std::get<Is>(_columns)[pos] = std::forward<Args>(values), 0)... };
+		(void)unused;
+	}
+
+	flat_unsigned_hashmap<key_type, detail::flat_column_slot> _lookup;
+	std::tuple<std::vector<Ts>...> _columns;
+};
+} // namespace fea
@@ -31,13 +31,28 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #pragma once
 #include <algorithm>
+#include <array>
 #include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <memory>
 #include <numeric>
 #include <stdexcept>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
+#if __cplusplus >= 201703L
+#include <memory_resource>
+#endif
+
+#include "fea_chunked_vector.hpp"
+#include "fea_file.hpp"
+#include "fea_unsigned_node.hpp"
+
 /*
 This is a more traditional-ish "hash map".
 
@@ -55,7 +70,8 @@ Its special characteristics are :
 	- Values are packed, so you may iterate values quickly (the map supports
 		.data()).
 	- Note : This map doesn't follow the c++ standard apis very closely, as
-		iterators are on value_type, not pair<key_type, value_type>.
+		iterators are on value_type, not pair<key_type, value_type>. Use
+		kvs() to iterate key / value pairs and keys() to iterate keys.
 */
 
 
@@ -87,6 +103,166 @@ auto flathashmap_make_on_exit(Func func) {
 	return flathhashmap_on_exit<Func>{ func };
 }
 
+// Iterates keys and values in parallel. Dereferencing returns a pair of
+// references, so like std::vector<bool>, it is a proxy iterator.
+template <class Key, class ValueIt>
+struct flat_hashmap_kv_iterator {
+	using iterator_category = std::random_access_iterator_tag;
+	using value_type = std::pair<Key,
+			typename std::iterator_traits<ValueIt>::value_type>;
+	using difference_type = std::ptrdiff_t;
+	using reference = std::pair<const Key&,
+			typename std::iterator_traits<ValueIt>::reference>;
+
+	// operator-> returns a temporary pair
+	struct pointer {
+		const reference* operator->() const noexcept {
+			return &ref;
+		}
+		reference ref;
+	};
+
+	flat_hashmap_kv_iterator() noexcept = default;
+	flat_hashmap_kv_iterator(const Key* key, ValueIt value) noexcept
+			: _key(key)
+			, _value(value) {
+	}
+
+	// iterator to const_iterator
+	template <class It,
+			class = typename std::enable_if<!std::is_same<It, ValueIt>::value
+					&& std::is_convertible<It, ValueIt>::value>::type>
+	flat_hashmap_kv_iterator(
+			const flat_hashmap_kv_iterator<Key, It>& other) noexcept
+			: _key(other.key_ptr())
+			, _value(other.value_it()) {
+	}
+
+	reference operator*() const noexcept {
+		return { *_key, *_value };
+	}
+	pointer operator->() const noexcept {
+		return { **this };
+	}
+	reference operator[](difference_type n) const noexcept {
+		return *(*this + n);
+	}
+
+	flat_hashmap_kv_iterator& operator++() noexcept {
+		++_key;
+		++_value;
+		return *this;
+	}
+	flat_hashmap_kv_iterator operator++(int) noexcept {
+		flat_hashmap_kv_iterator ret = *this;
+		++*this;
+		return ret;
+	}
+	flat_hashmap_kv_iterator& operator--() noexcept {
+		--_key;
+		--_value;
+		return *this;
+	}
+	flat_hashmap_kv_iterator operator--(int) noexcept {
+		flat_hashmap_kv_iterator ret = *this;
+		--*this;
+		return ret;
+	}
+	flat_hashmap_kv_iterator& operator+=(difference_type n) noexcept {
+		_key += n;
+		_value += n;
+		return *this;
+	}
+	flat_hashmap_kv_iterator& operator-=(difference_type n) noexcept {
+		_key -= n;
+		_value -= n;
+		return *this;
+	}
+
+	friend flat_hashmap_kv_iterator operator+(
+			flat_hashmap_kv_iterator it, difference_type n) noexcept {
+		return it += n;
+	}
+	friend flat_hashmap_kv_iterator operator+(
+			difference_type n, flat_hashmap_kv_iterator it) noexcept {
+		return it += n;
+	}
+	friend flat_hashmap_kv_iterator operator-(
+			flat_hashmap_kv_iterator it, difference_type n) noexcept {
+		return it -= n;
+	}
+	friend difference_type operator-(const flat_hashmap_kv_iterator& lhs,
+			const flat_hashmap_kv_iterator& rhs) noexcept {
+		return lhs._key - rhs._key;
+	}
+
+	// Keys and values move together, comparing keys is enough.
+	friend bool operator==(const flat_hashmap_kv_iterator& lhs,
+			const flat_hashmap_kv_iterator& rhs) noexcept {
+		return lhs._key == rhs._key;
+	}
+	friend bool operator!=(const flat_hashmap_kv_iterator& lhs,
+			const flat_hashmap_kv_iterator& rhs) noexcept {
+		return lhs._key != rhs._key;
+	}
+	friend bool operator<(const flat_hashmap_kv_iterator& lhs,
+			const flat_hashmap_kv_iterator& rhs) noexcept {
+		return lhs._key < rhs._key;
+	}
+	friend bool operator>(const flat_hashmap_kv_iterator& lhs,
+			const flat_hashmap_kv_iterator& rhs) noexcept {
+		return lhs._key > rhs._key;
+	}
+	friend bool operator<=(const flat_hashmap_kv_iterator& lhs,
+			const flat_hashmap_kv_iterator& rhs) noexcept {
+		return lhs._key <= rhs._key;
+	}
+	friend bool operator>=(const flat_hashmap_kv_iterator& lhs,
+			const flat_hashmap_kv_iterator& rhs) noexcept {
+		return lhs._key >= rhs._key;
+	}
+
+	const Key* key_ptr() const noexcept {
+		return _key;
+	}
+	ValueIt value_it() const noexcept {
+		return _value;
+	}
+
+private:
+	const Key* _key = nullptr;
+	ValueIt _value{};
+};
+
+// A [first, last) view, for range-based for loops.
+template <class It>
+struct flat_hashmap_range {
+	flat_hashmap_range(It first, It last) noexcept
+			: _first(first)
+			, _last(last) {
+	}
+
+	It begin() const noexcept {
+		return _first;
+	}
+	It end() const noexcept {
+		return _last;
+	}
+	bool empty() const noexcept {
+		return _first == _last;
+	}
+	size_t size() const noexcept {
+		return size_t(_last - _first);
+	}
+	decltype(auto) operator[](size_t i) const noexcept {
+		return _first[std::ptrdiff_t(i)];
+	}
+
+private:
+	It _first;
+	It _last;
+};
+
 // https://stackoverflow.com/questions/30052316/find-next-prime-number-algorithm
 template <class T>
 bool is_prime(T number) {
@@ -181,13 +357,344 @@ T next_prime(T a) {
 	} break;
 	}
 }
+
+// Header of a frozen flat_unsigned_hashmap image, written by
+// flat_unsigned_hashmap::freeze and probed by
+// frozen_flat_unsigned_hashmap_view. Uses native endianness and type sizes.
+//
+// [header][pad][lookup][pad][reverse lookup][pad][values]
+//
+// Offsets are relative to the start of the image, so it can be used from
+// any address : a mapped file, shared memory or a plain buffer. Sections
+// start on 64 byte boundaries.
+struct flat_hashmap_frozen_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t endian_check;
+	uint64_t key_size;
+	uint64_t idx_size;
+	uint64_t value_size;
+	uint64_t value_align;
+	uint64_t hash_max;
+	uint64_t num_lookup;
+	uint64_t num_values;
+	uint64_t lookup_offset;
+	uint64_t reverse_lookup_offset;
+	uint64_t values_offset;
+	uint64_t image_size;
+};
+
+// A lookup slot, an empty slot has the max idx.
+template <class Key, class Idx>
+struct flat_hashmap_frozen_slot {
+	Key key;
+	Idx idx;
+};
+
+constexpr char flat_hashmap_frozen_magic[8]
+		= { 'f', 'e', 'a', 'f', 'h', 'm', 'a', 'p' };
+constexpr uint32_t flat_hashmap_frozen_version = 1;
+constexpr uint32_t flat_hashmap_frozen_endian_check = 0x01020304;
+constexpr uint64_t flat_hashmap_frozen_section_align = 64;
+
+inline constexpr uint64_t flat_hashmap_frozen_align_up(uint64_t offset) {
+	return (offset + flat_hashmap_frozen_section_align - 1)
+			& ~(flat_hashmap_frozen_section_align - 1);
+}
+
+// The alignment required of the image's address.
+template <class T>
+inline constexpr size_t flat_hashmap_frozen_alignment() {
+	return alignof(T) > alignof(uint64_t) ? alignof(T) : alignof(uint64_t);
+}
+
+template <class Key, class Idx, class T>
+flat_hashmap_frozen_header make_flat_hashmap_frozen_header(
+		size_t hash_max, size_t num_lookup, size_t num_values) noexcept {
+	flat_hashmap_frozen_header ret{};
+	std::memcpy(ret.magic, flat_hashmap_frozen_magic, sizeof(ret.magic));
+	ret.version = flat_hashmap_frozen_version;
+	ret.endian_check = flat_hashmap_frozen_endian_check;
+	ret.key_size = sizeof(Key);
+	ret.idx_size = sizeof(Idx);
+	ret.value_size = sizeof(T);
+	ret.value_align = alignof(T);
+	ret.hash_max = hash_max;
+	ret.num_lookup = num_lookup;
+	ret.num_values = num_values;
+	ret.lookup_offset
+			= flat_hashmap_frozen_align_up(sizeof(flat_hashmap_frozen_header));
+	ret.reverse_lookup_offset = flat_hashmap_frozen_align_up(ret.lookup_offset
+			+ num_lookup * sizeof(flat_hashmap_frozen_slot<Key, Idx>));
+	ret.values_offset = flat_hashmap_frozen_align_up(
+			ret.reverse_lookup_offset + num_values * sizeof(Key));
+	ret.image_size = ret.values_offset + num_values * sizeof(T);
+	return ret;
+}
+
+// Up to this many elements, flat_unsigned_hashmap doesn't allocate a lookup
+// and stores its keys inline.
+constexpr size_t flat_hashmap_small_count = 8;
+
+// A vector of keys which stores up to N keys inline, they only allocate
+// once they outgrow it. Moves and swaps copy the inline keys, so they
+// invalidate pointers to them.
+template <class Key, class Alloc, size_t N>
+struct flat_hashmap_key_buffer {
+	static_assert(std::is_trivially_copyable<Key>::value,
+			"flat_hashmap_key_buffer : keys must be trivially copyable");
+
+	using allocator_type = Alloc;
+	using size_type = size_t;
+	using iterator = Key*;
+	using const_iterator = const Key*;
+
+	flat_hashmap_key_buffer() = default;
+	explicit flat_hashmap_key_buffer(const allocator_type& alloc)
+			: _alloc(alloc) {
+	}
+	flat_hashmap_key_buffer(const flat_hashmap_key_buffer& other)
+			: _alloc(alloc_traits::select_on_container_copy_construction(
+					other._alloc)) {
+		assign(other.begin(), other.end());
+	}
+	flat_hashmap_key_buffer(
+			const flat_hashmap_key_buffer& other, const allocator_type& alloc)
+			: _alloc(alloc) {
+		assign(other.begin(), other.end());
+	}
+	flat_hashmap_key_buffer(flat_hashmap_key_buffer&& other) noexcept
+			: _alloc(std::move(other._alloc)) {
+		steal(other);
+	}
+	flat_hashmap_key_buffer(
+			flat_hashmap_key_buffer&& other, const allocator_type& alloc)
+			: _alloc(alloc) {
+		if (_alloc == other._alloc) {
+			steal(other);
+		} else {
+			assign(other.begin(), other.end());
+		}
+	}
+	~flat_hashmap_key_buffer() {
+		free_heap();
+	}
+
+	flat_hashmap_key_buffer& operator=(const flat_hashmap_key_buffer& other) {
+		if (this != &other) {
+			assign(other.begin(), other.end());
+		}
+		return *this;
+	}
+	flat_hashmap_key_buffer& operator=(
+			flat_hashmap_key_buffer&& other) noexcept(alloc_traits::
+					propagate_on_container_move_assignment::value) {
+		if (this == &other) {
+			return *this;
+		}
+
+		if (alloc_traits::propagate_on_container_move_assignment::value
+				|| _alloc == other._alloc) {
+			free_heap();
+			move_alloc(other._alloc,
+					typename alloc_traits::
+							propagate_on_container_move_assignment{});
+			steal(other);
+		} else {
+			assign(other.begin(), other.end());
+		}
+		return *this;
+	}
+
+	allocator_type get_allocator() const noexcept {
+		return _alloc;
+	}
+
+	Key* data() noexcept {
+		return _heap != nullptr ? std::addressof(*_heap) : _inline;
+	}
+	const Key* data() const noexcept {
+		return _heap != nullptr ? std::addressof(*_heap) : _inline;
+	}
+	iterator begin() noexcept {
+		return data();
+	}
+	const_iterator begin() const noexcept {
+		return data();
+	}
+	iterator end() noexcept {
+		return data() + _size;
+	}
+	const_iterator end() const noexcept {
+		return data() + _size;
+	}
+
+	Key& operator[](size_type i) noexcept {
+		assert(i < _size);
+		return data()[i];
+	}
+	const Key& operator[](size_type i) const noexcept {
+		assert(i < _size);
+		return data()[i];
+	}
+	Key& back() noexcept {
+		return (*this)[_size - 1];
+	}
+	const Key& back() const noexcept {
+		return (*this)[_size - 1];
+	}
+
+	bool empty() const noexcept {
+		return _size == 0;
+	}
+	size_type size() const noexcept {
+		return _size;
+	}
+	size_type capacity() const noexcept {
+		return _heap != nullptr ? _capacity : N;
+	}
+	// the allocated capacity, 0 while the keys are inline
+	size_type heap_capacity() const noexcept {
+		return _heap != nullptr ? _capacity : 0;
+	}
+
+	void reserve(size_type new_cap) {
+		if (new_cap > capacity()) {
+			reallocate(new_cap);
+		}
+	}
+	void shrink_to_fit() {
+		if (_heap == nullptr || _size == _capacity) {
+			return;
+		}
+
+		if (_size <= N) {
+			pointer heap = _heap;
+			size_type cap = _capacity;
+			std::copy(begin(), end(), _inline);
+			_heap = nullptr;
+			alloc_traits::deallocate(_alloc, heap, cap);
+			return;
+		}
+		reallocate(_size);
+	}
+
+	void clear() noexcept {
+		_size = 0;
+	}
+	void push_back(Key key) {
+		if (_size == capacity()) {
+			reallocate(capacity() * 2);
+		}
+		data()[_size++] = key;
+	}
+	void pop_back() noexcept {
+		assert(_size != 0);
+		--_size;
+	}
+	// new keys are zeroed
+	void resize(size_type new_size) {
+		reserve(new_size);
+		if (new_size > _size) {
+			std::fill(end(), begin() + new_size, Key(0));
+		}
+		_size = new_size;
+	}
+	iterator erase(const_iterator first, const_iterator last) noexcept {
+		Key* dst = begin() + (first - begin());
+		Key* src = begin() + (last - begin());
+		std::copy(src, end(), dst);
+		_size -= size_type(last - first);
+		return dst;
+	}
+	template <class InputIt>
+	void assign(InputIt first, InputIt last) {
+		clear();
+		reserve(size_type(std::distance(first, last)));
+		std::copy(first, last, begin());
+		_size = size_type(std::distance(first, last));
+	}
+
+	void swap(flat_hashmap_key_buffer& other) noexcept {
+		using std::swap;
+		swap(_alloc, other._alloc);
+		swap(_heap, other._heap);
+		swap(_size, other._size);
+		swap(_capacity, other._capacity);
+		for (size_type i = 0; i < N; ++i) {
+			swap(_inline[i], other._inline[i]);
+		}
+	}
+
+private:
+	using alloc_traits = std::allocator_traits<allocator_type>;
+	using pointer = typename alloc_traits::pointer;
+
+	void reallocate(size_type new_cap) {
+		pointer heap = alloc_traits::allocate(_alloc, new_cap);
+		std::copy(begin(), end(), std::addressof(*heap));
+		free_heap();
+		_heap = heap;
+		_capacity = new_cap;
+	}
+
+	void free_heap() noexcept {
+		if (_heap != nullptr) {
+			alloc_traits::deallocate(_alloc, _heap, _capacity);
+			_heap = nullptr;
+		}
+	}
+
+	// Takes other's keys, other is left empty and inline.
+	void steal(flat_hashmap_key_buffer& other) noexcept {
+		_heap = other._heap;
+		_capacity = other._capacity;
+		_size = other._size;
+		if (_heap == nullptr) {
+			std::copy(other._inline, other._inline + _size, _inline);
+		}
+		other._heap = nullptr;
+		other._size = 0;
+	}
+
+	void move_alloc(allocator_type& alloc, std::true_type) noexcept {
+		_alloc = std::move(alloc);
+	}
+	void move_alloc(allocator_type&, std::false_type) noexcept {
+	}
+
+	allocator_type _alloc;
+	pointer _heap = nullptr;
+	size_type _size = 0;
+	size_type _capacity = 0;
+	Key _inline[N] = {};
+};
 } // namespace detail
 
+// Tags selecting the order flat_unsigned_hashmap::compact sorts values in.
+// Ascending keys.
+struct key_order_t {
+	explicit key_order_t() = default;
+};
+constexpr key_order_t key_order{};
+
+// The lookup's slot order. Keys that hash to neighbouring slots get
+// neighbouring values. Doesn't need a sort.
+struct hash_order_t {
+	explicit hash_order_t() = default;
+};
+constexpr hash_order_t hash_order{};
+
 
-template <class Key, class T>
+template <class Key, class T, class Alloc = std::allocator<T>,
+		class ValueStorage = contiguous_values>
 struct flat_unsigned_hashmap {
 	static_assert(std::is_unsigned<Key>::value,
 			"unsigned_map : key must be unsigned integer");
+	static_assert(
+			std::is_same<typename std::allocator_traits<Alloc>::value_type,
+					T>::value,
+			"flat_unsigned_hashmap : allocator value_type must be T");
 
 	using key_type = Key;
 	using mapped_type = T;
@@ -198,7 +705,7 @@ struct flat_unsigned_hashmap {
 					key_type, size_type>::type;
 	using difference_type = std::ptrdiff_t;
 
-	using allocator_type = typename std::vector<value_type>::allocator_type;
+	using allocator_type = Alloc;
 
 	using reference = value_type&;
 	using const_reference = const value_type&;
@@ -206,15 +713,69 @@ struct flat_unsigned_hashmap {
 	using const_pointer =
 			typename std::allocator_traits<allocator_type>::const_pointer;
 
-	using iterator = typename std::vector<value_type>::iterator;
-	using const_iterator = typename std::vector<value_type>::const_iterator;
+	using values_container = typename ValueStorage::template container<
+			value_type, allocator_type>;
+
+	using iterator = typename values_container::iterator;
+	using const_iterator = typename values_container::const_iterator;
 	using local_iterator = iterator;
 	using const_local_iterator = const_iterator;
 
+	// key / value iterators, dereference to pair<const key_type&, T&>
+	using kv_iterator = detail::flat_hashmap_kv_iterator<key_type, iterator>;
+	using const_kv_iterator
+			= detail::flat_hashmap_kv_iterator<key_type, const_iterator>;
+
+	// bytes used and reserved by an internal buffer
+	struct buffer_usage {
+		size_type used = 0;
+		size_type reserved = 0;
+	};
+
+	// heap memory of the container, per internal buffer
+	struct memory_usage_type {
+		buffer_usage lookup;
+		buffer_usage reverse_lookup;
+		buffer_usage values;
+		size_type size = 0;
+
+		// returns bytes used by all buffers
+		size_type used() const noexcept {
+			return lookup.used + reverse_lookup.used + values.used;
+		}
+		// returns bytes reserved by all buffers
+		size_type reserved() const noexcept {
+			return lookup.reserved + reverse_lookup.reserved
+					+ values.reserved;
+		}
+		// returns used bytes per element, 0 if empty
+		double used_per_element() const noexcept {
+			return size == 0 ? 0.0 : double(used()) / double(size);
+		}
+		// returns reserved bytes per element, 0 if empty
+		double reserved_per_element() const noexcept {
+			return size == 0 ? 0.0 : double(reserved()) / double(size);
+		}
+	};
+
+	// owns an extracted element, see fea::unsigned_node
+	using node_type = unsigned_node<key_type, mapped_type>;
+
+	// progress of an incremental compact
+	struct compact_cursor {
+	private:
+		friend struct flat_unsigned_hashmap;
+
+		// The keys in their new order, gathered on the first call.
+		std::vector<key_type> _keys;
+		size_type _next = 0;
+		size_type _pos = 0;
+		bool _started = false;
+	};
+
 	// Don't make sense
 	// using hasher = std::hash<key_type>;
 	// using key_equal = std::equal_to<key_type>;
-	// using node_type;
 	// using insert_return_type;
 
 
@@ -226,33 +787,59 @@ struct flat_unsigned_hashmap {
 	flat_unsigned_hashmap& operator=(const flat_unsigned_hashmap&) = default;
 	flat_unsigned_hashmap& operator=(flat_unsigned_hashmap&&) = default;
 
-	explicit flat_unsigned_hashmap(size_t reserve_count)
-			: flat_unsigned_hashmap() {
+	// Every internal buffer uses a copy of alloc, rebound to its type.
+	explicit flat_unsigned_hashmap(const allocator_type& alloc)
+			: _lookup(alloc)
+			, _reverse_lookup(alloc)
+			, _values(alloc) {
+	}
+	flat_unsigned_hashmap(
+			const flat_unsigned_hashmap& other, const allocator_type& alloc)
+			: _max_load_factor(other._max_load_factor)
+			, _hash_max(other._hash_max)
+			, _lookup(other._lookup, alloc)
+			, _reverse_lookup(other._reverse_lookup, alloc)
+			, _values(other._values, alloc) {
+	}
+	flat_unsigned_hashmap(
+			flat_unsigned_hashmap&& other, const allocator_type& alloc)
+			: _max_load_factor(other._max_load_factor)
+			, _hash_max(other._hash_max)
+			, _lookup(std::move(other._lookup), alloc)
+			, _reverse_lookup(std::move(other._reverse_lookup), alloc)
+			, _values(std::move(other._values), alloc) {
+	}
+
+	explicit flat_unsigned_hashmap(size_t reserve_count,
+			const allocator_type& alloc = allocator_type())
+			: flat_unsigned_hashmap(alloc) {
 		_lookup.reserve(reserve_count);
 		_reverse_lookup.reserve(reserve_count);
 		_values.reserve(reserve_count);
 	}
-	explicit flat_unsigned_hashmap(
-			size_t key_reserve_count, size_t value_reserve_count)
-			: flat_unsigned_hashmap() {
+	explicit flat_unsigned_hashmap(size_t key_reserve_count,
+			size_t value_reserve_count,
+			const allocator_type& alloc = allocator_type())
+			: flat_unsigned_hashmap(alloc) {
 		_lookup.reserve(key_reserve_count);
 		_reverse_lookup.reserve(value_reserve_count);
 		_values.reserve(value_reserve_count);
 	}
 
-	// todo : kv iterators
-	// template <class InputIt>
-	// flat_unsigned_hashmap(InputIt first, InputIt last)
-	//		: flat_unsigned_hashmap() {
-	//	// TODO : benchmark and potentially optimize
-	//	for (auto it = first; it != last; ++it) {
-	//		insert(*it);
-	//	}
-	//}
+	// Builds from iterators on pairs, or on another map's kvs().
+	template <class InputIt,
+			class = typename std::enable_if<
+					!std::is_integral<InputIt>::value>::type>
+	flat_unsigned_hashmap(InputIt first, InputIt last,
+			const allocator_type& alloc = allocator_type())
+			: flat_unsigned_hashmap(alloc) {
+		insert(first, last);
+	}
 
 	explicit flat_unsigned_hashmap(
-			const std::initializer_list<std::pair<key_type, value_type>>& init)
-			: flat_unsigned_hashmap() {
+			const std::initializer_list<std::pair<key_type, value_type>>& init,
+			const allocator_type& alloc = allocator_type())
+			: flat_unsigned_hashmap(alloc) {
 		// TODO : benchmark and potentially optimize
 		for (const std::pair<key_type, value_type>& kv : init) {
 			insert(kv.first, kv.second);
@@ -260,6 +847,12 @@ struct flat_unsigned_hashmap {
 	}
 
 
+	// returns the allocator associated with the container
+	allocator_type get_allocator() const noexcept {
+		return _values.get_allocator();
+	}
+
+
 	// Iterators
 
 	// returns an iterator to the beginning
@@ -284,6 +877,44 @@ struct flat_unsigned_hashmap {
 		return _values.cend();
 	}
 
+	// returns a key / value iterator to the beginning
+	kv_iterator kv_begin() noexcept {
+		return { _reverse_lookup.data(), _values.begin() };
+	}
+	const_kv_iterator kv_begin() const noexcept {
+		return { _reverse_lookup.data(), _values.begin() };
+	}
+	const_kv_iterator kv_cbegin() const noexcept {
+		return kv_begin();
+	}
+
+	// returns a key / value iterator to the end (one past last)
+	kv_iterator kv_end() noexcept {
+		return { _reverse_lookup.data() + _reverse_lookup.size(),
+			_values.end() };
+	}
+	const_kv_iterator kv_end() const noexcept {
+		return { _reverse_lookup.data() + _reverse_lookup.size(),
+			_values.end() };
+	}
+	const_kv_iterator kv_cend() const noexcept {
+		return kv_end();
+	}
+
+	// returns the key / value pairs, in value order
+	detail::flat_hashmap_range<kv_iterator> kvs() noexcept {
+		return { kv_begin(), kv_end() };
+	}
+	detail::flat_hashmap_range<const_kv_iterator> kvs() const noexcept {
+		return { kv_begin(), kv_end() };
+	}
+
+	// returns the keys, in value order
+	detail::flat_hashmap_range<const key_type*> keys() const noexcept {
+		return { _reverse_lookup.data(),
+			_reverse_lookup.data() + _reverse_lookup.size() };
+	}
+
 
 	// Capacity
 
@@ -323,6 +954,21 @@ struct flat_unsigned_hashmap {
 		_values.shrink_to_fit();
 	}
 
+	// returns the bytes used and reserved by each internal buffer
+	// capacity() only reflects the values, the lookup is usually bigger
+	memory_usage_type memory_usage() const noexcept {
+		memory_usage_type ret;
+		ret.lookup.used = _lookup.size() * sizeof(lookup_data);
+		ret.lookup.reserved = _lookup.capacity() * sizeof(lookup_data);
+		ret.reverse_lookup.used = _reverse_lookup.size() * sizeof(key_type);
+		ret.reverse_lookup.reserved
+				= _reverse_lookup.heap_capacity() * sizeof(key_type);
+		ret.values.used = _values.size() * sizeof(value_type);
+		ret.values.reserved = ValueStorage::memory_reserved(_values);
+		ret.size = _values.size();
+		return ret;
+	}
+
 
 	// Modifiers
 
@@ -342,14 +988,17 @@ struct flat_unsigned_hashmap {
 		return minsert(key, detail::flathashmap_maybe_move(value));
 	}
 
-	// todo : pair iterators
-	// template <class InputIt>
-	// void insert(InputIt first, InputIt last) {
-	//	// TODO : benchmark and potentially optimize
-	//	for (auto it = first; it != last; ++it) {
-	//		insert(*it);
-	//	}
-	//}
+	// Range inserts don't overwrite existing keys. Accepts iterators on
+	// pairs, or on another map's kvs().
+	template <class InputIt,
+			class = typename std::enable_if<
+					!std::is_integral<InputIt>::value>::type>
+	void insert(InputIt first, InputIt last) {
+		for (auto it = first; it != last; ++it) {
+			auto&& kv = *it;
+			insert(kv.first, kv.second);
+		}
+	}
 	void insert(const std::initializer_list<std::pair<key_type, value_type>>&
 					ilist) {
 		// TODO : benchmark and potentially optimize
@@ -357,6 +1006,25 @@ struct flat_unsigned_hashmap {
 			insert(kv.first, kv.second);
 		}
 	}
+	// Inserting an empty node does nothing. If the key already exists, the
+	// node keeps its value.
+	std::pair<iterator, bool> insert(node_type&& node) {
+		if (node.empty()) {
+			return { end(), false };
+		}
+
+		std::pair<iterator, bool> ret = mupsert(
+				node.key(),
+				[&](values_container& values) {
+					values.push_back(
+							detail::flathashmap_maybe_move(node.mapped()));
+				},
+				[](value_type&) {});
+		if (ret.second) {
+			node.clear();
+		}
+		return ret;
+	}
 
 	// inserts an element or assigns to the current element if the key
 	// already exists
@@ -380,32 +1048,36 @@ struct flat_unsigned_hashmap {
 	// exists
 	template <class... Args>
 	std::pair<iterator, bool> try_emplace(key_type key, Args&&... args) {
-		if (load_factor() >= max_load_factor()) {
-			size_type new_size = hash_max() * 2;
-			rehash(new_size);
-		}
-
-		auto lookup_it = find_first_slot_or_hole(key);
-		if (lookup_it == _lookup.end()) {
-			// Need to grow _lookup for trailing collisions.
-			size_type idx = _lookup.size();
-			_lookup.resize(size_type(_lookup.size() * _lookup_trailing_amount));
-			lookup_it = _lookup.begin() + idx;
-		}
-
-		if (lookup_it->idx != idx_sentinel()) {
-			// Found valid key.
-			return { _values.begin() + lookup_it->idx, false };
-		}
+		return mupsert(
+				key,
+				[&](values_container& values) {
+					values.emplace_back(std::forward<Args>(args)...);
+				},
+				[](value_type&) {});
+	}
 
-		idx_type new_pos = idx_type(_values.size());
-		_values.emplace_back(std::forward<Args>(args)...);
-		_reverse_lookup.push_back(key);
-		lookup_it->key = key;
-		lookup_it->idx = new_pos;
+	// inserts make_fn() if the key does not exist, calls update_fn(value)
+	// if it exists
+	// probes once, returns true if the value was inserted
+	template <class MakeFn, class UpdateFn>
+	std::pair<iterator, bool> upsert(
+			key_type key, MakeFn&& make_fn, UpdateFn&& update_fn) {
+		return mupsert(
+				key,
+				[&](values_container& values) {
+					values.emplace_back(make_fn());
+				},
+				update_fn);
+	}
 
-		assert(_reverse_lookup.size() == _values.size());
-		return { begin() + new_pos, true };
+	// calls fn(value), the value is default constructed first if the key
+	// does not exist
+	// probes once, returns true if the value was inserted
+	template <class Fn>
+	std::pair<iterator, bool> compute(key_type key, Fn&& fn) {
+		std::pair<iterator, bool> ret = try_emplace(key);
+		fn(*ret.first);
+		return ret;
 	}
 
 	// erases elements
@@ -417,63 +1089,217 @@ struct flat_unsigned_hashmap {
 		size_t first_idx = std::distance(_values.cbegin(), first);
 		size_t last_idx = std::distance(_values.cbegin(), last);
 
-		std::vector<key_type> to_erase;
-		to_erase.reserve(last_idx - first_idx);
-		for (auto it = _reverse_lookup.begin() + first_idx;
-				it != _reverse_lookup.begin() + last_idx; ++it) {
-			to_erase.push_back(*it);
+		std::vector<idx_type> victims(last_idx - first_idx);
+		std::iota(victims.begin(), victims.end(), idx_type(first_idx));
+		erase_victims(victims);
+	}
+	// erases all the provided keys, ignores missing keys
+	// returns the number of erased elements
+	size_type erase(const key_type* keys, size_type count) {
+		std::vector<idx_type> victims;
+		victims.reserve(count);
+		for (size_type i = 0; i < count; ++i) {
+			const_iterator it = find(keys[i]);
+			if (it == end()) {
+				continue;
+			}
+			victims.push_back(idx_type(std::distance(cbegin(), it)));
 		}
 
-		for (key_type& k : to_erase) {
-			erase(k);
-		}
+		std::sort(victims.begin(), victims.end());
+		victims.erase(
+				std::unique(victims.begin(), victims.end()), victims.end());
+		erase_victims(victims);
+		return victims.size();
 	}
 	size_type erase(key_type k) {
+		return erase_index(k).second ? 1 : 0;
+	}
+
+	// erases k, the last element moves into its position
+	// returns k's position and true, or size() and false if k doesn't exist
+	// lets storage that mirrors the positions follow with a single probe
+	std::pair<size_type, bool> erase_index(key_type k) {
+		if (is_small()) {
+			size_type idx = small_find(k);
+			if (idx == _values.size()) {
+				return { idx, false };
+			}
+
+			small_erase_at(idx);
+			return { idx, true };
+		}
+
 		auto lookup_it = find_first_slot_or_hole(k);
-		if (lookup_it == _lookup.end()) {
-			return 0;
+		if (lookup_it == _lookup.end() || lookup_it->idx == idx_sentinel()) {
+			return { size(), false };
 		}
 
-		if (lookup_it->idx == idx_sentinel()) {
-			return 0;
+		size_type idx = lookup_it->idx;
+		erase_at(lookup_it);
+		return { idx, true };
+	}
+
+	// erases all elements satisfying the predicate
+	// the predicate is called with (key_type, const value_type&)
+	// returns the number of erased elements
+	template <class Pred>
+	size_type erase_if(Pred pred) {
+		const auto& values = _values;
+		std::vector<idx_type> victims;
+		for (size_t i = 0; i < values.size(); ++i) {
+			if (pred(_reverse_lookup[i], values[i])) {
+				victims.push_back(idx_type(i));
+			}
 		}
 
-		auto e = detail::flathashmap_make_on_exit(
-				[lookup_idx = std::distance(_lookup.begin(), lookup_it),
-						this]() { repack_collisions(lookup_idx); });
+		erase_victims(victims);
+		return victims.size();
+	}
 
-		if (lookup_it->idx == _values.size() - 1) {
-			// No need for swap, object is already at end.
-			*lookup_it = {};
-			_reverse_lookup.pop_back();
-			_values.pop_back();
-			assert(_values.size() == _reverse_lookup.size());
+	// moves the element out of the map, into a node
+	// returns an empty node if the key doesn't exist
+	node_type extract(key_type k) {
+		if (is_small()) {
+			size_type idx = small_find(k);
+			if (idx == _values.size()) {
+				return node_type{};
+			}
 
-			return 1;
+			node_type ret{ detail::unsigned_node_make_t{}, k,
+				detail::flathashmap_maybe_move(_values[idx]) };
+			small_erase_at(idx);
+			return ret;
 		}
 
-		// todo : Better way than doing a key search? could be slow
-		// if we store the index of the key lookup, rehash gets slower
-		key_type last_key = _reverse_lookup.back();
-		auto last_lookup_it = find_first_slot_or_hole(last_key);
+		// Erases through the slot found, the key is only probed once.
+		auto lookup_it = find_first_slot_or_hole(k);
+		if (lookup_it == _lookup.end() || lookup_it->idx == idx_sentinel()) {
+			return node_type{};
+		}
 
-		// set new pos on last element.
-		last_lookup_it->idx = lookup_it->idx;
+		node_type ret{ detail::unsigned_node_make_t{}, k,
+			detail::flathashmap_maybe_move(_values[lookup_it->idx]) };
+		erase_at(lookup_it);
+		return ret;
+	}
+	node_type extract(const_iterator pos) {
+		size_t idx = std::distance(_values.cbegin(), pos);
+		return extract(_reverse_lookup[idx]);
+	}
 
-		// invalidate erased lookup
-		*lookup_it = {};
+	// moves the elements of other whose keys aren't in this map, the others
+	// stay in other
+	// values are moved straight from other's storage, nothing is copied
+	// if a move throws, other keeps the elements that weren't moved yet
+	void merge(flat_unsigned_hashmap& other) {
+		if (&other == this) {
+			return;
+		}
 
-		// "swap" the elements
-		_values[last_lookup_it->idx]
-				= detail::flathashmap_maybe_move(_values.back());
-		_reverse_lookup[last_lookup_it->idx] = last_key;
+		// Grow once, so the loop never rehashes.
+		size_type new_size = size() + other.size();
+		reserve(new_size);
+		if (new_size > small_count()
+				&& (is_small()
+						|| new_size >= hash_max() * max_load_factor())) {
+			rehash(size_type(new_size / max_load_factor()) + 1);
+		}
 
-		// delete last
-		_values.pop_back();
-		_reverse_lookup.pop_back();
+		// The elements that stay are packed at the front of other. If a move
+		// throws, the values already moved out are dropped from other, so it
+		// stays valid.
+		size_type kept = 0;
+		size_type i = 0;
+		try {
+			for (; i < other._values.size(); ++i) {
+				key_type k = other._reverse_lookup[i];
+				std::pair<iterator, bool> ret = mupsert(
+						k,
+						[&](values_container& values) {
+							values.push_back(detail::flathashmap_maybe_move(
+									other._values[i]));
+						},
+						[](value_type&) {});
+				if (ret.second) {
+					continue;
+				}
+
+				if (kept != i) {
+					other._values[kept]
+							= detail::flathashmap_maybe_move(other._values[i]);
+					other._reverse_lookup[kept] = k;
+				}
+				++kept;
+			}
+		} catch (...) {
+			other.erase_merged(kept, i);
+			throw;
+		}
 
-		assert(_values.size() == _reverse_lookup.size());
-		return 1;
+		other.erase_merged(kept, other._values.size());
+	}
+	void merge(flat_unsigned_hashmap&& other) {
+		merge(other);
+	}
+
+	// reorders the values in key order or lookup order, so neighbouring keys
+	// are neighbours in memory again after erases scattered them
+	// invalidates iterators
+	void compact(key_order_t) {
+		// Sorting the keys with their index beats sorting indexes through
+		// the reverse lookup, which misses cache on every compare.
+		std::vector<std::pair<key_type, idx_type>> sorted;
+		sorted.reserve(size());
+		for (size_t i = 0; i < size(); ++i) {
+			sorted.push_back({ _reverse_lookup[i], idx_type(i) });
+		}
+		std::sort(sorted.begin(), sorted.end());
+
+		std::vector<idx_type> order;
+		order.reserve(size());
+		for (const std::pair<key_type, idx_type>& p : sorted) {
+			order.push_back(p.second);
+		}
+		apply_order(order);
+	}
+	void compact(hash_order_t) {
+		if (is_small()) {
+			return;
+		}
+
+		std::vector<idx_type> order;
+		order.reserve(size());
+		for (const lookup_data& l : _lookup) {
+			if (l.idx != idx_sentinel()) {
+				order.push_back(l.idx);
+			}
+		}
+		apply_order(order);
+	}
+	// incremental compact, places at most count values, starting where
+	// cursor stopped
+	// the map can change between calls, it is always valid but may end up
+	// less ordered
+	// returns true once the map is compacted
+	bool compact(key_order_t, compact_cursor& cursor, size_type count) {
+		if (!cursor._started) {
+			cursor._keys.assign(_reverse_lookup.begin(), _reverse_lookup.end());
+			std::sort(cursor._keys.begin(), cursor._keys.end());
+			cursor._started = true;
+		}
+		return compact_step(cursor, count);
+	}
+	bool compact(hash_order_t, compact_cursor& cursor, size_type count) {
+		if (!cursor._started) {
+			for (const lookup_data& l : _lookup) {
+				if (l.idx != idx_sentinel()) {
+					cursor._keys.push_back(l.key);
+				}
+			}
+			cursor._started = true;
+		}
+		return compact_step(cursor, count);
 	}
 
 	// swaps the contents
@@ -488,6 +1314,7 @@ struct flat_unsigned_hashmap {
 
 	// Lookup
 	// direct access to the underlying vector
+	// only available with contiguous_values storage
 	const value_type* data() const noexcept {
 		return _values.data();
 	}
@@ -495,6 +1322,17 @@ struct flat_unsigned_hashmap {
 		return _values.data();
 	}
 
+	// calls func(first, last) on each contiguous span of values, in
+	// iteration order
+	template <class Func>
+	void iterate_chunks(Func&& func) const {
+		detail::iterate_chunks(_values, func);
+	}
+	template <class Func>
+	void iterate_chunks(Func&& func) {
+		detail::iterate_chunks(_values, func);
+	}
+
 	// access specified element with bounds checking
 	const mapped_type& at(key_type k) const {
 		const_iterator it = find(k);
@@ -522,12 +1360,7 @@ struct flat_unsigned_hashmap {
 
 	// access or insert specified element
 	mapped_type& operator[](key_type k) {
-		iterator it = find(k);
-		if (it != end()) {
-			return *it;
-		}
-
-		return *insert(k, {}).first;
+		return *try_emplace(k).first;
 	}
 
 	// returns the number of elements matching specific key (which is 1 or 0,
@@ -541,6 +1374,10 @@ struct flat_unsigned_hashmap {
 
 	// finds element with specific key
 	const_iterator find(key_type k) const {
+		if (is_small()) {
+			return begin() + small_find(k);
+		}
+
 		auto lookup_it = find_first_slot_or_hole(k);
 		if (lookup_it == _lookup.end()) {
 			return end();
@@ -573,12 +1410,12 @@ struct flat_unsigned_hashmap {
 	// Hash policy
 
 	// returns average number of elements per bucket
+	// small maps report their fill ratio
 	float load_factor() const noexcept {
-		size_type h_max = hash_max();
-		if (h_max == 0) {
-			return 2.f; // dummy value to trigger growth, must be > 1.f
+		if (is_small()) {
+			return _values.size() / float(small_count());
 		}
-		return _values.size() / float(h_max);
+		return _values.size() / float(hash_max());
 	}
 
 	float max_load_factor() const noexcept {
@@ -596,53 +1433,113 @@ struct flat_unsigned_hashmap {
 		}
 		assert(detail::is_prime(count));
 
-		std::vector<lookup_data> new_lookup(count);
+		lookup_vector new_lookup(
+				count, empty_lookup(), _lookup.get_allocator());
 
-		for (const lookup_data& lookup : _lookup) {
-			if (lookup.idx == idx_sentinel()) {
-				continue;
-			}
+		// Built from the reverse lookup, which also works for small maps that
+		// don't have a lookup yet.
+		for (size_t i = 0; i < _reverse_lookup.size(); ++i) {
+			lookup_insert(new_lookup, count, _reverse_lookup[i], idx_type(i));
+		}
 
-			// new lookup position
-			size_type new_bucket_pos = key_to_index(lookup.key, count);
-			auto it = find_first_hole(
-					new_lookup.begin(), new_lookup.end(), new_bucket_pos);
+		_lookup = std::move(new_lookup);
+		_hash_max = count;
+	}
 
-			if (it == new_lookup.end()) {
-				size_type idx = new_lookup.size();
-				new_lookup.resize(size_type(idx * _lookup_trailing_amount));
-				it = new_lookup.begin() + idx;
-			}
 
-			// creates new lookup, assigns the existing element pos
-			it->key = lookup.key;
-			it->idx = lookup.idx;
+	// Freezing
+
+	// returns the size in bytes of the frozen image, see freeze
+	size_type frozen_size() const noexcept {
+		return size_type(make_frozen_header().image_size);
+	}
+
+	// writes a read-only, position independent image of the map to dst,
+	// open it with fea::frozen_flat_unsigned_hashmap_view
+	// dst must hold frozen_size() bytes and be aligned for value_type and
+	// uint64_t
+	// mapped_type must be trivially copyable
+	void freeze(void* dst, size_type dst_size) const {
+		if (dst_size < frozen_size()) {
+			throw std::invalid_argument{
+				"flat_unsigned_hashmap : freeze buffer too small"
+			};
+		}
+		if (reinterpret_cast<uintptr_t>(dst)
+						% detail::flat_hashmap_frozen_alignment<value_type>()
+				!= 0) {
+			throw std::invalid_argument{
+				"flat_unsigned_hashmap : freeze buffer is misaligned"
+			};
 		}
 
-		_lookup = std::move(new_lookup);
-		_hash_max = count;
+		char* out = static_cast<char*>(dst);
+		write_frozen([&](const void* data, size_t bytes) {
+			std::memcpy(out, data, bytes);
+			out += bytes;
+		});
+	}
+
+	// writes the frozen image to path
+	void freeze(const char* path) const {
+		std::unique_ptr<std::FILE, int (*)(std::FILE*)> file{
+			detail::open_file(path, "wb"), &std::fclose
+		};
+		if (file == nullptr) {
+			throw std::runtime_error{
+				"flat_unsigned_hashmap : couldn't open file"
+			};
+		}
+
+		write_frozen([&](const void* data, size_t bytes) {
+			if (std::fwrite(data, 1, bytes, file.get()) != bytes) {
+				throw std::runtime_error{
+					"flat_unsigned_hashmap : couldn't write file"
+				};
+			}
+		});
+
+		if (std::fclose(file.release()) != 0) {
+			throw std::runtime_error{
+				"flat_unsigned_hashmap : couldn't write file"
+			};
+		}
 	}
 
 
 	// Non-member functions
 
 	//	compares the values in the unordered_map
-	template <class K, class U>
-	friend bool operator==(const flat_unsigned_hashmap<K, U>& lhs,
-			const flat_unsigned_hashmap<K, U>& rhs);
-	template <class K, class U>
-	friend bool operator!=(const flat_unsigned_hashmap<K, U>& lhs,
-			const flat_unsigned_hashmap<K, U>& rhs);
+	template <class K, class U, class A, class V>
+	friend bool operator==(const flat_unsigned_hashmap<K, U, A, V>& lhs,
+			const flat_unsigned_hashmap<K, U, A, V>& rhs);
+	template <class K, class U, class A, class V>
+	friend bool operator!=(const flat_unsigned_hashmap<K, U, A, V>& lhs,
+			const flat_unsigned_hashmap<K, U, A, V>& rhs);
 
 private:
+	// Kept trivial so lookup copies, growth and fills are simple memory
+	// copies. Use empty_lookup() to initialize.
 	struct lookup_data {
 		// The user provided key.
-		key_type key = key_sentinel();
+		key_type key;
 
 		// The index of the user data in the _values container.
-		idx_type idx = idx_sentinel();
+		idx_type idx;
 	};
 
+	static constexpr lookup_data empty_lookup() noexcept {
+		return { key_sentinel(), idx_sentinel() };
+	}
+
+	template <class U>
+	using rebind_alloc_t = typename std::allocator_traits<
+			allocator_type>::template rebind_alloc<U>;
+	using lookup_vector
+			= std::vector<lookup_data, rebind_alloc_t<lookup_data>>;
+	using reverse_lookup_type = detail::flat_hashmap_key_buffer<key_type,
+			rebind_alloc_t<key_type>, detail::flat_hashmap_small_count>;
+
 	size_type hash_max() const {
 		assert(detail::is_prime(_hash_max) || _hash_max == 0);
 		return _hash_max;
@@ -671,6 +1568,87 @@ private:
 		return 7;
 	}
 
+	// Up to this many elements, the map doesn't allocate a lookup and finds
+	// keys with a linear scan of the reverse lookup, which stores them
+	// inline. Past 8 keys, the scan is slower than hashing.
+	static constexpr size_type small_count() noexcept {
+		return detail::flat_hashmap_small_count;
+	}
+
+	// Small maps have no lookup, until they overflow small_count() or
+	// rehash() is called.
+	bool is_small() const noexcept {
+		return _hash_max == 0;
+	}
+
+	// Returns the index of key, or size() if it isn't in a small map.
+	size_type small_find(key_type key) const noexcept {
+		assert(is_small());
+		auto it = std::find(
+				_reverse_lookup.begin(), _reverse_lookup.end(), key);
+		return size_type(std::distance(_reverse_lookup.begin(), it));
+	}
+
+	detail::flat_hashmap_frozen_header make_frozen_header() const noexcept {
+		return detail::make_flat_hashmap_frozen_header<key_type, idx_type,
+				value_type>(_hash_max, _lookup.size(), _values.size());
+	}
+
+	// Writes the frozen image in order, through write(data, bytes).
+	template <class Write>
+	void write_frozen(Write&& write) const {
+		static_assert(std::is_trivially_copyable<mapped_type>::value,
+				"flat_unsigned_hashmap : freeze requires a trivially copyable "
+				"mapped_type");
+		using slot_t = detail::flat_hashmap_frozen_slot<key_type, idx_type>;
+
+		detail::flat_hashmap_frozen_header header = make_frozen_header();
+		uint64_t pos = 0;
+		auto pad_to = [&](uint64_t offset) {
+			const char zeros[detail::flat_hashmap_frozen_section_align] = {};
+			if (offset != pos) {
+				write(zeros, size_t(offset - pos));
+			}
+			pos = offset;
+		};
+
+		write(&header, sizeof(header));
+		pos += sizeof(header);
+
+		// The slot layout is part of the format, copy field by field.
+		pad_to(header.lookup_offset);
+		std::array<slot_t, 1024> slots;
+		for (size_t i = 0; i < _lookup.size(); i += slots.size()) {
+			size_t count = (std::min)(slots.size(), _lookup.size() - i);
+			for (size_t j = 0; j < count; ++j) {
+				slots[j] = { _lookup[i + j].key, _lookup[i + j].idx };
+			}
+			write(slots.data(), count * sizeof(slot_t));
+		}
+		pos += _lookup.size() * sizeof(slot_t);
+
+		pad_to(header.reverse_lookup_offset);
+		if (!_reverse_lookup.empty()) {
+			write(_reverse_lookup.data(),
+					_reverse_lookup.size() * sizeof(key_type));
+		}
+		pos += _reverse_lookup.size() * sizeof(key_type);
+
+		pad_to(header.values_offset);
+		iterate_chunks([&](const value_type* first, const value_type* last) {
+			write(first, size_t(last - first) * sizeof(value_type));
+		});
+	}
+
+	// Returns the next hash max when growing. Small maps that overflow go
+	// straight to a lookup sized for their elements.
+	size_type grow_count() const noexcept {
+		if (is_small()) {
+			return size_type(_values.size() / max_load_factor()) * 2;
+		}
+		return hash_max() * 2;
+	}
+
 	// Custom find_if.
 	// todo : benchmark simd search
 	template <class Iter, class Func>
@@ -713,19 +1691,155 @@ private:
 		return _lookup.erase(const_it, const_it);
 	}
 
-	// Find first free slot given a lookup idx.
-	template <class Iter>
-	static auto find_first_hole(Iter beg, Iter end, size_type bucket_idx) {
-
-		// find first free slot
-		auto it = find_slot(
-				beg + bucket_idx, end, [](const lookup_data& search) {
+	// Inserts a key which isn't in the lookup yet. Grows the lookup if the
+	// collisions reach its end without a hole.
+	static void lookup_insert(lookup_vector& lookup,
+			size_type h_max, key_type key, idx_type idx) {
+		size_type bucket_pos = key_to_index(key, h_max);
+		auto it = find_slot(lookup.begin() + bucket_pos, lookup.end(),
+				[](const lookup_data& search) {
 					return search.idx == idx_sentinel();
 				});
 
-		assert(it != end);
+		if (it == lookup.end()) {
+			size_type lookup_idx = lookup.size();
+			lookup.resize(size_type(lookup_idx * _lookup_trailing_amount),
+					empty_lookup());
+			it = lookup.begin() + lookup_idx;
+		}
 
-		return it;
+		it->key = key;
+		it->idx = idx;
+	}
+
+	// Erases the value at idx of a small map.
+	void small_erase_at(size_type idx) {
+		if (idx != _values.size() - 1) {
+			_values[idx] = detail::flathashmap_maybe_move(_values.back());
+			_reverse_lookup[idx] = _reverse_lookup.back();
+		}
+		_values.pop_back();
+		_reverse_lookup.pop_back();
+	}
+
+	// Erases the value of an occupied lookup slot.
+	template <class LookupIt>
+	void erase_at(LookupIt lookup_it) {
+		auto e = detail::flathashmap_make_on_exit(
+				[lookup_idx = std::distance(_lookup.begin(), lookup_it),
+						this]() { repack_collisions(lookup_idx); });
+
+		if (lookup_it->idx == _values.size() - 1) {
+			// No need for swap, object is already at end.
+			*lookup_it = empty_lookup();
+			_reverse_lookup.pop_back();
+			_values.pop_back();
+			assert(_values.size() == _reverse_lookup.size());
+
+			return;
+		}
+
+		// todo : Better way than doing a key search? could be slow
+		// if we store the index of the key lookup, rehash gets slower
+		key_type last_key = _reverse_lookup.back();
+		auto last_lookup_it = find_first_slot_or_hole(last_key);
+
+		// set new pos on last element.
+		last_lookup_it->idx = lookup_it->idx;
+
+		// invalidate erased lookup
+		*lookup_it = empty_lookup();
+
+		// "swap" the elements
+		_values[last_lookup_it->idx]
+				= detail::flathashmap_maybe_move(_values.back());
+		_reverse_lookup[last_lookup_it->idx] = last_key;
+
+		// delete last
+		_values.pop_back();
+		_reverse_lookup.pop_back();
+
+		assert(_values.size() == _reverse_lookup.size());
+	}
+
+	// Drops the values in [first, last), which merge moved out or packed
+	// forward, and rebuilds the lookup.
+	void erase_merged(size_type first, size_type last) {
+		if (first == last) {
+			return;
+		}
+
+		_values.erase(std::next(_values.begin(), first),
+				std::next(_values.begin(), last));
+		_reverse_lookup.erase(std::next(_reverse_lookup.begin(), first),
+				std::next(_reverse_lookup.begin(), last));
+		if (!is_small()) {
+			rebuild_lookup();
+		}
+	}
+
+	// Rebuilds the lookup in place from the reverse lookup.
+	void rebuild_lookup() {
+		std::fill(_lookup.begin(), _lookup.end(), empty_lookup());
+		for (size_t i = 0; i < _reverse_lookup.size(); ++i) {
+			lookup_insert(_lookup, hash_max(), _reverse_lookup[i], idx_type(i));
+		}
+	}
+
+	// Erases the values at the provided sorted and unique positions.
+	// Holes are filled with the survivors at the back, so at most
+	// min(victims, survivors) values are moved. When erasing a large portion
+	// of the map, the lookup is rebuilt once instead of being patched per
+	// key.
+	void erase_victims(const std::vector<idx_type>& victims) {
+		assert(std::is_sorted(victims.begin(), victims.end()));
+		if (victims.empty()) {
+			return;
+		}
+
+		// Small maps have no lookup to patch or rebuild.
+		bool small = is_small();
+		bool rebuild = !small && victims.size() >= _values.size() / 4;
+		if (!small && !rebuild) {
+			for (idx_type victim : victims) {
+				auto lookup_it
+						= find_first_slot_or_hole(_reverse_lookup[victim]);
+				*lookup_it = empty_lookup();
+				repack_collisions(
+						size_type(std::distance(_lookup.begin(), lookup_it)));
+			}
+		}
+
+		size_t new_size = _values.size() - victims.size();
+		size_t back = _values.size();
+		size_t tail_victim = victims.size();
+
+		for (size_t i = 0; i < victims.size() && victims[i] < new_size; ++i) {
+			// Skip the victims at the back, there are exactly as many
+			// survivors past new_size as there are holes before it.
+			--back;
+			while (tail_victim > 0 && victims[tail_victim - 1] == back) {
+				--tail_victim;
+				--back;
+			}
+
+			idx_type hole = victims[i];
+			_values[hole] = detail::flathashmap_maybe_move(_values[back]);
+			_reverse_lookup[hole] = _reverse_lookup[back];
+
+			if (!small && !rebuild) {
+				find_first_slot_or_hole(_reverse_lookup[hole])->idx = hole;
+			}
+		}
+
+		// A single call, free for trivially destructible values.
+		_values.erase(_values.begin() + new_size, _values.end());
+		_reverse_lookup.resize(new_size);
+		assert(_values.size() == _reverse_lookup.size());
+
+		if (rebuild) {
+			rebuild_lookup();
+		}
 	}
 
 	// Packs the collisions so all clashing keys are contigous.
@@ -761,44 +1875,153 @@ private:
 
 			lookup_data& right = _lookup[swap_right_idx];
 			_lookup[swap_left_idx] = right;
-			right = {}; // Invalidate in case it is the last.
+			right = empty_lookup(); // Invalidate in case it is the last.
 
 			swap_left_idx = swap_right_idx;
 			++swap_right_idx;
 		}
 
-		// Something went horribly wrong.
-		assert(false);
+		// Reached the end of the lookup. Trailing collisions can fill it,
+		// they are packed.
 	}
 
 	template <class M>
 	std::pair<iterator, bool> minsert(
 			key_type key, M&& value, bool assign_found = false) {
-		if (load_factor() >= max_load_factor()) {
-			size_type new_size = hash_max() * 2;
-			rehash(new_size);
-		}
+		return mupsert(
+				key,
+				[&](values_container& values) {
+					values.push_back(std::forward<M>(value));
+				},
+				[&](value_type& found) {
+					if (assign_found) {
+						found = std::forward<M>(value);
+					}
+				});
+	}
 
-		auto lookup_it = find_first_slot_or_hole(key);
-		if (lookup_it == _lookup.end()) {
-			// Need to grow _lookup for trailing collisions.
-			size_type idx = _lookup.size();
-			_lookup.resize(size_type(idx * _lookup_trailing_amount));
-			lookup_it = _lookup.begin() + idx;
+	// Finds the key's slot or hole once. Calls make(_values) to append a new
+	// value, or update(value) on the existing one.
+	template <class Make, class Update>
+	std::pair<iterator, bool> mupsert(
+			key_type key, Make&& make, Update&& update) {
+		if (is_small()) {
+			return small_upsert(key, make, update);
 		}
 
-		if (lookup_it->idx != idx_sentinel()) {
+		auto lookup_it = static_cast<const flat_unsigned_hashmap*>(this)
+								 ->find_first_slot_or_hole(key);
+		if (lookup_it != _lookup.end() && lookup_it->idx != idx_sentinel()) {
 			// Found valid key.
-
 			auto data_it = _values.begin() + lookup_it->idx;
-			if (assign_found) {
-				*data_it = std::forward<M>(value);
-			}
+			update(*data_it);
+			return { data_it, false };
+		}
+		return { mappend(key, size_type(lookup_it - _lookup.cbegin()), make),
+			true };
+	}
+
+	// mupsert on a small map, grows it into a hashmap when full.
+	template <class Make, class Update>
+	std::pair<iterator, bool> small_upsert(
+			key_type key, Make& make, Update& update) {
+		size_type idx = small_find(key);
+		if (idx != _values.size()) {
+			auto data_it = _values.begin() + idx;
+			update(*data_it);
 			return { data_it, false };
 		}
 
+		if (_values.size() < small_count()) {
+			make(_values);
+			_reverse_lookup.push_back(key);
+			return { _values.end() - 1, true };
+		}
+		return { mappend(key, _lookup.size(), make), true };
+	}
+
+	// Moves the values to their new positions, order[new_idx] == old_idx.
+	// Fixes the lookup in one pass.
+	void apply_order(const std::vector<idx_type>& order) {
+		assert(order.size() == size());
+		values_container values(_values.get_allocator());
+		values.reserve(size());
+		reverse_lookup_type reverse_lookup(_reverse_lookup.get_allocator());
+		reverse_lookup.reserve(size());
+		std::vector<idx_type> new_idxes(size());
+
+		for (size_t i = 0; i < order.size(); ++i) {
+			values.push_back(detail::flathashmap_maybe_move(_values[order[i]]));
+			reverse_lookup.push_back(_reverse_lookup[order[i]]);
+			new_idxes[order[i]] = idx_type(i);
+		}
+
+		_values.swap(values);
+		_reverse_lookup.swap(reverse_lookup);
+		for (lookup_data& l : _lookup) {
+			if (l.idx != idx_sentinel()) {
+				l.idx = new_idxes[l.idx];
+			}
+		}
+	}
+
+	// Places cursor's next keys at cursor's position, with swaps.
+	bool compact_step(compact_cursor& cursor, size_type count) {
+		for (size_type i = 0; i < count; ++i) {
+			if (cursor._next == cursor._keys.size() || cursor._pos >= size()) {
+				return true;
+			}
+
+			key_type k = cursor._keys[cursor._next++];
+			const_iterator it = find(k);
+			if (it == cend()) {
+				// Erased since the first call.
+				continue;
+			}
+
+			size_type idx = size_type(std::distance(cbegin(), it));
+			if (idx < cursor._pos) {
+				// Moved into the placed values by an erase since the last
+				// call, leave it there.
+				continue;
+			}
+
+			if (idx != cursor._pos) {
+				key_type other = _reverse_lookup[cursor._pos];
+				using std::swap;
+				swap(_values[cursor._pos], _values[idx]);
+				swap(_reverse_lookup[cursor._pos], _reverse_lookup[idx]);
+				if (!is_small()) {
+					find_first_slot_or_hole(k)->idx = idx_type(cursor._pos);
+					find_first_slot_or_hole(other)->idx = idx_type(idx);
+				}
+			}
+			++cursor._pos;
+		}
+
+		return cursor._next == cursor._keys.size() || cursor._pos >= size();
+	}
+
+	// Appends a new key in the hole found by mupsert. Kept out of mupsert so
+	// the hit path inlines, and only misses check the load factor.
+	template <class Make>
+	iterator mappend(key_type key, size_type lookup_idx, Make& make) {
+		auto lookup_it = _lookup.begin() + lookup_idx;
+		if (is_small() || load_factor() >= max_load_factor()) {
+			rehash(grow_count());
+			lookup_it = find_first_slot_or_hole(key);
+		}
+
+		if (lookup_it == _lookup.end()) {
+			// Need to grow _lookup for trailing collisions.
+			size_type idx = _lookup.size();
+			_lookup.resize(
+					size_type(idx * _lookup_trailing_amount), empty_lookup());
+			lookup_it = _lookup.begin() + idx;
+		}
+
 		idx_type new_pos = idx_type(_values.size());
-		_values.push_back(std::forward<M>(value));
+		make(_values);
 		_reverse_lookup.push_back(key);
 		lookup_it->key = key;
 		lookup_it->idx = new_pos;
@@ -806,7 +2029,7 @@ private:
 		assert(_reverse_lookup.size() == _values.size());
 		assert(_values.size() < idx_sentinel()
 				&& "container has reached max capacity");
-		return { begin() + new_pos, true };
+		return begin() + new_pos;
 	}
 
 	// OK, so, we always have max_hash * 2 lookups. The load_factor will be
@@ -819,30 +2042,30 @@ private:
 	// The hash max value is the current theoretical size of the lookup.
 	// It is decoupled from _lookup.size() to allow growing lookup in certain
 	// situations (when adding collisions at the end, requires growing lookup).
+	// It is 0 while the map is small and has no lookup.
 	size_type _hash_max = 0;
 
 	// Stores the key at hash and points to the values index.
 	// Lookups at odd indexes are collisions stored in-place.
-	std::vector<lookup_data> _lookup;
+	lookup_vector _lookup;
 
-	// Used in erase for swap & pop.
-	std::vector<key_type> _reverse_lookup;
+	// Used in erase for swap & pop. Small maps keep their keys inline.
+	reverse_lookup_type _reverse_lookup;
 
 	// Packed user values.
 	// Since this is a flat map, the values are tightly packed instead of in
 	// pairs.
-	// This means we cannot fulfill standard apis.
-	// todo : make unsigned_hashmap for cases when you need pair iterators.
-	std::vector<value_type> _values;
+	// This means we cannot fulfill standard apis, kvs() zips the keys.
+	values_container _values;
 
 	// When the lookup collisions fill up the end of the lookup container, by
 	// how much do we resize it?
 	constexpr static double _lookup_trailing_amount = 1.25;
 };
 
-template <class Key, class T>
-inline bool operator==(const flat_unsigned_hashmap<Key, T>& lhs,
-		const flat_unsigned_hashmap<Key, T>& rhs) {
+template <class Key, class T, class A, class V>
+inline bool operator==(const flat_unsigned_hashmap<Key, T, A, V>& lhs,
+		const flat_unsigned_hashmap<Key, T, A, V>& rhs) {
 	if (lhs.size() != rhs.size())
 		return false;
 
@@ -860,9 +2083,17 @@ inline bool operator==(const flat_unsigned_hashmap<Key, T>& lhs,
 
 	return true;
 }
-template <class Key, class T>
-inline bool operator!=(const flat_unsigned_hashmap<Key, T>& lhs,
-		const flat_unsigned_hashmap<Key, T>& rhs) {
+template <class Key, class T, class A, class V>
+inline bool operator!=(const flat_unsigned_hashmap<Key, T, A, V>& lhs,
+		const flat_unsigned_hashmap<Key, T, A, V>& rhs) {
 	return !operator==(lhs, rhs);
 }
+
+#if __cplusplus >= 201703L
+namespace pmr {
+template <class Key, class T, class ValueStorage = contiguous_values>
+using flat_unsigned_hashmap = fea::flat_unsigned_hashmap<Key, T,
+		std::pmr::polymorphic_allocator<T>, ValueStorage>;
+} // namespace pmr
+#endif
 } // namespace fea
@@ -0,0 +1,334 @@
+﻿/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Philippe Groarke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "fea_flat_unsigned_hashmap.hpp"
+#include "fea_mapped_file.hpp"
+
+/*
+A read-only flat_unsigned_hashmap, probed in place from an image written by
+flat_unsigned_hashmap::freeze.
+
+The image is position independent. Build a table once, then every process
+maps the same file (or shared memory) and shares one page cache copy,
+instead of building its own heap map.
+	fea::flat_unsigned_hashmap<unsigned, float> map;
+	map.freeze("table.bin");
+
+	fea::frozen_flat_unsigned_hashmap_view<unsigned, float> view{
+		"table.bin"
+	};
+	const float& f = view.at(42);
+
+The image must have been written by the same Key and T, on a platform with
+the same endianness and type layouts. Mismatching images throw when opened.
+*/
+
+namespace fea {
+template <class Key, class T>
+struct frozen_flat_unsigned_hashmap_view {
+	static_assert(std::is_unsigned<Key>::value,
+			"frozen_flat_unsigned_hashmap_view : key must be unsigned "
+			"integer");
+	static_assert(std::is_trivially_copyable<T>::value,
+			"frozen_flat_unsigned_hashmap_view : mapped_type must be "
+			"trivially copyable");
+
+	using key_type = Key;
+	using mapped_type = T;
+	using value_type = mapped_type;
+	using size_type = std::size_t;
+	using idx_type = typename flat_unsigned_hashmap<Key, T>::idx_type;
+	using difference_type = std::ptrdiff_t;
+
+	using const_reference = const value_type&;
+	using const_pointer = const value_type*;
+	using const_iterator = const value_type*;
+	using iterator = const_iterator;
+
+
+	// Constructors, destructors and assignement
+
+	frozen_flat_unsigned_hashmap_view() noexcept = default;
+
+	// uses an image in memory, which must outlive the view
+	frozen_flat_unsigned_hashmap_view(const void* image, size_type size) {
+		validate(image, size);
+	}
+
+	// maps a file written by flat_unsigned_hashmap::freeze
+	explicit frozen_flat_unsigned_hashmap_view(const char* path) {
+		_mapping = detail::map_file(path, _mapping_size);
+		if (_mapping == nullptr) {
+			throw std::runtime_error{
+				"frozen_flat_unsigned_hashmap_view : couldn't map file"
+			};
+		}
+
+		try {
+			validate(_mapping, _mapping_size);
+		} catch (...) {
+			detail::unmap_file(_mapping, _mapping_size);
+			throw;
+		}
+	}
+
+	frozen_flat_unsigned_hashmap_view(
+			const frozen_flat_unsigned_hashmap_view&)
+			= delete;
+	frozen_flat_unsigned_hashmap_view& operator=(
+			const frozen_flat_unsigned_hashmap_view&)
+			= delete;
+
+	frozen_flat_unsigned_hashmap_view(
+			frozen_flat_unsigned_hashmap_view&& other) noexcept {
+		swap(other);
+	}
+	frozen_flat_unsigned_hashmap_view& operator=(
+			frozen_flat_unsigned_hashmap_view&& other) noexcept {
+		if (this != &other) {
+			frozen_flat_unsigned_hashmap_view tmp{ std::move(other) };
+			swap(tmp);
+		}
+		return *this;
+	}
+
+	~frozen_flat_unsigned_hashmap_view() {
+		detail::unmap_file(_mapping, _mapping_size);
+	}
+
+	void swap(frozen_flat_unsigned_hashmap_view& other) noexcept {
+		std::swap(_mapping, other._mapping);
+		std::swap(_mapping_size, other._mapping_size);
+		std::swap(_hash_max, other._hash_max);
+		std::swap(_lookup, other._lookup);
+		std::swap(_lookup_size, other._lookup_size);
+		std::swap(_reverse_lookup, other._reverse_lookup);
+		std::swap(_values, other._values);
+		std::swap(_size, other._size);
+	}
+
+
+	// Iterators
+
+	const_iterator begin() const noexcept {
+		return _values;
+	}
+	const_iterator cbegin() const noexcept {
+		return begin();
+	}
+	const_iterator end() const noexcept {
+		return _values + _size;
+	}
+	const_iterator cend() const noexcept {
+		return end();
+	}
+
+
+	// Capacity
+
+	bool empty() const noexcept {
+		return _size == 0;
+	}
+	size_type size() const noexcept {
+		return _size;
+	}
+
+
+	// Lookup
+
+	// direct access to the values
+	const value_type* data() const noexcept {
+		return _values;
+	}
+
+	// the keys, in the same order as the values
+	const key_type* key_data() const noexcept {
+		return _reverse_lookup;
+	}
+
+	// access specified element with bounds checking
+	const mapped_type& at(key_type k) const {
+		const_iterator it = find(k);
+		if (it == end()) {
+			throw std::out_of_range{
+				"frozen_flat_unsigned_hashmap_view : value doesn't exist"
+			};
+		}
+		return *it;
+	}
+
+	// returns the number of elements matching specific key
+	size_type count(key_type k) const noexcept {
+		return contains(k) ? 1 : 0;
+	}
+
+	// finds element with specific key
+	const_iterator find(key_type k) const noexcept {
+		return _values + find_idx(k);
+	}
+
+	// checks if the container contains element with specific key
+	bool contains(key_type k) const noexcept {
+		return find_idx(k) != _size;
+	}
+
+private:
+	using slot_t = detail::flat_hashmap_frozen_slot<key_type, idx_type>;
+
+	static constexpr idx_type idx_sentinel() noexcept {
+		return (std::numeric_limits<idx_type>::max)();
+	}
+
+	// Returns the value index of k, or size() if it isn't in the map.
+	// Indexes past the values are treated as missing, which keeps a corrupt
+	// image in bounds without validating the lookup when opening.
+	size_type find_idx(key_type k) const noexcept {
+		if (_hash_max == 0) {
+			// Small map, there is no lookup.
+			for (size_type i = 0; i < _size; ++i) {
+				if (_reverse_lookup[i] == k) {
+					return i;
+				}
+			}
+			return _size;
+		}
+
+		for (size_type i = size_type(k) % _hash_max; i < _lookup_size; ++i) {
+			const slot_t& slot = _lookup[i];
+			if (slot.idx == idx_sentinel()) {
+				return _size;
+			}
+			if (slot.key == k) {
+				return size_type(slot.idx) < _size ? size_type(slot.idx)
+												   : _size;
+			}
+		}
+		return _size;
+	}
+
+	// checks the header and section bounds, sets the section pointers
+	void validate(const void* image, size_type size) {
+		using header_t = detail::flat_hashmap_frozen_header;
+		if (image == nullptr || size < sizeof(header_t)) {
+			throw std::runtime_error{
+				"frozen_flat_unsigned_hashmap_view : image too small"
+			};
+		}
+		if (reinterpret_cast<uintptr_t>(image)
+						% detail::flat_hashmap_frozen_alignment<value_type>()
+				!= 0) {
+			throw std::runtime_error{
+				"frozen_flat_unsigned_hashmap_view : image is misaligned"
+			};
+		}
+
+		header_t header;
+		std::memcpy(&header, image, sizeof(header_t));
+		if (std::memcmp(header.magic, detail::flat_hashmap_frozen_magic,
+					sizeof(header.magic))
+				!= 0) {
+			throw std::runtime_error{
+				"frozen_flat_unsigned_hashmap_view : not a frozen "
+				"flat_unsigned_hashmap"
+			};
+		}
+		if (header.version != detail::flat_hashmap_frozen_version) {
+			throw std::runtime_error{
+				"frozen_flat_unsigned_hashmap_view : unsupported version"
+			};
+		}
+
+		// Also catches overflowing counts, the offsets wouldn't match.
+		if (header.num_lookup > size / sizeof(slot_t)
+				|| header.num_values > size / sizeof(value_type)) {
+			throw std::runtime_error{
+				"frozen_flat_unsigned_hashmap_view : corrupt image"
+			};
+		}
+
+		header_t expected = detail::make_flat_hashmap_frozen_header<key_type,
+				idx_type, value_type>(size_t(header.hash_max),
+				size_t(header.num_lookup), size_t(header.num_values));
+		if (header.endian_check != expected.endian_check
+				|| header.key_size != expected.key_size
+				|| header.idx_size != expected.idx_size
+				|| header.value_size != expected.value_size
+				|| header.value_align != expected.value_align) {
+			throw std::runtime_error{
+				"frozen_flat_unsigned_hashmap_view : image doesn't match the "
+				"map types"
+			};
+		}
+
+		if (header.hash_max > header.num_lookup
+				|| header.lookup_offset != expected.lookup_offset
+				|| header.reverse_lookup_offset
+						!= expected.reverse_lookup_offset
+				|| header.values_offset != expected.values_offset
+				|| header.image_size != expected.image_size
+				|| header.image_size > size) {
+			throw std::runtime_error{
+				"frozen_flat_unsigned_hashmap_view : corrupt image"
+			};
+		}
+
+		const char* bytes = static_cast<const char*>(image);
+		_hash_max = size_type(header.hash_max);
+		_lookup = reinterpret_cast<const slot_t*>(bytes + header.lookup_offset);
+		_lookup_size = size_type(header.num_lookup);
+		_reverse_lookup = reinterpret_cast<const key_type*>(
+				bytes + header.reverse_lookup_offset);
+		_values = reinterpret_cast<const value_type*>(
+				bytes + header.values_offset);
+		_size = size_type(header.num_values);
+	}
+
+	// Only set when the view maps a file.
+	const void* _mapping = nullptr;
+	size_t _mapping_size = 0;
+
+	size_type _hash_max = 0;
+	const slot_t* _lookup = nullptr;
+	size_type _lookup_size = 0;
+	const key_type* _reverse_lookup = nullptr;
+	const value_type* _values = nullptr;
+	size_type _size = 0;
+};
+} // namespace fea
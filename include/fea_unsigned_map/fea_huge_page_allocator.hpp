@@ -0,0 +1,162 @@
+﻿/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Philippe Groarke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+/*
+An allocator backed by transparent huge pages.
+
+Big lookup and index tables are probed at random, large maps spend most of
+their find time on TLB misses. Allocations of at least 2MB are mmapped on a
+2MB boundary and advised with MADV_HUGEPAGE, smaller allocations use
+std::allocator.
+
+The allocator is rebound for every internal buffer :
+	fea::flat_unsigned_hashmap<unsigned, float,
+			fea::huge_page_allocator<float>> map;
+	fea::unsigned_map<unsigned, float, fea::sentinel_indexes,
+			fea::huge_page_allocator<std::pair<unsigned, float>>> map;
+
+If the kernel doesn't support transparent huge pages, or on other platforms,
+you get normal pages.
+*/
+
+namespace fea {
+namespace detail {
+constexpr size_t huge_page_size = size_t(2) * 1024 * 1024;
+
+// Allocations smaller than this use std::allocator.
+#if defined(__linux__)
+constexpr size_t huge_page_threshold = huge_page_size;
+#else
+constexpr size_t huge_page_threshold = (std::numeric_limits<size_t>::max)();
+#endif
+
+inline size_t huge_page_round_up(size_t bytes) noexcept {
+	return (bytes + huge_page_size - 1) & ~(huge_page_size - 1);
+}
+
+#if defined(__linux__)
+// maps bytes (a multiple of huge_page_size) on a huge_page_size boundary
+inline void* huge_page_map(size_t bytes) {
+	// Over-allocate, then trim the unaligned head and the excess tail.
+	size_t map_size = bytes + huge_page_size;
+	void* ptr = mmap(nullptr, map_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED) {
+		throw std::bad_alloc{};
+	}
+
+	uintptr_t addr = reinterpret_cast<uintptr_t>(ptr);
+	uintptr_t aligned = (addr + huge_page_size - 1) & ~(huge_page_size - 1);
+	size_t head = size_t(aligned - addr);
+	size_t tail = map_size - head - bytes;
+	if (head != 0) {
+		munmap(ptr, head);
+	}
+	if (tail != 0) {
+		munmap(reinterpret_cast<void*>(aligned + bytes), tail);
+	}
+
+#if defined(MADV_HUGEPAGE)
+	// Best effort, normal pages are used if this fails.
+	madvise(reinterpret_cast<void*>(aligned), bytes, MADV_HUGEPAGE);
+#endif
+	return reinterpret_cast<void*>(aligned);
+}
+
+inline void huge_page_unmap(void* ptr, size_t bytes) noexcept {
+	munmap(ptr, bytes);
+}
+#endif
+} // namespace detail
+
+template <class T>
+struct huge_page_allocator {
+	using value_type = T;
+
+	huge_page_allocator() noexcept = default;
+	template <class U>
+	huge_page_allocator(const huge_page_allocator<U>&) noexcept {
+	}
+
+	T* allocate(size_t n) {
+		if (n > (std::numeric_limits<size_t>::max)() / sizeof(T)) {
+			throw std::bad_alloc{};
+		}
+
+#if defined(__linux__)
+		size_t bytes = n * sizeof(T);
+		if (uses_huge_pages(bytes)) {
+			return static_cast<T*>(
+					detail::huge_page_map(detail::huge_page_round_up(bytes)));
+		}
+#endif
+		return std::allocator<T>{}.allocate(n);
+	}
+
+	void deallocate(T* ptr, size_t n) noexcept {
+#if defined(__linux__)
+		size_t bytes = n * sizeof(T);
+		if (uses_huge_pages(bytes)) {
+			detail::huge_page_unmap(ptr, detail::huge_page_round_up(bytes));
+			return;
+		}
+#endif
+		std::allocator<T>{}.deallocate(ptr, n);
+	}
+
+	// returns true if an allocation of bytes goes through huge pages
+	static constexpr bool uses_huge_pages(size_t bytes) noexcept {
+		return bytes >= detail::huge_page_threshold;
+	}
+};
+
+template <class T, class U>
+inline bool operator==(const huge_page_allocator<T>&,
+		const huge_page_allocator<U>&) noexcept {
+	return true;
+}
+template <class T, class U>
+inline bool operator!=(const huge_page_allocator<T>&,
+		const huge_page_allocator<U>&) noexcept {
+	return false;
+}
+} // namespace fea
@@ -0,0 +1,541 @@
+﻿/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Philippe Groarke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+A read-only hash map over a key set known up front, built with a minimal
+perfect hash (PTHash style).
+
+Keys are split in buckets, every bucket gets a pilot so its keys land in
+distinct slots. Lookups hash the key once, read the bucket's pilot and land
+on exactly one slot, there are no collision chains. Values are packed, there
+are exactly size() slots and data() points to them.
+
+Values can be modified, the key set can't.
+	std::vector<unsigned> keys{ 4, 42, 1'000'000 };
+	std::vector<float> values{ 0.f, 1.f, 2.f };
+	fea::perfect_unsigned_hashmap<unsigned, float> map{ keys.data(),
+		values.data(), keys.size() };
+
+Building is slower than inserting in a flat_unsigned_hashmap, it pays off
+for tables that are built once and looked up often.
+*/
+
+namespace fea {
+namespace detail {
+// murmur3 finalizer, a bijection
+inline constexpr uint64_t perfect_hash_mix(uint64_t h) noexcept {
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+inline constexpr uint64_t perfect_hash_pilot(uint16_t pilot) noexcept {
+	return uint64_t(pilot) * 0x9e3779b97f4a7c15ull;
+}
+
+// maps x to [0, range) without a division
+inline constexpr uint32_t perfect_hash_reduce(
+		uint32_t x, uint32_t range) noexcept {
+	return uint32_t((uint64_t(x) * range) >> 32);
+}
+
+// Skewed buckets, 60% of the keys go to the first 30% of the buckets. Big
+// buckets are placed first while the table is mostly empty, which shortens
+// the pilot search of the small ones.
+inline uint32_t perfect_hash_bucket(uint32_t x, uint32_t num_buckets) noexcept {
+	constexpr uint64_t split = 2'576'980'378; // 0.6 * 2^32
+	constexpr uint64_t rest = (uint64_t(1) << 32) - split;
+	uint64_t dense = uint64_t(num_buckets) * 3 / 10;
+	if (x < split) {
+		return uint32_t(x * dense / split);
+	}
+	return uint32_t(dense + (x - split) * (num_buckets - dense) / rest);
+}
+} // namespace detail
+
+template <class Key, class T, class Alloc = std::allocator<T>>
+struct perfect_unsigned_hashmap {
+	static_assert(std::is_unsigned<Key>::value,
+			"perfect_unsigned_hashmap : key must be unsigned integer");
+	static_assert(
+			std::is_same<typename std::allocator_traits<Alloc>::value_type,
+					T>::value,
+			"perfect_unsigned_hashmap : allocator value_type must be T");
+
+	using key_type = Key;
+	using mapped_type = T;
+	using value_type = mapped_type;
+	using size_type = std::size_t;
+	using difference_type = std::ptrdiff_t;
+
+	using allocator_type = Alloc;
+
+	using reference = value_type&;
+	using const_reference = const value_type&;
+	using pointer = typename std::allocator_traits<allocator_type>::pointer;
+	using const_pointer =
+			typename std::allocator_traits<allocator_type>::const_pointer;
+
+	using iterator =
+			typename std::vector<value_type, allocator_type>::iterator;
+	using const_iterator =
+			typename std::vector<value_type, allocator_type>::const_iterator;
+
+
+	// Constructors, destructors and assignement
+
+	perfect_unsigned_hashmap() = default;
+	perfect_unsigned_hashmap(const perfect_unsigned_hashmap&) = default;
+	perfect_unsigned_hashmap(perfect_unsigned_hashmap&&) = default;
+	perfect_unsigned_hashmap& operator=(const perfect_unsigned_hashmap&)
+			= default;
+	perfect_unsigned_hashmap& operator=(perfect_unsigned_hashmap&&)
+			= default;
+
+	// Every internal buffer uses a copy of alloc, rebound to its type.
+	explicit perfect_unsigned_hashmap(const allocator_type& alloc)
+			: _pilots(alloc)
+			, _remap(alloc)
+			, _keys(alloc)
+			, _values(alloc) {
+	}
+
+	// builds the map, values[i] is mapped to keys[i]
+	// throws std::invalid_argument on duplicate keys
+	perfect_unsigned_hashmap(const key_type* keys, const value_type* values,
+			size_type count, const allocator_type& alloc = allocator_type())
+			: perfect_unsigned_hashmap(alloc) {
+		build(keys, count, [&](size_type i) -> const value_type& {
+			return values[i];
+		});
+	}
+
+	explicit perfect_unsigned_hashmap(
+			const std::initializer_list<std::pair<key_type, value_type>>& init,
+			const allocator_type& alloc = allocator_type())
+			: perfect_unsigned_hashmap(alloc) {
+		std::vector<key_type, rebind_alloc_t<key_type>> keys(alloc);
+		keys.reserve(init.size());
+		for (const std::pair<key_type, value_type>& kv : init) {
+			keys.push_back(kv.first);
+		}
+		const std::pair<key_type, value_type>* kvs = init.begin();
+		build(keys.data(), keys.size(),
+				[&](size_type i) -> const value_type& {
+					return kvs[i].second;
+				});
+	}
+
+	// returns the allocator associated with the container
+	allocator_type get_allocator() const noexcept {
+		return _values.get_allocator();
+	}
+
+
+	// Iterators
+
+	iterator begin() noexcept {
+		return _values.begin();
+	}
+	const_iterator begin() const noexcept {
+		return _values.begin();
+	}
+	const_iterator cbegin() const noexcept {
+		return _values.cbegin();
+	}
+
+	iterator end() noexcept {
+		return _values.end();
+	}
+	const_iterator end() const noexcept {
+		return _values.end();
+	}
+	const_iterator cend() const noexcept {
+		return _values.cend();
+	}
+
+
+	// Capacity
+
+	bool empty() const noexcept {
+		return _values.empty();
+	}
+	size_type size() const noexcept {
+		return _values.size();
+	}
+
+
+	// Modifiers
+
+	void swap(perfect_unsigned_hashmap& other) noexcept {
+		std::swap(_seed, other._seed);
+		std::swap(_table_size, other._table_size);
+		_pilots.swap(other._pilots);
+		_remap.swap(other._remap);
+		_keys.swap(other._keys);
+		_values.swap(other._values);
+	}
+
+
+	// Lookup
+
+	// direct access to the underlying vector
+	const value_type* data() const noexcept {
+		return _values.data();
+	}
+	value_type* data() noexcept {
+		return _values.data();
+	}
+
+	// the keys, in the same order as the values
+	const key_type* key_data() const noexcept {
+		return _keys.data();
+	}
+
+	// access specified element with bounds checking
+	const mapped_type& at(key_type k) const {
+		const_iterator it = find(k);
+		if (it == end()) {
+			throw std::out_of_range{
+				"perfect_unsigned_hashmap : value doesn't exist"
+			};
+		}
+		return *it;
+	}
+	mapped_type& at(key_type k) {
+		return const_cast<mapped_type&>(
+				static_cast<const perfect_unsigned_hashmap*>(this)->at(k));
+	}
+
+	// access specified element without any bounds checking
+	const mapped_type& at_unchecked(key_type k) const noexcept {
+		return _values[slot(k)];
+	}
+	mapped_type& at_unchecked(key_type k) noexcept {
+		return _values[slot(k)];
+	}
+
+	// returns the number of elements matching specific key
+	size_type count(key_type k) const noexcept {
+		return contains(k) ? 1 : 0;
+	}
+
+	// finds element with specific key
+	const_iterator find(key_type k) const noexcept {
+		return begin() + difference_type(find_idx(k));
+	}
+	iterator find(key_type k) noexcept {
+		return begin() + difference_type(find_idx(k));
+	}
+
+	// checks if the container contains element with specific key
+	bool contains(key_type k) const noexcept {
+		return find_idx(k) != size();
+	}
+
+
+	// Non-member functions
+
+	//	compares the values in the map
+	template <class K, class U, class A>
+	friend bool operator==(const perfect_unsigned_hashmap<K, U, A>& lhs,
+			const perfect_unsigned_hashmap<K, U, A>& rhs);
+
+private:
+	template <class U>
+	using rebind_alloc_t = typename std::allocator_traits<
+			allocator_type>::template rebind_alloc<U>;
+
+	// Average keys per bucket. Bigger buckets use less pilot memory but
+	// take longer to build, 4 is 25% slower to build than 3.
+	static constexpr size_type bucket_size() noexcept {
+		return 3;
+	}
+
+	// Pilot search gives up on a seed after this many tries per bucket.
+	// Pilots are 16 bits, the pilot table stays small enough to be cached.
+	static constexpr uint32_t max_pilot() noexcept {
+		return (std::numeric_limits<uint16_t>::max)();
+	}
+
+	// Free slots added to small tables, see build.
+	static constexpr size_type min_slack() noexcept {
+		return 4;
+	}
+
+	uint64_t key_hash(key_type k) const noexcept {
+		return detail::perfect_hash_mix(uint64_t(k) ^ _seed);
+	}
+
+	// Returns the slot of key k, before remapping.
+	// The multiply carries every bit of the pilot xored hash into the top
+	// bits. Xoring the pilot into the top bits alone moves every key of a
+	// bucket together, keys sharing their top bits were never separated.
+	size_type table_slot(uint64_t h, uint16_t pilot) const noexcept {
+		uint64_t ph = (h ^ detail::perfect_hash_pilot(pilot))
+				* 0x9e3779b97f4a7c15ull;
+		return detail::perfect_hash_reduce(
+				uint32_t(ph >> 32), uint32_t(_table_size));
+	}
+
+	// The only slot k can be in, if it is in the map.
+	size_type slot(key_type k) const noexcept {
+		assert(!_keys.empty());
+		uint64_t h = key_hash(k);
+		uint32_t bucket = detail::perfect_hash_bucket(
+				uint32_t(h), uint32_t(_pilots.size()));
+		size_type ret = table_slot(h, _pilots[bucket]);
+		if (ret >= _keys.size()) {
+			ret = _remap[ret - _keys.size()];
+		}
+		return ret;
+	}
+
+	// Returns the index of k, or size() if it isn't in the map.
+	size_type find_idx(key_type k) const noexcept {
+		if (_keys.empty()) {
+			return 0;
+		}
+
+		size_type ret = slot(k);
+		return _keys[ret] == k ? ret : _keys.size();
+	}
+
+	template <class GetValue>
+	void build(const key_type* keys, size_type count, GetValue get_value) {
+		if (count == 0) {
+			return;
+		}
+		if (count >= (std::numeric_limits<uint32_t>::max)() / 2) {
+			throw std::length_error{
+				"perfect_unsigned_hashmap : too many keys"
+			};
+		}
+
+		// The table is 1% bigger than the key count, and at least
+		// min_slack() slots bigger, which makes the last pilot searches
+		// much shorter. Keys landing past count are remapped to the free
+		// slots, so the values are still packed.
+		size_type num_buckets = (count + bucket_size() - 1) / bucket_size();
+		_table_size = count + (std::max)(count / 100, min_slack());
+		_pilots.assign(num_buckets, 0);
+
+		std::vector<uint32_t, rebind_alloc_t<uint32_t>> slots(
+				count, 0, _pilots.get_allocator());
+		for (uint64_t attempt = 0;; ++attempt) {
+			_seed = detail::perfect_hash_mix(attempt + 1);
+			if (find_pilots(keys, count, slots)) {
+				break;
+			}
+		}
+
+		// Remap the slots past count to the free slots.
+		std::vector<bool, rebind_alloc_t<bool>> taken(
+				count, false, _pilots.get_allocator());
+		for (uint32_t s : slots) {
+			if (s < count) {
+				taken[s] = true;
+			}
+		}
+		_remap.assign(_table_size - count, 0);
+		size_type free_slot = 0;
+		for (size_type i = 0; i < count; ++i) {
+			if (slots[i] < count) {
+				continue;
+			}
+			while (taken[free_slot]) {
+				++free_slot;
+			}
+			taken[free_slot] = true;
+			_remap[slots[i] - count] = uint32_t(free_slot);
+			slots[i] = uint32_t(free_slot);
+		}
+
+		// Place the keys and values in slot order.
+		std::vector<uint32_t, rebind_alloc_t<uint32_t>> key_of_slot(
+				count, 0, _pilots.get_allocator());
+		for (size_type i = 0; i < count; ++i) {
+			key_of_slot[slots[i]] = uint32_t(i);
+		}
+		_keys.reserve(count);
+		_values.reserve(count);
+		for (uint32_t i : key_of_slot) {
+			_keys.push_back(keys[i]);
+			_values.push_back(get_value(i));
+		}
+	}
+
+	// Finds a pilot for every bucket with the current seed, biggest buckets
+	// first. Returns false if a bucket has no pilot, the caller reseeds.
+	bool find_pilots(const key_type* keys, size_type count,
+			std::vector<uint32_t, rebind_alloc_t<uint32_t>>& slots) {
+		using u32_vec = std::vector<uint32_t, rebind_alloc_t<uint32_t>>;
+		using u64_vec = std::vector<uint64_t, rebind_alloc_t<uint64_t>>;
+		size_type num_buckets = _pilots.size();
+
+		u64_vec hashes(count, 0, _pilots.get_allocator());
+		u32_vec bucket_starts(num_buckets + 1, 0, _pilots.get_allocator());
+		for (size_type i = 0; i < count; ++i) {
+			hashes[i] = key_hash(keys[i]);
+			uint32_t b = detail::perfect_hash_bucket(
+					uint32_t(hashes[i]), uint32_t(num_buckets));
+			++bucket_starts[b + 1];
+		}
+		for (size_type b = 0; b < num_buckets; ++b) {
+			bucket_starts[b + 1] += bucket_starts[b];
+		}
+
+		// Key indexes sorted by bucket.
+		u32_vec bucket_keys(count, 0, _pilots.get_allocator());
+		{
+			u32_vec fill(bucket_starts.begin(), bucket_starts.end() - 1,
+					_pilots.get_allocator());
+			for (size_type i = 0; i < count; ++i) {
+				uint32_t b = detail::perfect_hash_bucket(
+						uint32_t(hashes[i]), uint32_t(num_buckets));
+				bucket_keys[fill[b]++] = uint32_t(i);
+			}
+		}
+
+		u32_vec order(num_buckets, 0, _pilots.get_allocator());
+		for (size_type b = 0; b < num_buckets; ++b) {
+			order[b] = uint32_t(b);
+		}
+		std::stable_sort(order.begin(), order.end(),
+				[&](uint32_t lhs, uint32_t rhs) {
+					return bucket_starts[lhs + 1] - bucket_starts[lhs]
+							> bucket_starts[rhs + 1] - bucket_starts[rhs];
+				});
+
+		std::vector<bool, rebind_alloc_t<bool>> taken(
+				_table_size, false, _pilots.get_allocator());
+		u32_vec candidates(_pilots.get_allocator());
+		for (uint32_t b : order) {
+			uint32_t first = bucket_starts[b];
+			uint32_t last = bucket_starts[b + 1];
+			if (first == last) {
+				break;
+			}
+
+			uint32_t pilot = 0;
+			for (; pilot < max_pilot(); ++pilot) {
+				candidates.clear();
+				bool ok = true;
+				for (uint32_t i = first; i < last && ok; ++i) {
+					uint32_t s = uint32_t(table_slot(
+							hashes[bucket_keys[i]], uint16_t(pilot)));
+					ok = !taken[s]
+							&& std::find(candidates.begin(), candidates.end(),
+									   s)
+									== candidates.end();
+					candidates.push_back(s);
+				}
+				if (ok) {
+					break;
+				}
+			}
+
+			if (pilot == max_pilot()) {
+				// Duplicate keys always share a bucket and a slot. Only
+				// checked on failure, it is rare and keeps builds fast.
+				for (uint32_t i = first; i < last; ++i) {
+					for (uint32_t j = i + 1; j < last; ++j) {
+						if (keys[bucket_keys[i]] == keys[bucket_keys[j]]) {
+							throw std::invalid_argument{
+								"perfect_unsigned_hashmap : duplicate keys"
+							};
+						}
+					}
+				}
+				return false;
+			}
+
+			_pilots[b] = uint16_t(pilot);
+			for (uint32_t i = first; i < last; ++i) {
+				taken[candidates[i - first]] = true;
+				slots[bucket_keys[i]] = candidates[i - first];
+			}
+		}
+		return true;
+	}
+
+	uint64_t _seed = 0;
+
+	// Slots before remapping, a bit more than size().
+	size_type _table_size = 0;
+
+	// One pilot per bucket.
+	std::vector<uint16_t, rebind_alloc_t<uint16_t>> _pilots;
+
+	// Slots past size() -> free slot.
+	std::vector<uint32_t, rebind_alloc_t<uint32_t>> _remap;
+
+	// Keys and values, in slot order.
+	std::vector<key_type, rebind_alloc_t<key_type>> _keys;
+	std::vector<value_type, allocator_type> _values;
+};
+
+template <class Key, class T, class A>
+inline bool operator==(const perfect_unsigned_hashmap<Key, T, A>& lhs,
+		const perfect_unsigned_hashmap<Key, T, A>& rhs) {
+	if (lhs.size() != rhs.size()) {
+		return false;
+	}
+
+	for (size_t i = 0; i < lhs.size(); ++i) {
+		auto it = rhs.find(lhs._keys[i]);
+		if (it == rhs.end() || *it != lhs._values[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+template <class Key, class T, class A>
+inline bool operator!=(const perfect_unsigned_hashmap<Key, T, A>& lhs,
+		const perfect_unsigned_hashmap<Key, T, A>& rhs) {
+	return !(lhs == rhs);
+}
+} // namespace fea
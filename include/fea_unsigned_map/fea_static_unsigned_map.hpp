@@ -0,0 +1,394 @@
+﻿/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Philippe Groarke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+/*
+A constant, constexpr unsigned_map, built from a std::array of key value
+pairs. Meant for small tables that never change, like enum -> handler
+tables.
+
+	constexpr std::array<std::pair<unsigned, int>, 3> kvs{ {
+		{ 1, 10 },
+		{ 5, 50 },
+		{ 900, 90 },
+	} };
+	constexpr fea::static_unsigned_map<unsigned, int, 3> map{ kvs };
+	static_assert(map.at(5) == 50, "");
+
+The lookup table holds 2 to 4 slots per key. When the keys fit in it, it is
+a direct index (key - min key). Otherwise, a perfect hash is searched when
+the map is built : keys are split in buckets, and every bucket gets a pilot
+that sends its keys to free slots. Either way, a lookup reads one slot.
+
+Built in a constexpr context, duplicate keys are a compilation error. At
+runtime, they throw std::invalid_argument. If no perfect hash is found, which
+shouldn't happen with distinct keys, std::runtime_error is thrown.
+*/
+
+namespace fea {
+namespace detail {
+// murmur3 finalizer
+constexpr uint64_t static_map_mix(uint64_t h) noexcept {
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+constexpr size_t static_map_pow2(size_t n) noexcept {
+	size_t ret = 1;
+	while (ret < n) {
+		ret *= 2;
+	}
+	return ret;
+}
+
+// n must be a power of 2
+constexpr size_t static_map_log2(size_t n) noexcept {
+	size_t ret = 0;
+	while (n > 1) {
+		n /= 2;
+		++ret;
+	}
+	return ret;
+}
+} // namespace detail
+
+template <class Key, class T, size_t N>
+struct static_unsigned_map {
+	static_assert(std::is_unsigned<Key>::value,
+			"static_unsigned_map : key must be unsigned integer");
+	static_assert(N != 0, "static_unsigned_map : map can't be empty");
+
+	using key_type = Key;
+	using mapped_type = T;
+	using value_type = std::pair<key_type, mapped_type>;
+	using size_type = std::size_t;
+	using difference_type = std::ptrdiff_t;
+
+	using const_reference = const value_type&;
+	using const_pointer = const value_type*;
+	using const_iterator = const value_type*;
+	using iterator = const_iterator;
+
+	// Position of a value in the values, N for an empty slot.
+	using pos_type = typename std::conditional<(N < 0xff), uint8_t,
+			typename std::conditional<(N < 0xffff), uint16_t,
+					uint32_t>::type>::type;
+
+
+	// Constructors, destructors and assignement
+
+	constexpr static_unsigned_map(const std::array<value_type, N>& kvs)
+			: _values(kvs) {
+		Key min_key = kvs[0].first;
+		Key max_key = kvs[0].first;
+		for (size_t i = 1; i < N; ++i) {
+			min_key = kvs[i].first < min_key ? kvs[i].first : min_key;
+			max_key = kvs[i].first > max_key ? kvs[i].first : max_key;
+		}
+
+		for (size_t i = 0; i < table_size; ++i) {
+			_slots[i] = pos_type(N);
+		}
+
+		_min_key = min_key;
+		_dense = uint64_t(max_key - min_key) < table_size;
+		if (_dense) {
+			build_dense(kvs);
+		} else {
+			build_hashed(kvs);
+		}
+	}
+
+
+	// Iterators
+
+	const_iterator begin() const noexcept {
+		return _values.data();
+	}
+	const_iterator cbegin() const noexcept {
+		return begin();
+	}
+	const_iterator end() const noexcept {
+		return _values.data() + N;
+	}
+	const_iterator cend() const noexcept {
+		return end();
+	}
+
+
+	// Capacity
+
+	constexpr bool empty() const noexcept {
+		return false;
+	}
+	constexpr size_type size() const noexcept {
+		return N;
+	}
+
+	// true when the lookup table is a direct index
+	constexpr bool is_dense() const noexcept {
+		return _dense;
+	}
+
+
+	// Lookup
+
+	// access specified element with bounds checking
+	constexpr const mapped_type& at(key_type k) const {
+		return contains(k) ? _values[find_idx(k)].second
+						   : throw std::out_of_range{
+								 "static_unsigned_map : value doesn't exist"
+							 };
+	}
+
+	// access specified element without any bounds checking
+	constexpr const mapped_type& at_unchecked(key_type k) const noexcept {
+		return _values[_slots[slot(k)]].second;
+	}
+
+	// returns the number of elements matching specific key
+	constexpr size_type count(key_type k) const noexcept {
+		return contains(k) ? 1 : 0;
+	}
+
+	// finds element with specific key
+	const_iterator find(key_type k) const noexcept {
+		return begin() + find_idx(k);
+	}
+
+	// checks if the container contains element with specific key
+	constexpr bool contains(key_type k) const noexcept {
+		return find_idx(k) != N;
+	}
+
+private:
+	// 2 to 4 slots per key.
+	static constexpr size_t table_size = detail::static_map_pow2(2 * N);
+
+	// 1 to 2 keys per bucket.
+	static constexpr size_t num_buckets
+			= table_size / 4 == 0 ? 1 : table_size / 4;
+
+	// A hashed bucket has no pilot after this many tries, the build is
+	// retried with another seed.
+	static constexpr uint32_t max_pilot = 0xffff;
+	static constexpr uint64_t max_seed = 16;
+
+	static constexpr size_t table_shift
+			= 64 - detail::static_map_log2(table_size);
+
+	constexpr uint64_t key_hash(key_type k) const noexcept {
+		return detail::static_map_mix(uint64_t(k) ^ _seed);
+	}
+	static constexpr size_t bucket(uint64_t h) noexcept {
+		return size_t(h) & (num_buckets - 1);
+	}
+
+	// The multiply carries every bit of the pilot xored hash into the top
+	// bits. Keys of a bucket are moved independently by every pilot.
+	static constexpr size_t hashed_slot(uint64_t h, uint16_t pilot) noexcept {
+		uint64_t ph = h ^ (uint64_t(pilot) * 0x9e3779b97f4a7c15ull);
+		return size_t((ph * 0xc4ceb9fe1a85ec53ull) >> table_shift);
+	}
+
+	// The only slot k can be in. Out of range dense keys return an empty
+	// slot.
+	constexpr size_t slot(key_type k) const noexcept {
+		if (_dense) {
+			uint64_t offset = uint64_t(key_type(k - _min_key));
+			return k >= _min_key && offset < table_size ? size_t(offset)
+														: _empty_slot;
+		}
+
+		uint64_t h = key_hash(k);
+		return hashed_slot(h, _pilots[bucket(h)]);
+	}
+
+	// Returns the position of k, or N if it isn't in the map.
+	constexpr size_t find_idx(key_type k) const noexcept {
+		size_t pos = _slots[slot(k)];
+		return pos != N && _values[pos].first == k ? pos : N;
+	}
+
+	constexpr void build_dense(const std::array<value_type, N>& kvs) {
+		for (size_t i = 0; i < N; ++i) {
+			size_t s = size_t(kvs[i].first - _min_key);
+			if (_slots[s] != N) {
+				throw std::invalid_argument{
+					"static_unsigned_map : duplicate keys"
+				};
+			}
+			_slots[s] = pos_type(i);
+		}
+
+		// The table has at least 2 slots per key, one is always free.
+		for (size_t i = 0; i < table_size; ++i) {
+			if (_slots[i] == N) {
+				_empty_slot = i;
+				break;
+			}
+		}
+	}
+
+	constexpr void build_hashed(const std::array<value_type, N>& kvs) {
+		for (uint64_t attempt = 0; attempt < max_seed; ++attempt) {
+			_seed = detail::static_map_mix(attempt + 1);
+			if (place_buckets(kvs)) {
+				return;
+			}
+
+			for (size_t i = 0; i < table_size; ++i) {
+				_slots[i] = pos_type(N);
+			}
+			for (size_t b = 0; b < num_buckets; ++b) {
+				_pilots[b] = 0;
+			}
+		}
+		throw std::runtime_error{
+			"static_unsigned_map : couldn't build perfect hash"
+		};
+	}
+
+	// Finds a pilot for every bucket with the current seed. Returns false
+	// if a bucket has no pilot.
+	constexpr bool place_buckets(const std::array<value_type, N>& kvs) {
+		// Key positions sorted by bucket.
+		size_t bucket_starts[num_buckets + 1] = {};
+		for (size_t i = 0; i < N; ++i) {
+			++bucket_starts[bucket(key_hash(kvs[i].first)) + 1];
+		}
+		size_t max_size = 0;
+		for (size_t b = 0; b < num_buckets; ++b) {
+			size_t bucket_size = bucket_starts[b + 1];
+			max_size = bucket_size > max_size ? bucket_size : max_size;
+			bucket_starts[b + 1] += bucket_starts[b];
+		}
+
+		size_t bucket_keys[N] = {};
+		size_t fill[num_buckets] = {};
+		for (size_t i = 0; i < N; ++i) {
+			size_t b = bucket(key_hash(kvs[i].first));
+			bucket_keys[bucket_starts[b] + fill[b]++] = i;
+		}
+
+		// Biggest buckets first, while the table is emptier.
+		size_t candidates[N] = {};
+		for (size_t bucket_size = max_size; bucket_size > 0; --bucket_size) {
+			for (size_t b = 0; b < num_buckets; ++b) {
+				size_t first = bucket_starts[b];
+				size_t last = bucket_starts[b + 1];
+				if (last - first != bucket_size) {
+					continue;
+				}
+
+				// Duplicates share a bucket and would never be placed.
+				for (size_t i = first; i < last; ++i) {
+					for (size_t j = i + 1; j < last; ++j) {
+						if (kvs[bucket_keys[i]].first
+								== kvs[bucket_keys[j]].first) {
+							throw std::invalid_argument{
+								"static_unsigned_map : duplicate keys"
+							};
+						}
+					}
+				}
+
+				uint32_t pilot = 0;
+				for (; pilot < max_pilot; ++pilot) {
+					if (try_pilot(bucket_keys, first, last, uint16_t(pilot),
+								candidates)) {
+						break;
+					}
+				}
+				if (pilot == max_pilot) {
+					return false;
+				}
+
+				_pilots[b] = uint16_t(pilot);
+				for (size_t i = first; i < last; ++i) {
+					_slots[candidates[i - first]] = pos_type(bucket_keys[i]);
+				}
+			}
+		}
+		return true;
+	}
+
+	// Checks the pilot sends the bucket's keys to distinct free slots.
+	constexpr bool try_pilot(const size_t (&bucket_keys)[N], size_t first,
+			size_t last, uint16_t pilot, size_t (&candidates)[N]) const {
+		for (size_t i = first; i < last; ++i) {
+			size_t s = hashed_slot(
+					key_hash(_values[bucket_keys[i]].first), pilot);
+			if (_slots[s] != N) {
+				return false;
+			}
+			for (size_t j = 0; j < i - first; ++j) {
+				if (candidates[j] == s) {
+					return false;
+				}
+			}
+			candidates[i - first] = s;
+		}
+		return true;
+	}
+
+	std::array<value_type, N> _values;
+
+	// slot -> position in _values
+	pos_type _slots[table_size] = {};
+	uint16_t _pilots[num_buckets] = {};
+
+	uint64_t _seed = 0;
+	Key _min_key = 0;
+	bool _dense = false;
+
+	// A slot that is always empty, dense lookups of out of range keys use
+	// it.
+	size_t _empty_slot = 0;
+};
+
+template <class Key, class T, size_t N>
+constexpr static_unsigned_map<Key, T, N> make_static_unsigned_map(
+		const std::array<std::pair<Key, T>, N>& kvs) {
+	return static_unsigned_map<Key, T, N>{ kvs };
+}
+} // namespace fea
@@ -30,17 +30,37 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #pragma once
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
 #include <functional>
 #include <initializer_list>
 #include <iterator>
 #include <limits>
+#include <memory>
 #include <stdexcept>
+#include <thread>
 #include <tuple>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
+#if __cplusplus >= 201703L
+#include <memory_resource>
+#endif
+
+#if defined(_MSC_VER)
+#include <xmmintrin.h>
+#endif
+
+#include "fea_chunked_vector.hpp"
+#include "fea_file.hpp"
+#include "fea_unsigned_node.hpp"
+
 // Notes :
 // - The container doesn't use const key_type& in apis, it uses key_type. The
 // value of a key will always be smaller or equally sized to a reference.
@@ -69,12 +89,740 @@ inline constexpr std::conditional_t<!std::is_move_constructible<T>::value
 maybe_move(T& arg) noexcept {
 	return std::move(arg);
 }
+
+// hints the cache line of ptr will be read soon
+inline void prefetch(const void* ptr) noexcept {
+#if defined(_MSC_VER)
+	_mm_prefetch(static_cast<const char*>(ptr), _MM_HINT_T0);
+#else
+	__builtin_prefetch(ptr);
+#endif
+}
+
+// Splits [0, count) in contiguous chunks and calls func(chunk_idx, begin, end)
+// on each one, using up to hardware_concurrency threads. The calling thread
+// processes the first chunk. Exceptions thrown by func are rethrown after all
+// threads have joined.
+template <class Func>
+void parallel_chunks(size_t count, Func&& func) {
+	// Don't bother spinning up threads for tiny workloads.
+	constexpr size_t min_chunk_size = 16'384;
+
+	size_t num_chunks = (std::max)(
+			size_t(std::thread::hardware_concurrency()), size_t(1));
+	num_chunks = (std::min)(num_chunks, count / min_chunk_size + 1);
+
+	if (num_chunks == 1) {
+		func(size_t(0), size_t(0), count);
+		return;
+	}
+
+	size_t chunk_size = count / num_chunks;
+	std::vector<std::exception_ptr> errors(num_chunks);
+	std::vector<std::thread> threads;
+	threads.reserve(num_chunks - 1);
+
+	auto run = [&](size_t chunk_idx) {
+		size_t b = chunk_idx * chunk_size;
+		size_t e = chunk_idx == num_chunks - 1 ? count : b + chunk_size;
+		try {
+			func(chunk_idx, b, e);
+		} catch (...) {
+			errors[chunk_idx] = std::current_exception();
+		}
+	};
+
+	try {
+		for (size_t i = 1; i < num_chunks; ++i) {
+			threads.emplace_back(run, i);
+		}
+	} catch (...) {
+		for (std::thread& t : threads) {
+			t.join();
+		}
+		throw;
+	}
+
+	run(0);
+	for (std::thread& t : threads) {
+		t.join();
+	}
+
+	for (const std::exception_ptr& e : errors) {
+		if (e) {
+			std::rethrow_exception(e);
+		}
+	}
+}
 } // namespace detail
 
+// Index storage modes, selects how unsigned_map stores its key -> position
+// directory.
+
+// Default mode. Erased keys reset their slot to a sentinel, clear() empties the
+// directory.
+struct sentinel_indexes {};
+
+// Slots are stamped with an epoch. clear() only bumps the epoch, it keeps the
+// directory allocation and contents intact. Refilling a cleared map doesn't
+// rewrite the slots. Uses more memory than sentinel_indexes.
+struct epoch_indexes {};
+
+// Key / value record written by unsigned_map::save and returned by
+// unsigned_map_view. Unlike std::pair, it is trivially copyable.
 template <class Key, class T>
+struct unsigned_map_record {
+	Key first;
+	T second;
+};
+
+namespace detail {
+template <class Alloc, class T>
+using rebind_alloc_t =
+		typename std::allocator_traits<Alloc>::template rebind_alloc<T>;
+
+// Binary layout written by unsigned_map::save and read by
+// unsigned_map_view. Uses native endianness and type sizes, mismatching
+// files are rejected when opened.
+//
+// [header][pad][indexes : num_indexes keys][pad][values : num_values records]
+//
+// The indexes hold the value position of every key, or the max key when the
+// key isn't present. Values are unsigned_map_record, with zeroed padding.
+// Sections start on unsigned_map_file_align boundaries.
+struct unsigned_map_file_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t endian_check;
+	uint64_t key_size;
+	uint64_t value_size;
+	uint64_t value_align;
+	uint64_t num_indexes;
+	uint64_t num_values;
+	uint64_t indexes_offset;
+	uint64_t values_offset;
+	uint64_t file_size;
+};
+
+constexpr char unsigned_map_file_magic[8]
+		= { 'f', 'e', 'a', 'u', 'm', 'a', 'p', '\0' };
+constexpr uint32_t unsigned_map_file_version = 1;
+constexpr uint32_t unsigned_map_file_endian_check = 0x01020304;
+constexpr uint64_t unsigned_map_file_align = 64;
+
+inline constexpr uint64_t unsigned_map_file_align_up(uint64_t offset) {
+	return (offset + unsigned_map_file_align - 1)
+			& ~(unsigned_map_file_align - 1);
+}
+
+template <class Key, class Value>
+unsigned_map_file_header make_unsigned_map_file_header(
+		size_t num_indexes, size_t num_values) noexcept {
+	unsigned_map_file_header ret{};
+	std::memcpy(ret.magic, unsigned_map_file_magic, sizeof(ret.magic));
+	ret.version = unsigned_map_file_version;
+	ret.endian_check = unsigned_map_file_endian_check;
+	ret.key_size = sizeof(Key);
+	ret.value_size = sizeof(Value);
+	ret.value_align = alignof(Value);
+	ret.num_indexes = num_indexes;
+	ret.num_values = num_values;
+	ret.indexes_offset
+			= unsigned_map_file_align_up(sizeof(unsigned_map_file_header));
+	ret.values_offset = unsigned_map_file_align_up(
+			ret.indexes_offset + num_indexes * sizeof(Key));
+	ret.file_size = ret.values_offset + num_values * sizeof(Value);
+	return ret;
+}
+
+inline void unsigned_map_file_write(
+		std::FILE* file, const void* data, size_t bytes) {
+	if (bytes != 0 && std::fwrite(data, 1, bytes, file) != bytes) {
+		throw std::runtime_error{ "unsigned_map : couldn't write file" };
+	}
+}
+
+// writes zeros up to offset
+inline void unsigned_map_file_pad(
+		std::FILE* file, uint64_t& pos, uint64_t offset) {
+	const char zeros[unsigned_map_file_align] = {};
+	unsigned_map_file_write(file, zeros, size_t(offset - pos));
+	pos = offset;
+}
+
+// Keys of 16 bits or less index a fixed table, which covers the whole key
+// space.
+template <class Key>
+struct unsigned_map_fixed_indexes
+		: std::integral_constant<bool, (sizeof(Key) <= 2)> {};
+
+template <class Key, class Pos, class Mode, class Alloc,
+		bool Fixed = unsigned_map_fixed_indexes<Key>::value>
+struct unsigned_map_indexes;
+
+template <class Pos>
+struct unsigned_map_sentinel_slot {
+	Pos pos = (std::numeric_limits<Pos>::max)();
+};
+
+template <class Pos>
+constexpr Pos unsigned_map_slot_pos(Pos pos) noexcept {
+	return pos;
+}
+template <class Pos>
+constexpr Pos unsigned_map_slot_pos(
+		unsigned_map_sentinel_slot<Pos> slot) noexcept {
+	return slot.pos;
+}
+
+// Returns the first slot in [first, last) that isn't the sentinel, or last.
+// Empty runs are skipped a cache line at a time, the and-reduction
+// vectorizes. Slots before the first boundary are checked one by one, so
+// walking a dense table doesn't pay for blocks.
+template <class Pos, class Slot>
+size_t unsigned_map_next_slot(
+		const Slot* slots, size_t first, size_t last) noexcept {
+	constexpr Pos sentinel = (std::numeric_limits<Pos>::max)();
+	constexpr size_t block = 64 / sizeof(Slot);
+
+	size_t k = first;
+	size_t boundary = (std::min)(last, (first + block - 1) / block * block);
+	for (; k < boundary; ++k) {
+		if (unsigned_map_slot_pos(slots[k]) != sentinel) {
+			return k;
+		}
+	}
+
+	for (; k + block <= last; k += block) {
+		Pos acc = sentinel;
+		for (size_t i = 0; i < block; ++i) {
+			acc &= unsigned_map_slot_pos(slots[k + i]);
+		}
+		if (acc != sentinel) {
+			break;
+		}
+	}
+
+	for (; k < last; ++k) {
+		if (unsigned_map_slot_pos(slots[k]) != sentinel) {
+			return k;
+		}
+	}
+	return last;
+}
+
+template <class Key, class Pos, class Alloc>
+struct unsigned_map_indexes<Key, Pos, sentinel_indexes, Alloc, false> {
+	unsigned_map_indexes() = default;
+	explicit unsigned_map_indexes(const Alloc& alloc)
+			: _indexes(alloc) {
+	}
+	unsigned_map_indexes(
+			const unsigned_map_indexes& other, const Alloc& alloc)
+			: _indexes(other._indexes, alloc) {
+	}
+	unsigned_map_indexes(unsigned_map_indexes&& other, const Alloc& alloc)
+			: _indexes(std::move(other._indexes), alloc) {
+	}
+
+	size_t size() const noexcept {
+		return _indexes.size();
+	}
+	size_t capacity() const noexcept {
+		return _indexes.capacity();
+	}
+	size_t memory_used() const noexcept {
+		return _indexes.size() * sizeof(Pos);
+	}
+	size_t memory_reserved() const noexcept {
+		return _indexes.capacity() * sizeof(Pos);
+	}
+
+	bool contains(Key k) const noexcept {
+		return size_t(k) < _indexes.size() && contains_unchecked(k);
+	}
+	bool contains_unchecked(Key k) const noexcept {
+		return _indexes[k] != sentinel();
+	}
+	Pos at_unchecked(Key k) const noexcept {
+		return _indexes[k];
+	}
+	// returns the first key in [first, last) that has a position, or last
+	size_t next(size_t first, size_t last) const noexcept {
+		return unsigned_map_next_slot<Pos>(_indexes.data(), first, last);
+	}
+
+	void assign(Key k, Pos pos) noexcept {
+		_indexes[k] = pos;
+	}
+	void reset(Key k) noexcept {
+		_indexes[k] = sentinel();
+	}
+
+	void resize(size_t new_size) {
+		_indexes.resize(new_size, sentinel());
+	}
+	void reserve(size_t new_cap) {
+		_indexes.reserve(new_cap);
+	}
+	void shrink_to_fit() {
+		_indexes.shrink_to_fit();
+	}
+	void clear() noexcept {
+		_indexes.clear();
+	}
+	void swap(unsigned_map_indexes& other) noexcept {
+		_indexes.swap(other._indexes);
+	}
+
+private:
+	static constexpr Pos sentinel() noexcept {
+		return (std::numeric_limits<Pos>::max)();
+	}
+
+	std::vector<Pos, rebind_alloc_t<Alloc, Pos>> _indexes;
+};
+
+template <class Key, class Pos, class Alloc>
+struct unsigned_map_indexes<Key, Pos, epoch_indexes, Alloc, false> {
+	unsigned_map_indexes() = default;
+	explicit unsigned_map_indexes(const Alloc& alloc)
+			: _slots(alloc) {
+	}
+	unsigned_map_indexes(
+			const unsigned_map_indexes& other, const Alloc& alloc)
+			: _slots(other._slots, alloc)
+			, _epoch(other._epoch) {
+	}
+	unsigned_map_indexes(unsigned_map_indexes&& other, const Alloc& alloc)
+			: _slots(std::move(other._slots), alloc)
+			, _epoch(other._epoch) {
+	}
+
+	size_t size() const noexcept {
+		return _slots.size();
+	}
+	size_t capacity() const noexcept {
+		return _slots.capacity();
+	}
+	size_t memory_used() const noexcept {
+		return _slots.size() * sizeof(slot);
+	}
+	size_t memory_reserved() const noexcept {
+		return _slots.capacity() * sizeof(slot);
+	}
+
+	bool contains(Key k) const noexcept {
+		return size_t(k) < _slots.size() && contains_unchecked(k);
+	}
+	bool contains_unchecked(Key k) const noexcept {
+		return _slots[k].epoch == _epoch;
+	}
+	Pos at_unchecked(Key k) const noexcept {
+		return _slots[k].pos;
+	}
+	// returns the first key in [first, last) that has a position, or last
+	size_t next(size_t first, size_t last) const noexcept {
+		for (; first < last; ++first) {
+			if (_slots[first].epoch == _epoch) {
+				return first;
+			}
+		}
+		return last;
+	}
+
+	void assign(Key k, Pos pos) noexcept {
+		_slots[k] = { pos, _epoch };
+	}
+	void reset(Key k) noexcept {
+		_slots[k].epoch = 0;
+	}
+
+	void resize(size_t new_size) {
+		_slots.resize(new_size);
+	}
+	void reserve(size_t new_cap) {
+		_slots.reserve(new_cap);
+	}
+	void shrink_to_fit() {
+		_slots.shrink_to_fit();
+	}
+	void clear() noexcept {
+		if (++_epoch != 0) {
+			return;
+		}
+
+		// Wrapped around, stale stamps could become valid again.
+		for (slot& s : _slots) {
+			s.epoch = 0;
+		}
+		_epoch = 1;
+	}
+	void swap(unsigned_map_indexes& other) noexcept {
+		_slots.swap(other._slots);
+		std::swap(_epoch, other._epoch);
+	}
+
+private:
+	struct slot {
+		Pos pos = 0;
+
+		// 0 is never a valid epoch.
+		uint32_t epoch = 0;
+	};
+
+	std::vector<slot, rebind_alloc_t<Alloc, slot>> _slots;
+	uint32_t _epoch = 1;
+};
+
+// A table of every possible key, allocated on the first insertion. Lookups
+// never check bounds, empty maps point to a shared table of empty slots
+// which is never written to. A value initialized Slot is empty.
+template <class Key, class Slot, class Alloc>
+struct unsigned_map_fixed_table {
+	using table_type = std::array<Slot,
+			size_t((std::numeric_limits<Key>::max)()) + 1u>;
+
+	unsigned_map_fixed_table() = default;
+	explicit unsigned_map_fixed_table(const Alloc& alloc)
+			: _table(alloc) {
+	}
+	unsigned_map_fixed_table(const unsigned_map_fixed_table& other)
+			: _table(other._table)
+			, _size(other._size) {
+		refresh();
+	}
+	unsigned_map_fixed_table(
+			const unsigned_map_fixed_table& other, const Alloc& alloc)
+			: _table(other._table, alloc)
+			, _size(other._size) {
+		refresh();
+	}
+	unsigned_map_fixed_table(unsigned_map_fixed_table&& other) noexcept
+			: _table(std::move(other._table))
+			, _size(other._size) {
+		refresh();
+		other.refresh();
+	}
+	unsigned_map_fixed_table(
+			unsigned_map_fixed_table&& other, const Alloc& alloc)
+			: _table(std::move(other._table), alloc)
+			, _size(other._size) {
+		refresh();
+		other.refresh();
+	}
+	unsigned_map_fixed_table& operator=(
+			const unsigned_map_fixed_table& other) {
+		if (this != &other) {
+			_table = other._table;
+			_size = other._size;
+			refresh();
+		}
+		return *this;
+	}
+	unsigned_map_fixed_table& operator=(unsigned_map_fixed_table&& other) {
+		if (this != &other) {
+			_table = std::move(other._table);
+			_size = other._size;
+			refresh();
+			other.refresh();
+		}
+		return *this;
+	}
+
+	// the highest key ever assigned + 1
+	size_t size() const noexcept {
+		return _size;
+	}
+	size_t capacity() const noexcept {
+		return _table.empty() ? 0 : std::tuple_size<table_type>::value;
+	}
+	size_t memory_used() const noexcept {
+		return _size * sizeof(Slot);
+	}
+	size_t memory_reserved() const noexcept {
+		return _table.size() * sizeof(table_type);
+	}
+
+	void resize(size_t new_size) {
+		allocate();
+		_size = (std::max)(_size, new_size);
+	}
+	void reserve(size_t new_cap) {
+		if (new_cap != 0) {
+			allocate();
+		}
+	}
+	void shrink_to_fit() {
+		if (_size == 0) {
+			_table.clear();
+			_table.shrink_to_fit();
+			refresh();
+		}
+	}
+	void swap(unsigned_map_fixed_table& other) noexcept {
+		_table.swap(other._table);
+		std::swap(_size, other._size);
+		refresh();
+		other.refresh();
+	}
+
+private:
+	static table_type& empty_table() noexcept {
+		static table_type ret{};
+		return ret;
+	}
+
+	void allocate() {
+		if (_table.empty()) {
+			_table.resize(1);
+			refresh();
+		}
+	}
+
+	// Points _slots to the current table, after it changed.
+	void refresh() noexcept {
+		if (_table.empty()) {
+			_slots = empty_table().data();
+			_size = 0;
+		} else {
+			_slots = _table.front().data();
+		}
+	}
+
+	std::vector<table_type, rebind_alloc_t<Alloc, table_type>> _table;
+
+protected:
+	Slot* _slots = empty_table().data();
+	size_t _size = 0;
+};
+
+template <class Key, class Pos, class Alloc>
+struct unsigned_map_indexes<Key, Pos, sentinel_indexes, Alloc, true>
+		: unsigned_map_fixed_table<Key, unsigned_map_sentinel_slot<Pos>,
+				  Alloc> {
+	using base = unsigned_map_fixed_table<Key, unsigned_map_sentinel_slot<Pos>,
+			Alloc>;
+
+	unsigned_map_indexes() = default;
+	explicit unsigned_map_indexes(const Alloc& alloc)
+			: base(alloc) {
+	}
+	unsigned_map_indexes(
+			const unsigned_map_indexes& other, const Alloc& alloc)
+			: base(other, alloc) {
+	}
+	unsigned_map_indexes(unsigned_map_indexes&& other, const Alloc& alloc)
+			: base(std::move(other), alloc) {
+	}
+
+	bool contains(Key k) const noexcept {
+		return contains_unchecked(k);
+	}
+	bool contains_unchecked(Key k) const noexcept {
+		return this->_slots[k].pos != sentinel();
+	}
+	Pos at_unchecked(Key k) const noexcept {
+		return this->_slots[k].pos;
+	}
+	// returns the first key in [first, last) that has a position, or last
+	size_t next(size_t first, size_t last) const noexcept {
+		return unsigned_map_next_slot<Pos>(this->_slots, first, last);
+	}
+
+	void assign(Key k, Pos pos) noexcept {
+		this->_slots[k].pos = pos;
+	}
+	void reset(Key k) noexcept {
+		this->_slots[k].pos = sentinel();
+	}
+
+	void clear() noexcept {
+		for (size_t i = 0; i < this->_size; ++i) {
+			this->_slots[i].pos = sentinel();
+		}
+		this->_size = 0;
+	}
+
+private:
+	static constexpr Pos sentinel() noexcept {
+		return (std::numeric_limits<Pos>::max)();
+	}
+};
+
+template <class Pos>
+struct unsigned_map_epoch_slot {
+	Pos pos = 0;
+
+	// 0 is never a valid epoch.
+	uint32_t epoch = 0;
+};
+
+template <class Key, class Pos, class Alloc>
+struct unsigned_map_indexes<Key, Pos, epoch_indexes, Alloc, true>
+		: unsigned_map_fixed_table<Key, unsigned_map_epoch_slot<Pos>, Alloc> {
+	using base = unsigned_map_fixed_table<Key, unsigned_map_epoch_slot<Pos>,
+			Alloc>;
+
+	unsigned_map_indexes() = default;
+	explicit unsigned_map_indexes(const Alloc& alloc)
+			: base(alloc) {
+	}
+	unsigned_map_indexes(
+			const unsigned_map_indexes& other, const Alloc& alloc)
+			: base(other, alloc)
+			, _epoch(other._epoch) {
+	}
+	unsigned_map_indexes(unsigned_map_indexes&& other, const Alloc& alloc)
+			: base(std::move(other), alloc)
+			, _epoch(other._epoch) {
+	}
+
+	bool contains(Key k) const noexcept {
+		return contains_unchecked(k);
+	}
+	bool contains_unchecked(Key k) const noexcept {
+		return this->_slots[k].epoch == _epoch;
+	}
+	Pos at_unchecked(Key k) const noexcept {
+		return this->_slots[k].pos;
+	}
+	// returns the first key in [first, last) that has a position, or last
+	size_t next(size_t first, size_t last) const noexcept {
+		for (; first < last; ++first) {
+			if (this->_slots[first].epoch == _epoch) {
+				return first;
+			}
+		}
+		return last;
+	}
+
+	void assign(Key k, Pos pos) noexcept {
+		this->_slots[k] = { pos, _epoch };
+	}
+	void reset(Key k) noexcept {
+		this->_slots[k].epoch = 0;
+	}
+
+	void clear() noexcept {
+		if (++_epoch != 0) {
+			return;
+		}
+
+		// Wrapped around, stale stamps could become valid again.
+		for (size_t i = 0; i < this->_size; ++i) {
+			this->_slots[i].epoch = 0;
+		}
+		_epoch = 1;
+	}
+	void swap(unsigned_map_indexes& other) noexcept {
+		base::swap(other);
+		std::swap(_epoch, other._epoch);
+	}
+
+private:
+	uint32_t _epoch = 1;
+};
+
+// Iterates an unsigned_map in ascending key order, by walking its indexes.
+// Map is const for const iterators.
+template <class Map, class Value>
+struct unsigned_map_ordered_iterator {
+	using iterator_category = std::forward_iterator_tag;
+	using value_type = typename std::remove_const<Value>::type;
+	using difference_type = std::ptrdiff_t;
+	using pointer = Value*;
+	using reference = Value&;
+
+	unsigned_map_ordered_iterator() noexcept = default;
+	unsigned_map_ordered_iterator(Map* map, size_t key, size_t last) noexcept
+			: _map(map)
+			, _key(key)
+			, _last(last) {
+	}
+
+	// converts an iterator to a const_iterator
+	template <class M, class V,
+			class = typename std::enable_if<
+					std::is_convertible<M*, Map*>::value>::type>
+	unsigned_map_ordered_iterator(
+			const unsigned_map_ordered_iterator<M, V>& other) noexcept
+			: _map(other._map)
+			, _key(other._key)
+			, _last(other._last) {
+	}
+
+	reference operator*() const noexcept {
+		assert(_key < _last);
+		return _map->ordered_at(_key);
+	}
+	pointer operator->() const noexcept {
+		return &**this;
+	}
+
+	unsigned_map_ordered_iterator& operator++() noexcept {
+		assert(_key < _last);
+		_key = _map->ordered_next(_key + 1, _last);
+		return *this;
+	}
+	unsigned_map_ordered_iterator operator++(int) noexcept {
+		unsigned_map_ordered_iterator ret = *this;
+		++*this;
+		return ret;
+	}
+
+	template <class M, class V>
+	bool operator==(
+			const unsigned_map_ordered_iterator<M, V>& rhs) const noexcept {
+		assert(_map == rhs._map);
+		return _key == rhs._key;
+	}
+	template <class M, class V>
+	bool operator!=(
+			const unsigned_map_ordered_iterator<M, V>& rhs) const noexcept {
+		return !(*this == rhs);
+	}
+
+private:
+	template <class, class>
+	friend struct unsigned_map_ordered_iterator;
+
+	Map* _map = nullptr;
+	size_t _key = 0;
+	size_t _last = 0;
+};
+
+// A begin / end pair, for range-based for loops.
+template <class It>
+struct unsigned_map_range {
+	It first;
+	It last;
+
+	It begin() const noexcept {
+		return first;
+	}
+	It end() const noexcept {
+		return last;
+	}
+};
+} // namespace detail
+
+// Tag used to opt-in multi-threaded bulk operations.
+struct multithreaded_t {
+	explicit multithreaded_t() = default;
+};
+constexpr multithreaded_t multithreaded{};
+
+template <class Key, class T, class IndexStorage = sentinel_indexes,
+		class Alloc = std::allocator<std::pair<Key, T>>,
+		class ValueStorage = contiguous_values>
 struct unsigned_map {
 	static_assert(std::is_unsigned<Key>::value,
 			"unsigned_map : key must be unsigned integer");
+	static_assert(
+			std::is_same<typename std::allocator_traits<Alloc>::value_type,
+					std::pair<Key, T>>::value,
+			"unsigned_map : allocator value_type must be std::pair<Key, T>");
 
 	using key_type = Key;
 	using mapped_type = T;
@@ -83,7 +831,7 @@ struct unsigned_map {
 	using pos_type = Key;
 	using difference_type = std::ptrdiff_t;
 
-	using allocator_type = typename std::vector<value_type>::allocator_type;
+	using allocator_type = Alloc;
 
 	using reference = value_type&;
 	using const_reference = const value_type&;
@@ -91,15 +839,65 @@ struct unsigned_map {
 	using const_pointer =
 			typename std::allocator_traits<allocator_type>::const_pointer;
 
-	using iterator = typename std::vector<value_type>::iterator;
-	using const_iterator = typename std::vector<value_type>::const_iterator;
+	using values_container = typename ValueStorage::template container<
+			value_type, allocator_type>;
+
+	using iterator = typename values_container::iterator;
+	using const_iterator = typename values_container::const_iterator;
+	using ordered_iterator
+			= detail::unsigned_map_ordered_iterator<unsigned_map, value_type>;
+	using const_ordered_iterator
+			= detail::unsigned_map_ordered_iterator<const unsigned_map,
+					const value_type>;
 	using local_iterator = iterator;
 	using const_local_iterator = const_iterator;
 
+	// bytes used and reserved by an internal buffer
+	struct buffer_usage {
+		size_type used = 0;
+		size_type reserved = 0;
+	};
+
+	// heap memory of the container, per internal buffer
+	struct memory_usage_type {
+		buffer_usage value_indexes;
+		buffer_usage values;
+		size_type size = 0;
+
+		// returns bytes used by all buffers
+		size_type used() const noexcept {
+			return value_indexes.used + values.used;
+		}
+		// returns bytes reserved by all buffers
+		size_type reserved() const noexcept {
+			return value_indexes.reserved + values.reserved;
+		}
+		// returns used bytes per element, 0 if empty
+		double used_per_element() const noexcept {
+			return size == 0 ? 0.0 : double(used()) / double(size);
+		}
+		// returns reserved bytes per element, 0 if empty
+		double reserved_per_element() const noexcept {
+			return size == 0 ? 0.0 : double(reserved()) / double(size);
+		}
+	};
+
+	// owns an extracted element, see fea::unsigned_node
+	using node_type = unsigned_node<key_type, mapped_type>;
+
+	// progress of an incremental compact
+	struct compact_cursor {
+	private:
+		friend struct unsigned_map;
+
+		// Next key to place and where.
+		size_t _key = 0;
+		size_type _pos = 0;
+	};
+
 	// Don't make sense
 	// using hasher = std::hash<key_type>;
 	// using key_equal = std::equal_to<key_type>;
-	// using node_type;
 	// using insert_return_type;
 
 
@@ -111,29 +909,58 @@ struct unsigned_map {
 	unsigned_map& operator=(const unsigned_map&) = default;
 	unsigned_map& operator=(unsigned_map&&) = default;
 
-	explicit unsigned_map(size_t reserve_count) {
+	// Every internal buffer uses a copy of alloc, rebound to its type.
+	explicit unsigned_map(const allocator_type& alloc)
+			: _value_indexes(alloc)
+			, _values(alloc) {
+	}
+	unsigned_map(const unsigned_map& other, const allocator_type& alloc)
+			: _value_indexes(other._value_indexes, alloc)
+			, _values(other._values, alloc) {
+	}
+	unsigned_map(unsigned_map&& other, const allocator_type& alloc)
+			: _value_indexes(std::move(other._value_indexes), alloc)
+			, _values(std::move(other._values), alloc) {
+	}
+
+	explicit unsigned_map(size_t reserve_count,
+			const allocator_type& alloc = allocator_type())
+			: unsigned_map(alloc) {
 		_value_indexes.reserve(reserve_count);
 		_values.reserve(reserve_count);
 	}
-	explicit unsigned_map(
-			size_t key_reserve_count, size_t value_reserve_count) {
+	explicit unsigned_map(size_t key_reserve_count, size_t value_reserve_count,
+			const allocator_type& alloc = allocator_type())
+			: unsigned_map(alloc) {
 		_value_indexes.reserve(key_reserve_count);
 		_values.reserve(value_reserve_count);
 	}
 
 	template <class InputIt>
-	unsigned_map(InputIt first, InputIt last) {
-		// TODO : benchmark and potentially optimize
-		for (auto it = first; it != last; ++it) {
-			insert(*it);
-		}
+	unsigned_map(InputIt first, InputIt last,
+			const allocator_type& alloc = allocator_type())
+			: unsigned_map(alloc) {
+		insert(first, last);
 	}
 
-	explicit unsigned_map(std::initializer_list<value_type> init) {
-		// TODO : benchmark and potentially optimize
-		for (const value_type& kv : init) {
-			insert(kv);
-		}
+	// Builds the map using multiple threads. Only worth it for very large
+	// ranges.
+	template <class RandomIt>
+	unsigned_map(multithreaded_t, RandomIt first, RandomIt last,
+			const allocator_type& alloc = allocator_type())
+			: unsigned_map(alloc) {
+		insert(multithreaded, first, last);
+	}
+
+	explicit unsigned_map(std::initializer_list<value_type> init,
+			const allocator_type& alloc = allocator_type())
+			: unsigned_map(alloc) {
+		insert(init.begin(), init.end());
+	}
+
+	// returns the allocator associated with the container
+	allocator_type get_allocator() const noexcept {
+		return _values.get_allocator();
 	}
 
 
@@ -161,6 +988,59 @@ struct unsigned_map {
 		return _values.cend();
 	}
 
+	// returns an iterator to the smallest key
+	// ordered iterators walk the indexes, which are as big as the biggest key
+	ordered_iterator ordered_begin() noexcept {
+		return ordered_iterator{ this, ordered_next(0, _value_indexes.size()),
+			_value_indexes.size() };
+	}
+	const_ordered_iterator ordered_begin() const noexcept {
+		return const_ordered_iterator{ this,
+			ordered_next(0, _value_indexes.size()), _value_indexes.size() };
+	}
+	const_ordered_iterator ordered_cbegin() const noexcept {
+		return ordered_begin();
+	}
+
+	// returns an iterator past the biggest key
+	ordered_iterator ordered_end() noexcept {
+		return ordered_iterator{ this, _value_indexes.size(),
+			_value_indexes.size() };
+	}
+	const_ordered_iterator ordered_end() const noexcept {
+		return const_ordered_iterator{ this, _value_indexes.size(),
+			_value_indexes.size() };
+	}
+	const_ordered_iterator ordered_cend() const noexcept {
+		return ordered_end();
+	}
+
+	// returns the elements in ascending key order
+	detail::unsigned_map_range<ordered_iterator> ordered() noexcept {
+		return { ordered_begin(), ordered_end() };
+	}
+	detail::unsigned_map_range<const_ordered_iterator> ordered()
+			const noexcept {
+		return { ordered_begin(), ordered_end() };
+	}
+
+	// returns the elements with keys in [lo, hi), in ascending key order
+	// hi can be one past the maximum key, to include it
+	detail::unsigned_map_range<ordered_iterator> range(
+			key_type lo, size_t hi) noexcept {
+		size_t last = (std::min)(size_t(hi), _value_indexes.size());
+		size_t first = ordered_next((std::min)(size_t(lo), last), last);
+		return { ordered_iterator{ this, first, last },
+			ordered_iterator{ this, last, last } };
+	}
+	detail::unsigned_map_range<const_ordered_iterator> range(
+			key_type lo, size_t hi) const noexcept {
+		size_t last = (std::min)(size_t(hi), _value_indexes.size());
+		size_t first = ordered_next((std::min)(size_t(lo), last), last);
+		return { const_ordered_iterator{ this, first, last },
+			const_ordered_iterator{ this, last, last } };
+	}
+
 
 	// Capacity
 
@@ -176,8 +1056,11 @@ struct unsigned_map {
 
 	// returns the maximum possible number of elements
 	size_type max_size() const noexcept {
-		// -1 due to sentinel
-		return pos_sentinel() - 1;
+		// The max position is the sentinel. Fixed indexes can use the max
+		// key, other indexes can't.
+		return detail::unsigned_map_fixed_indexes<key_type>::value
+				? pos_sentinel()
+				: pos_sentinel() - 1;
 	}
 
 	// reserves storage
@@ -198,6 +1081,18 @@ struct unsigned_map {
 		_values.shrink_to_fit();
 	}
 
+	// returns the bytes used and reserved by each internal buffer
+	// capacity() only reflects the values, the indexes grow with the max key
+	memory_usage_type memory_usage() const noexcept {
+		memory_usage_type ret;
+		ret.value_indexes.used = _value_indexes.memory_used();
+		ret.value_indexes.reserved = _value_indexes.memory_reserved();
+		ret.values.used = _values.size() * sizeof(value_type);
+		ret.values.reserved = ValueStorage::memory_reserved(_values);
+		ret.size = _values.size();
+		return ret;
+	}
+
 	// Modifiers
 
 	// clears the contents
@@ -213,18 +1108,65 @@ struct unsigned_map {
 	std::pair<iterator, bool> insert(value_type&& value) {
 		return minsert(value.first, detail::maybe_move(value.second));
 	}
+	// Range inserts don't overwrite existing keys. If the range contains
+	// duplicate keys, the first one wins.
 	template <class InputIt>
 	void insert(InputIt first, InputIt last) {
-		// TODO : benchmark and potentially optimize
-		for (auto it = first; it != last; ++it) {
-			insert(*it);
+		minsert_range(first, last,
+				typename std::iterator_traits<InputIt>::iterator_category{});
+	}
+	template <class RandomIt>
+	void insert(multithreaded_t, RandomIt first, RandomIt last) {
+		static_assert(
+				std::is_base_of<std::random_access_iterator_tag,
+						typename std::iterator_traits<
+								RandomIt>::iterator_category>::value,
+				"unsigned_map : multithreaded insert requires random access "
+				"iterators");
+
+		size_t count = size_t(std::distance(first, last));
+		if (count == 0) {
+			return;
 		}
+
+		std::vector<key_type> chunk_maxes(
+				std::thread::hardware_concurrency() + 1, key_type(0));
+		detail::parallel_chunks(count, [&](size_t chunk, size_t b, size_t e) {
+			key_type m = 0;
+			for (size_t i = b; i < e; ++i) {
+				m = (std::max)(m, key_type(first[i].first));
+			}
+			chunk_maxes[chunk] = m;
+		});
+
+		key_type max_key
+				= *std::max_element(chunk_maxes.begin(), chunk_maxes.end());
+		minsert_range_mt(first, count, max_key,
+				std::integral_constant<bool,
+						std::is_default_constructible<
+								mapped_type>::value>{});
 	}
 	void insert(std::initializer_list<value_type> ilist) {
-		// TODO : benchmark and potentially optimize
-		for (const value_type& kv : ilist) {
-			insert(kv);
+		insert(ilist.begin(), ilist.end());
+	}
+	// Inserting an empty node does nothing. If the key already exists, the
+	// node keeps its value.
+	std::pair<iterator, bool> insert(node_type&& node) {
+		if (node.empty()) {
+			return { end(), false };
 		}
+
+		std::pair<iterator, bool> ret = mupsert(
+				node.key(),
+				[&](values_container& values) {
+					values.emplace_back(node.key(),
+							detail::maybe_move(node.mapped()));
+				},
+				[](mapped_type&) {});
+		if (ret.second) {
+			node.clear();
+		}
+		return ret;
 	}
 
 	// inserts an element or assigns to the current element if the key already
@@ -237,17 +1179,14 @@ struct unsigned_map {
 	// constructs element in-place
 	template <class... Args>
 	std::pair<iterator, bool> emplace(key_type k, Args&&... args) {
-		iterator it = find(k);
-		if (it != end()) {
-			return { it, false };
-		}
-
-		resize_indexes_if_needed(k);
-
-		_value_indexes[k] = pos_type(_values.size());
-		_values.emplace_back(k, std::forward<Args>(args)...);
-
-		return { std::prev(_values.end()), true };
+		return mupsert(
+				k,
+				[&](values_container& values) {
+					values.emplace_back(std::piecewise_construct,
+							std::forward_as_tuple(k),
+							std::forward_as_tuple(std::forward<Args>(args)...));
+				},
+				[](mapped_type&) {});
 	}
 
 	// inserts in-place if the key does not exist, does nothing if the key
@@ -259,6 +1198,30 @@ struct unsigned_map {
 		return emplace(key, std::forward<Args>(args)...);
 	}
 
+	// inserts make_fn() if the key does not exist, calls update_fn(value)
+	// if it exists
+	// looks up the key once, returns true if the value was inserted
+	template <class MakeFn, class UpdateFn>
+	std::pair<iterator, bool> upsert(
+			key_type k, MakeFn&& make_fn, UpdateFn&& update_fn) {
+		return mupsert(
+				k,
+				[&](values_container& values) {
+					values.emplace_back(k, make_fn());
+				},
+				update_fn);
+	}
+
+	// calls fn(value), the value is default constructed first if the key
+	// does not exist
+	// looks up the key once, returns true if the value was inserted
+	template <class Fn>
+	std::pair<iterator, bool> compute(key_type k, Fn&& fn) {
+		std::pair<iterator, bool> ret = emplace(k);
+		fn(ret.first->second);
+		return ret;
+	}
+
 	// erases elements
 	iterator erase(const_iterator pos) {
 		size_t idx = std::distance(_values.cbegin(), pos);
@@ -273,21 +1236,35 @@ struct unsigned_map {
 		size_t first_idx = std::distance(_values.cbegin(), first);
 		size_t last_idx = std::distance(_values.cbegin(), last);
 
-
-		std::vector<key_type> to_erase;
-		to_erase.reserve(last_idx - first_idx);
-		for (auto it = std::next(_values.begin(), first_idx);
-				it != std::next(_values.begin(), last_idx); ++it) {
-			to_erase.push_back(it->first);
-		}
-
-		for (key_type& k : to_erase) {
-			erase(k);
+		std::vector<pos_type> victims;
+		victims.reserve(last_idx - first_idx);
+		for (size_t i = first_idx; i < last_idx; ++i) {
+			_value_indexes.reset(_values[i].first);
+			victims.push_back(pos_type(i));
 		}
+		erase_victims(victims);
 
 		if (first_idx >= _values.size())
 			return end();
-		return find(_values[first_idx].first);
+		return std::next(begin(), first_idx);
+	}
+	// erases all the provided keys, ignores missing keys
+	// returns the number of erased elements
+	size_type erase(const key_type* keys, size_type count) {
+		std::vector<pos_type> victims;
+		victims.reserve(count);
+		for (size_type i = 0; i < count; ++i) {
+			key_type k = keys[i];
+			if (!contains(k)) {
+				continue;
+			}
+
+			victims.push_back(_value_indexes.at_unchecked(k));
+			_value_indexes.reset(k);
+		}
+
+		erase_victims(victims);
+		return victims.size();
 	}
 	size_type erase(key_type k) {
 		iterator it = find(k);
@@ -295,24 +1272,158 @@ struct unsigned_map {
 			return 0;
 		}
 
-		iterator last_it = std::prev(end());
-		_value_indexes[k] = pos_sentinel();
+		merase(it);
+		return 1;
+	}
 
-		// No need for swap, object is already at end.
-		if (last_it == it) {
-			_values.pop_back();
-			return 1;
+	// erases all elements satisfying the predicate
+	// returns the number of erased elements
+	template <class Pred>
+	size_type erase_if(Pred pred) {
+		const auto& values = _values;
+		std::vector<pos_type> victims;
+
+		for (size_t i = 0; i < values.size(); ++i) {
+			try {
+				if (!pred(values[i])) {
+					continue;
+				}
+			} catch (...) {
+				// Restore marked indexes, nothing was erased.
+				for (pos_type pos : victims) {
+					_value_indexes.assign(_values[pos].first, pos);
+				}
+				throw;
+			}
+
+			_value_indexes.reset(values[i].first);
+			victims.push_back(pos_type(i));
 		}
 
-		// swap & pop
-		pos_type value_idx = pos_type(std::distance(_values.begin(), it));
-		key_type last_key = _values.back().first;
+		erase_victims(victims);
+		return victims.size();
+	}
 
-		*it = detail::maybe_move(_values.back());
-		_values.pop_back();
-		_value_indexes[last_key] = value_idx;
+	// moves the element out of the map, into a node
+	// returns an empty node if the key doesn't exist
+	node_type extract(key_type k) {
+		iterator it = find(k);
+		if (it == end()) {
+			return node_type{};
+		}
 
-		return 1;
+		node_type ret{ detail::unsigned_node_make_t{}, k,
+			detail::maybe_move(it->second) };
+		merase(it);
+		return ret;
+	}
+	node_type extract(const_iterator pos) {
+		return extract(pos->first);
+	}
+
+	// moves the elements of other whose keys aren't in this map, the others
+	// stay in other
+	// values are moved straight from other's storage, nothing is copied
+	// if a move throws, other keeps the elements that weren't moved yet
+	void merge(unsigned_map& other) {
+		if (&other == this) {
+			return;
+		}
+
+		if (other.size() > max_size() - size()) {
+			throw std::out_of_range{ "unsigned_map : maximum size reached\n" };
+		}
+
+		reserve(size() + other.size());
+		if (other._value_indexes.size() > _value_indexes.size()) {
+			_value_indexes.resize(other._value_indexes.size());
+		}
+
+		// The elements that stay are packed at the front of other. If a move
+		// throws, the values already moved out are dropped from other, so it
+		// stays valid.
+		size_type kept = 0;
+		size_type i = 0;
+		try {
+			for (; i < other._values.size(); ++i) {
+				value_type& value = other._values[i];
+				key_type k = value.first;
+
+				if (_value_indexes.contains(k)) {
+					if (kept != i) {
+						other._values[kept] = detail::maybe_move(value);
+						other._value_indexes.assign(k, pos_type(kept));
+					}
+					++kept;
+					continue;
+				}
+
+				_values.push_back(detail::maybe_move(value));
+				_value_indexes.assign(k, pos_type(_values.size() - 1));
+				other._value_indexes.reset(k);
+			}
+		} catch (...) {
+			other.erase_merged(kept, i);
+			throw;
+		}
+
+		other.erase_merged(kept, other._values.size());
+	}
+	void merge(unsigned_map&& other) {
+		merge(other);
+	}
+
+	// reorders the values in ascending key order, so neighbouring keys are
+	// neighbours in memory again after erases scattered them
+	// invalidates iterators
+	void compact() {
+		values_container sorted(_values.get_allocator());
+		sorted.reserve(_values.size());
+
+		size_t last = _value_indexes.size();
+		for (size_t k = ordered_next(0, last); k < last;
+				k = ordered_next(k + 1, last)) {
+			sorted.push_back(detail::maybe_move(ordered_at(k)));
+		}
+
+		_values.swap(sorted);
+		for (size_t i = 0; i < _values.size(); ++i) {
+			_value_indexes.assign(_values[i].first, pos_type(i));
+		}
+	}
+	// incremental compact, places at most count values in key order,
+	// starting where cursor stopped
+	// the map can change between calls, it is always valid but may end up
+	// less ordered
+	// returns true once the map is compacted
+	bool compact(compact_cursor& cursor, size_type count) {
+		size_t last = _value_indexes.size();
+		for (size_type i = 0; i < count; ++i) {
+			cursor._key = ordered_next(cursor._key, last);
+			if (cursor._key == last || cursor._pos >= _values.size()) {
+				return true;
+			}
+
+			pos_type pos = _value_indexes.at_unchecked(key_type(cursor._key));
+			++cursor._key;
+			if (pos < cursor._pos) {
+				// Moved into the placed values by an erase since the last
+				// call, leave it there.
+				continue;
+			}
+
+			if (pos != cursor._pos) {
+				using std::swap;
+				swap(_values[cursor._pos], _values[pos]);
+				_value_indexes.assign(_values[pos].first, pos);
+				_value_indexes.assign(
+						_values[cursor._pos].first, pos_type(cursor._pos));
+			}
+			++cursor._pos;
+		}
+
+		return ordered_next(cursor._key, last) == last
+				|| cursor._pos >= _values.size();
 	}
 
 	// swaps the contents
@@ -324,6 +1435,7 @@ struct unsigned_map {
 
 	// Lookup
 	// direct access to the underlying vector
+	// only available with contiguous_values storage
 	const value_type* data() const noexcept {
 		return _values.data();
 	}
@@ -331,6 +1443,17 @@ struct unsigned_map {
 		return _values.data();
 	}
 
+	// calls func(first, last) on each contiguous span of values, in
+	// iteration order
+	template <class Func>
+	void iterate_chunks(Func&& func) const {
+		detail::iterate_chunks(_values, func);
+	}
+	template <class Func>
+	void iterate_chunks(Func&& func) {
+		detail::iterate_chunks(_values, func);
+	}
+
 	// access specified element with bounds checking
 	const mapped_type& at(key_type k) const {
 		const_iterator it = find(k);
@@ -347,7 +1470,7 @@ struct unsigned_map {
 
 	// access specified element without any bounds checking
 	const mapped_type& at_unchecked(key_type k) const {
-		return _values[_value_indexes[k]].second;
+		return _values[_value_indexes.at_unchecked(k)].second;
 	}
 	mapped_type& at_unchecked(key_type k) {
 		return const_cast<mapped_type&>(
@@ -356,12 +1479,7 @@ struct unsigned_map {
 
 	// access or insert specified element
 	mapped_type& operator[](key_type k) {
-		iterator it = find(k);
-		if (it != end()) {
-			return it->second;
-		}
-
-		return emplace(k, mapped_type{}).first->second;
+		return emplace(k).first->second;
 	}
 
 	// returns the number of elements matching specific key (which is 1 or 0,
@@ -379,25 +1497,49 @@ struct unsigned_map {
 			return end();
 		}
 
-		return std::next(begin(), _value_indexes[k]);
+		return std::next(begin(), _value_indexes.at_unchecked(k));
 	}
 	const_iterator find(key_type k) const {
 		if (!contains(k)) {
 			return end();
 		}
 
-		return std::next(begin(), _value_indexes[k]);
+		return std::next(begin(), _value_indexes.at_unchecked(k));
 	}
 
 	// checks if the container contains element with specific key
 	bool contains(key_type k) const {
-		if (k >= _value_indexes.size())
-			return false;
+		return _value_indexes.contains(k);
+	}
 
-		if (_value_indexes[k] == pos_sentinel())
-			return false;
+	// calls func(value) on each element, in ascending key order
+	template <class Func>
+	void for_each_ordered(Func&& func) const {
+		for (const value_type& v : ordered()) {
+			func(v);
+		}
+	}
+	template <class Func>
+	void for_each_ordered(Func&& func) {
+		for (value_type& v : ordered()) {
+			func(v);
+		}
+	}
+
+	// copies the values of keys[0, count) to out[0, count)
+	// every key must be in the map, keys aren't checked
+	void gather(const key_type* keys, size_type count, mapped_type* out) const {
+		batch_positions(keys, count, [&](size_t i, pos_type pos) {
+			out[i] = _values[pos].second;
+		});
+	}
 
-		return true;
+	// assigns in[0, count) to the values of keys[0, count)
+	// every key must be in the map, keys aren't checked
+	void scatter(const key_type* keys, size_type count, const mapped_type* in) {
+		batch_positions(keys, count, [&](size_t i, pos_type pos) {
+			_values[pos].second = in[i];
+		});
 	}
 
 	// returns range of elements matching a specific key (in this case, 1 or 0
@@ -418,58 +1560,398 @@ struct unsigned_map {
 	}
 
 
+	// Serialization
+
+	// writes the map to path, read it back with fea::unsigned_map_view
+	// mapped_type must be trivially copyable, see unsigned_map_file_header
+	void save(const char* path) const {
+		static_assert(std::is_trivially_copyable<mapped_type>::value,
+				"unsigned_map : save requires a trivially copyable "
+				"mapped_type");
+
+		std::unique_ptr<std::FILE, int (*)(std::FILE*)> file{
+			detail::open_file(path, "wb"), &std::fclose
+		};
+		if (file == nullptr) {
+			throw std::runtime_error{ "unsigned_map : couldn't open file" };
+		}
+
+		using record_type = unsigned_map_record<key_type, mapped_type>;
+		detail::unsigned_map_file_header header
+				= detail::make_unsigned_map_file_header<key_type, record_type>(
+						_value_indexes.size(), _values.size());
+		detail::unsigned_map_file_write(file.get(), &header, sizeof(header));
+		uint64_t pos = sizeof(header);
+
+		// Indexes are written in the sentinel layout, whatever the storage.
+		detail::unsigned_map_file_pad(file.get(), pos, header.indexes_offset);
+		std::array<pos_type, 4096> buf;
+		for (size_t i = 0; i < _value_indexes.size(); i += buf.size()) {
+			size_t count = (std::min)(buf.size(), _value_indexes.size() - i);
+			for (size_t j = 0; j < count; ++j) {
+				key_type k = key_type(i + j);
+				buf[j] = _value_indexes.contains_unchecked(k)
+						? _value_indexes.at_unchecked(k)
+						: pos_sentinel();
+			}
+			detail::unsigned_map_file_write(
+					file.get(), buf.data(), count * sizeof(pos_type));
+		}
+		pos += _value_indexes.size() * sizeof(pos_type);
+
+		// Values are copied field by field into zeroed records, the pair
+		// padding would otherwise be written uninitialized.
+		detail::unsigned_map_file_pad(file.get(), pos, header.values_offset);
+		using record_storage = typename std::aligned_storage<
+				sizeof(record_type), alignof(record_type)>::type;
+		std::vector<record_storage> storage(
+				(std::min)(_values.size(), size_t(1024)));
+		record_type* records = reinterpret_cast<record_type*>(storage.data());
+		iterate_chunks([&](const value_type* first, const value_type* last) {
+			while (first != last) {
+				size_t count
+						= (std::min)(storage.size(), size_t(last - first));
+				for (size_t i = 0; i < count; ++i) {
+					std::memcpy(&records[i].first, &first[i].first,
+							sizeof(key_type));
+					std::memcpy(&records[i].second, &first[i].second,
+							sizeof(mapped_type));
+				}
+				detail::unsigned_map_file_write(
+						file.get(), records, count * sizeof(record_type));
+				first += count;
+			}
+		});
+
+		if (std::fclose(file.release()) != 0) {
+			throw std::runtime_error{ "unsigned_map : couldn't write file" };
+		}
+	}
+
+
 	// Non-member functions
 
 	//	compares the values in the unordered_map
-	template <class K, class U>
-	friend bool operator==(
-			const unsigned_map<K, U>& lhs, const unsigned_map<K, U>& rhs);
-	template <class K, class U>
-	friend bool operator!=(
-			const unsigned_map<K, U>& lhs, const unsigned_map<K, U>& rhs);
+	template <class K, class U, class I, class A, class V>
+	friend bool operator==(const unsigned_map<K, U, I, A, V>& lhs,
+			const unsigned_map<K, U, I, A, V>& rhs);
+	template <class K, class U, class I, class A, class V>
+	friend bool operator!=(const unsigned_map<K, U, I, A, V>& lhs,
+			const unsigned_map<K, U, I, A, V>& rhs);
 
 private:
+	template <class, class>
+	friend struct detail::unsigned_map_ordered_iterator;
+
 	constexpr pos_type pos_sentinel() const noexcept {
 		return (std::numeric_limits<pos_type>::max)();
 	}
 
+	// Prepares the insertion of a new key.
+	void insert_checks(key_type k) {
+		if (_values.size() == max_size()) {
+			throw std::out_of_range{ "unsigned_map : maximum size reached\n" };
+		}
+		resize_indexes_if_needed(k);
+	}
+
 	void resize_indexes_if_needed(key_type k) {
 		if (k < _value_indexes.size()) {
 			return;
 		}
 
-		if (k == pos_sentinel()) {
+		if (!detail::unsigned_map_fixed_indexes<key_type>::value
+				&& k == pos_sentinel()) {
 			throw std::out_of_range{ "unsigned_map : maximum size reached\n" };
 		}
 
-		_value_indexes.resize(size_t(k) + 1u, pos_sentinel());
+		_value_indexes.resize(size_t(k) + 1u);
+	}
+
+	// Returns the first key in [first, last) that is in the map, or last.
+	size_t ordered_next(size_t first, size_t last) const noexcept {
+		return _value_indexes.next(first, last);
+	}
+
+	// Returns the value of a key found with ordered_next.
+	const value_type& ordered_at(size_t k) const noexcept {
+		return _values[_value_indexes.at_unchecked(key_type(k))];
+	}
+	value_type& ordered_at(size_t k) noexcept {
+		return _values[_value_indexes.at_unchecked(key_type(k))];
+	}
+
+	// Erases the value at it with a swap & pop.
+	void merase(iterator it) {
+		iterator last_it = std::prev(end());
+		_value_indexes.reset(it->first);
+
+		// No need for swap, object is already at end.
+		if (last_it == it) {
+			_values.pop_back();
+			return;
+		}
+
+		// swap & pop
+		pos_type value_idx = pos_type(std::distance(_values.begin(), it));
+		key_type last_key = _values.back().first;
+
+		*it = detail::maybe_move(_values.back());
+		_values.pop_back();
+		_value_indexes.assign(last_key, value_idx);
+	}
+
+	// Resolves the positions of a block of keys and prefetches their values,
+	// then calls func(key_idx, pos) on the block. The index loads are
+	// independent and the value loads are in flight before they're used.
+	template <class Func>
+	void batch_positions(
+			const key_type* keys, size_t count, Func&& func) const {
+		constexpr size_t block_size = 32;
+		std::array<pos_type, block_size> positions;
+
+		for (size_t first = 0; first < count; first += block_size) {
+			size_t block_count = (std::min)(block_size, count - first);
+			for (size_t i = 0; i < block_count; ++i) {
+				key_type k = keys[first + i];
+				assert(contains(k));
+				positions[i] = _value_indexes.at_unchecked(k);
+				detail::prefetch(&_values[positions[i]]);
+			}
+			for (size_t i = 0; i < block_count; ++i) {
+				func(first + i, positions[i]);
+			}
+		}
+	}
+
+	// Drops the values in [first, last), which merge moved out or packed
+	// forward, and fixes the indexes of the values after them.
+	void erase_merged(size_type first, size_type last) {
+		_values.erase(std::next(_values.begin(), first),
+				std::next(_values.begin(), last));
+		for (size_t i = first; i < _values.size(); ++i) {
+			_value_indexes.assign(_values[i].first, pos_type(i));
+		}
+	}
+
+	// Erases values at the provided positions. Their indexes must already be
+	// reset. Holes are filled with the survivors at the back,
+	// so at most min(victims, survivors) values are moved and each moved
+	// survivor updates its index once.
+	void erase_victims(const std::vector<pos_type>& victims) {
+		size_t new_size = _values.size() - victims.size();
+		size_t back = _values.size();
+
+		for (pos_type hole : victims) {
+			if (hole >= new_size) {
+				continue;
+			}
+
+			// There are exactly as many survivors past new_size as there
+			// are holes before it.
+			do {
+				--back;
+			} while (!_value_indexes.contains_unchecked(_values[back].first));
+
+			_values[hole] = detail::maybe_move(_values[back]);
+			_value_indexes.assign(_values[hole].first, hole);
+		}
+
+		// A single call, free for trivially destructible values.
+		_values.erase(_values.begin() + new_size, _values.end());
+	}
+
+	// Single pass iterators, nothing can be pre-computed.
+	template <class InputIt>
+	void minsert_range(InputIt first, InputIt last, std::input_iterator_tag) {
+		for (auto it = first; it != last; ++it) {
+			insert(*it);
+		}
+	}
+
+	template <class FwdIt>
+	void minsert_range(FwdIt first, FwdIt last, std::forward_iterator_tag) {
+		size_t count = 0;
+		key_type max_key = 0;
+		for (auto it = first; it != last; ++it) {
+			max_key = (std::max)(max_key, key_type(it->first));
+			++count;
+		}
+		minsert_range_imp(first, last, count, max_key);
+	}
+
+	template <class RandomIt>
+	void minsert_range(
+			RandomIt first, RandomIt last, std::random_access_iterator_tag) {
+		size_t count = size_t(std::distance(first, last));
+		key_type max_key = 0;
+		for (size_t i = 0; i < count; ++i) {
+			max_key = (std::max)(max_key, key_type(first[i].first));
+		}
+		minsert_range_imp(first, last, count, max_key);
+	}
+
+	// Assigns the positions of all new keys, without touching _values.
+	// Returns the number of new values.
+	template <class FwdIt>
+	size_t assign_range_positions(FwdIt first, FwdIt last) {
+		size_t new_size = _values.size();
+		for (auto it = first; it != last; ++it) {
+			key_type k = key_type(it->first);
+			if (_value_indexes.contains_unchecked(k)) {
+				continue;
+			}
+
+			if (new_size == max_size()) {
+				rollback_range_positions(first, last);
+				throw std::out_of_range{
+					"unsigned_map : maximum size reached\n"
+				};
+			}
+			_value_indexes.assign(k, pos_type(new_size++));
+		}
+		return new_size - _values.size();
+	}
+
+	// Resets the indexes which point past the last value.
+	template <class FwdIt>
+	void rollback_range_positions(FwdIt first, FwdIt last) noexcept {
+		for (auto it = first; it != last; ++it) {
+			key_type k = key_type(it->first);
+			if (_value_indexes.contains_unchecked(k)
+					&& _value_indexes.at_unchecked(k) >= _values.size()) {
+				_value_indexes.reset(k);
+			}
+		}
+	}
+
+	// Grows the indexes once, reserves the exact amount of values and
+	// inserts the first occurence of every new key.
+	template <class FwdIt>
+	void minsert_range_imp(
+			FwdIt first, FwdIt last, size_t count, key_type max_key) {
+		if (count == 0) {
+			return;
+		}
+
+		resize_indexes_if_needed(max_key);
+		size_t new_count = assign_range_positions(first, last);
+		try {
+			_values.reserve(_values.size() + new_count);
+
+			// A value is new if its key points to the next free position.
+			for (auto it = first; it != last; ++it) {
+				if (_value_indexes.at_unchecked(key_type(it->first))
+						== _values.size()) {
+					_values.push_back(*it);
+				}
+			}
+		} catch (...) {
+			rollback_range_positions(first, last);
+			throw;
+		}
+	}
+
+	// Values can't be default constructed, only the key search is
+	// multi-threaded.
+	template <class RandomIt>
+	void minsert_range_mt(
+			RandomIt first, size_t count, key_type max_key, std::false_type) {
+		minsert_range_imp(first, first + count, count, max_key);
+	}
+
+	// Default constructs the new values, then assigns them in parallel.
+	template <class RandomIt>
+	void minsert_range_mt(
+			RandomIt first, size_t count, key_type max_key, std::true_type) {
+		RandomIt last = first + count;
+		resize_indexes_if_needed(max_key);
+
+		size_t old_size = _values.size();
+		size_t new_count = assign_range_positions(first, last);
+		if (new_count == 0) {
+			return;
+		}
+
+		// Store where each new value comes from.
+		std::vector<size_t> sources;
+		try {
+			sources.reserve(new_count);
+			for (size_t i = 0; i < count; ++i) {
+				if (_value_indexes.at_unchecked(key_type(first[i].first))
+						== old_size + sources.size()) {
+					sources.push_back(i);
+				}
+			}
+			assert(sources.size() == new_count);
+
+			_values.resize(old_size + new_count);
+			detail::parallel_chunks(
+					new_count, [&](size_t, size_t b, size_t e) {
+						for (size_t i = b; i < e; ++i) {
+							_values[old_size + i] = first[sources[i]];
+						}
+					});
+		} catch (...) {
+			while (_values.size() > old_size) {
+				_values.pop_back();
+			}
+			rollback_range_positions(first, last);
+			throw;
+		}
 	}
 
 	template <class M>
 	std::pair<iterator, bool> minsert(
 			key_type k, M&& obj, bool assign_found = false) {
-		iterator it = find(k);
-		if (it != end()) {
-			if (assign_found) {
-				it->second = std::forward<M>(obj);
-			}
+		return mupsert(
+				k,
+				[&](values_container& values) {
+					values.push_back({ k, std::forward<M>(obj) });
+				},
+				[&](mapped_type& found) {
+					if (assign_found) {
+						found = std::forward<M>(obj);
+					}
+				});
+	}
+
+	// Looks up the key once. Calls make(_values) to append a new value, or
+	// update(value) on the existing one.
+	template <class Make, class Update>
+	std::pair<iterator, bool> mupsert(
+			key_type k, Make&& make, Update&& update) {
+		if (_value_indexes.contains(k)) {
+			iterator it = std::next(begin(), _value_indexes.at_unchecked(k));
+			update(it->second);
 			return { it, false };
 		}
+		return { mappend(k, make), true };
+	}
 
-		resize_indexes_if_needed(k);
+	// Appends a new key, kept out of mupsert so the hit path inlines.
+	template <class Make>
+	iterator mappend(key_type k, Make& make) {
+		insert_checks(k);
 
-		_value_indexes[k] = pos_type(_values.size());
-		_values.push_back({ k, std::forward<M>(obj) });
-		return { std::prev(_values.end()), true };
+		// The index is assigned last, a throwing make leaves it untouched.
+		make(_values);
+		_value_indexes.assign(k, pos_type(_values.size() - 1));
+		return std::prev(_values.end());
 	}
 
-	std::vector<pos_type> _value_indexes; // key -> position
-	std::vector<value_type> _values; // pair with reverse_lookup
+	// key -> position
+	detail::unsigned_map_indexes<key_type, pos_type, IndexStorage,
+			allocator_type>
+			_value_indexes;
+
+	// pair with reverse_lookup
+	values_container _values;
 };
 
-template <class Key, class T>
-inline bool operator==(
-		const unsigned_map<Key, T>& lhs, const unsigned_map<Key, T>& rhs) {
+template <class Key, class T, class I, class A, class V>
+inline bool operator==(const unsigned_map<Key, T, I, A, V>& lhs,
+		const unsigned_map<Key, T, I, A, V>& rhs) {
 	if (lhs.size() != rhs.size())
 		return false;
 
@@ -485,18 +1967,27 @@ inline bool operator==(
 
 	return true;
 }
-template <class Key, class T>
-inline bool operator!=(
-		const unsigned_map<Key, T>& lhs, const unsigned_map<Key, T>& rhs) {
+template <class Key, class T, class I, class A, class V>
+inline bool operator!=(const unsigned_map<Key, T, I, A, V>& lhs,
+		const unsigned_map<Key, T, I, A, V>& rhs) {
 	return !operator==(lhs, rhs);
 }
 
+#if __cplusplus >= 201703L
+namespace pmr {
+template <class Key, class T, class IndexStorage = sentinel_indexes,
+		class ValueStorage = contiguous_values>
+using unsigned_map = fea::unsigned_map<Key, T, IndexStorage,
+		std::pmr::polymorphic_allocator<std::pair<Key, T>>, ValueStorage>;
+} // namespace pmr
+#endif
+
 } // namespace fea
 
 namespace std {
-template <class Key, class T>
-inline void swap(fea::unsigned_map<Key, T>& lhs,
-		fea::unsigned_map<Key, T>& rhs) noexcept {
+template <class Key, class T, class I, class A, class V>
+inline void swap(fea::unsigned_map<Key, T, I, A, V>& lhs,
+		fea::unsigned_map<Key, T, I, A, V>& rhs) noexcept {
 	lhs.swap(rhs);
 }
 } // namespace std
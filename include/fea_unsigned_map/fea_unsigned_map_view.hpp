@@ -0,0 +1,265 @@
+﻿/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Philippe Groarke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "fea_mapped_file.hpp"
+#include "fea_unsigned_map.hpp"
+
+/*
+A read-only unsigned_map, answered directly from a file saved with
+unsigned_map::save.
+
+The file is memory mapped, opening it doesn't parse or copy anything. Pages
+are loaded on first access and shared with other processes mapping the same
+file.
+	fea::unsigned_map<unsigned, float> map;
+	map.save("map.bin");
+
+	fea::unsigned_map_view<unsigned, float> view{ "map.bin" };
+	const float& f = view.at(42);
+
+The file must have been written by the same Key and T, on a platform with the
+same endianness and type layouts. Mismatching files throw when opened.
+*/
+
+namespace fea {
+template <class Key, class T>
+struct unsigned_map_view {
+	static_assert(std::is_unsigned<Key>::value,
+			"unsigned_map_view : key must be unsigned integer");
+	static_assert(std::is_trivially_copyable<T>::value,
+			"unsigned_map_view : mapped_type must be trivially copyable");
+
+	using key_type = Key;
+	using mapped_type = T;
+	using value_type = unsigned_map_record<key_type, mapped_type>;
+	using size_type = std::size_t;
+	using pos_type = Key;
+	using difference_type = std::ptrdiff_t;
+
+	using const_reference = const value_type&;
+	using const_pointer = const value_type*;
+	using const_iterator = const value_type*;
+	using iterator = const_iterator;
+
+
+	// Constructors, destructors and assignement
+
+	unsigned_map_view() noexcept = default;
+
+	// maps a file written by unsigned_map::save, throws if it can't be
+	// mapped or doesn't match Key and T
+	explicit unsigned_map_view(const char* path) {
+		_mapping = detail::map_file(path, _mapping_size);
+		if (_mapping == nullptr) {
+			throw std::runtime_error{
+				"unsigned_map_view : couldn't map file"
+			};
+		}
+
+		try {
+			validate();
+		} catch (...) {
+			detail::unmap_file(_mapping, _mapping_size);
+			throw;
+		}
+	}
+
+	unsigned_map_view(const unsigned_map_view&) = delete;
+	unsigned_map_view& operator=(const unsigned_map_view&) = delete;
+
+	unsigned_map_view(unsigned_map_view&& other) noexcept {
+		swap(other);
+	}
+	unsigned_map_view& operator=(unsigned_map_view&& other) noexcept {
+		if (this != &other) {
+			unsigned_map_view tmp{ std::move(other) };
+			swap(tmp);
+		}
+		return *this;
+	}
+
+	~unsigned_map_view() {
+		detail::unmap_file(_mapping, _mapping_size);
+	}
+
+	void swap(unsigned_map_view& other) noexcept {
+		std::swap(_mapping, other._mapping);
+		std::swap(_mapping_size, other._mapping_size);
+		std::swap(_indexes, other._indexes);
+		std::swap(_indexes_size, other._indexes_size);
+		std::swap(_values, other._values);
+		std::swap(_size, other._size);
+	}
+
+
+	// Iterators
+
+	const_iterator begin() const noexcept {
+		return _values;
+	}
+	const_iterator cbegin() const noexcept {
+		return begin();
+	}
+	const_iterator end() const noexcept {
+		return _values + _size;
+	}
+	const_iterator cend() const noexcept {
+		return end();
+	}
+
+
+	// Capacity
+
+	bool empty() const noexcept {
+		return _size == 0;
+	}
+	size_type size() const noexcept {
+		return _size;
+	}
+
+
+	// Lookup
+
+	// direct access to the mapped values
+	const value_type* data() const noexcept {
+		return _values;
+	}
+
+	// access specified element with bounds checking
+	const mapped_type& at(key_type k) const {
+		const_iterator it = find(k);
+		if (it == end()) {
+			throw std::out_of_range{
+				"unsigned_map_view : value doesn't exist"
+			};
+		}
+		return it->second;
+	}
+
+	// access specified element without any bounds checking
+	const mapped_type& at_unchecked(key_type k) const noexcept {
+		return _values[_indexes[k]].second;
+	}
+
+	// returns the number of elements matching specific key
+	size_type count(key_type k) const noexcept {
+		return contains(k) ? 1 : 0;
+	}
+
+	// finds element with specific key
+	const_iterator find(key_type k) const noexcept {
+		if (!contains(k)) {
+			return end();
+		}
+		return _values + _indexes[k];
+	}
+
+	// checks if the container contains element with specific key
+	bool contains(key_type k) const noexcept {
+		// The sentinel is never a valid position. Checking against size
+		// also keeps lookups in bounds with a corrupt file, without
+		// validating the indexes when opening.
+		return size_t(k) < _indexes_size && size_t(_indexes[k]) < _size;
+	}
+
+private:
+	// checks the header and section bounds, sets the section pointers
+	void validate() {
+		using header_t = detail::unsigned_map_file_header;
+		if (_mapping_size < sizeof(header_t)) {
+			throw std::runtime_error{ "unsigned_map_view : file too small" };
+		}
+
+		header_t header;
+		std::memcpy(&header, _mapping, sizeof(header_t));
+		if (std::memcmp(header.magic, detail::unsigned_map_file_magic,
+					sizeof(header.magic))
+				!= 0) {
+			throw std::runtime_error{
+				"unsigned_map_view : not an unsigned_map file"
+			};
+		}
+		if (header.version != detail::unsigned_map_file_version) {
+			throw std::runtime_error{
+				"unsigned_map_view : unsupported file version"
+			};
+		}
+
+		header_t expected
+				= detail::make_unsigned_map_file_header<key_type, value_type>(
+						size_t(header.num_indexes), size_t(header.num_values));
+		if (header.endian_check != expected.endian_check
+				|| header.key_size != expected.key_size
+				|| header.value_size != expected.value_size
+				|| header.value_align != expected.value_align) {
+			throw std::runtime_error{
+				"unsigned_map_view : file doesn't match the map types"
+			};
+		}
+
+		// Also catches overflowing counts, the offsets wouldn't match.
+		if (header.num_indexes > _mapping_size / sizeof(pos_type)
+				|| header.num_values > _mapping_size / sizeof(value_type)
+				|| header.indexes_offset != expected.indexes_offset
+				|| header.values_offset != expected.values_offset
+				|| header.file_size != expected.file_size
+				|| header.file_size > _mapping_size) {
+			throw std::runtime_error{ "unsigned_map_view : corrupt file" };
+		}
+
+		const char* bytes = static_cast<const char*>(_mapping);
+		_indexes = reinterpret_cast<const pos_type*>(
+				bytes + header.indexes_offset);
+		_indexes_size = size_t(header.num_indexes);
+		_values = reinterpret_cast<const value_type*>(
+				bytes + header.values_offset);
+		_size = size_t(header.num_values);
+	}
+
+	const void* _mapping = nullptr;
+	size_t _mapping_size = 0;
+
+	// key -> position, max key when missing
+	const pos_type* _indexes = nullptr;
+	size_t _indexes_size = 0;
+
+	const value_type* _values = nullptr;
+	size_t _size = 0;
+};
+} // namespace fea
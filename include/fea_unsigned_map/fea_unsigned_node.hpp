@@ -0,0 +1,173 @@
+﻿/*
+BSD 3-Clause License
+
+Copyright (c) 2020, Philippe Groarke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the copyright holder nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <cassert>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/*
+An owning handle on a key and its value, extracted from an unsigned_map or a
+flat_unsigned_hashmap. It can be inserted back in any map with the same key
+and value types, without copying the value.
+
+	fea::unsigned_node<unsigned, std::string> node = pending.extract(42);
+	if (node) {
+		active.insert(std::move(node));
+	}
+
+Unlike std node handles, values aren't stored in separate nodes. Extracting
+moves the value into the handle and inserting moves it back out.
+*/
+
+namespace fea {
+namespace detail {
+// Only maps construct non-empty nodes. Keeps {key, value} braces
+// unambiguous in the maps' insert overloads.
+struct unsigned_node_make_t {
+	explicit unsigned_node_make_t() = default;
+};
+} // namespace detail
+
+template <class Key, class T>
+struct unsigned_node {
+	static_assert(std::is_unsigned<Key>::value,
+			"unsigned_node : key must be unsigned integer");
+
+	using key_type = Key;
+	using mapped_type = T;
+
+	unsigned_node() noexcept {
+	}
+	unsigned_node(
+			detail::unsigned_node_make_t, key_type key, mapped_type&& value)
+			: _key(key) {
+		new (&_value) mapped_type(std::move(value));
+		_has_value = true;
+	}
+	unsigned_node(detail::unsigned_node_make_t, key_type key,
+			const mapped_type& value)
+			: _key(key) {
+		new (&_value) mapped_type(value);
+		_has_value = true;
+	}
+
+	unsigned_node(const unsigned_node&) = delete;
+	unsigned_node(unsigned_node&& other) noexcept(
+			std::is_nothrow_move_constructible<mapped_type>::value)
+			: _key(other._key) {
+		if (other._has_value) {
+			new (&_value) mapped_type(std::move(other._value));
+			_has_value = true;
+			other.clear();
+		}
+	}
+	~unsigned_node() {
+		clear();
+	}
+
+	unsigned_node& operator=(const unsigned_node&) = delete;
+	unsigned_node& operator=(unsigned_node&& other) noexcept(
+			std::is_nothrow_move_constructible<mapped_type>::value) {
+		if (this == &other) {
+			return *this;
+		}
+
+		clear();
+		_key = other._key;
+		if (other._has_value) {
+			new (&_value) mapped_type(std::move(other._value));
+			_has_value = true;
+			other.clear();
+		}
+		return *this;
+	}
+
+	// checks whether the node holds a value
+	bool empty() const noexcept {
+		return !_has_value;
+	}
+	explicit operator bool() const noexcept {
+		return _has_value;
+	}
+
+	// returns the key, it can be changed before inserting the node
+	key_type& key() noexcept {
+		assert(!empty());
+		return _key;
+	}
+	key_type key() const noexcept {
+		assert(!empty());
+		return _key;
+	}
+
+	// returns the value
+	mapped_type& mapped() noexcept {
+		assert(!empty());
+		return _value;
+	}
+	const mapped_type& mapped() const noexcept {
+		assert(!empty());
+		return _value;
+	}
+
+	// destroys the value, the node becomes empty
+	void clear() noexcept {
+		if (!_has_value) {
+			return;
+		}
+
+		_value.~mapped_type();
+		_has_value = false;
+	}
+
+	void swap(unsigned_node& other) {
+		unsigned_node tmp{ std::move(other) };
+		other = std::move(*this);
+		*this = std::move(tmp);
+	}
+
+private:
+	key_type _key = 0;
+	bool _has_value = false;
+
+	// Only constructed while _has_value is true.
+	union {
+		mapped_type _value;
+	};
+};
+
+template <class Key, class T>
+inline void swap(unsigned_node<Key, T>& lhs, unsigned_node<Key, T>& rhs) {
+	lhs.swap(rhs);
+}
+} // namespace fea
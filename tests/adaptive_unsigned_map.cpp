@@ -0,0 +1,225 @@
+﻿#include <fea_unsigned_map/fea_adaptive_unsigned_map.hpp>
+#include <gtest/gtest.h>
+#include <limits>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace {
+TEST(adaptive_unsigned_map, basics) {
+	fea::adaptive_unsigned_map<unsigned, std::string> map;
+	EXPECT_TRUE(map.empty());
+	EXPECT_TRUE(map.is_direct());
+	EXPECT_EQ(map.find(0), map.end());
+	EXPECT_THROW(map.at(0), std::out_of_range);
+
+	for (unsigned i = 0; i < 5'000; ++i) {
+		auto ret = map.insert(i, std::to_string(i));
+		EXPECT_TRUE(ret.second);
+		EXPECT_EQ(*ret.first, std::to_string(i));
+	}
+	EXPECT_TRUE(map.is_direct());
+	EXPECT_EQ(map.size(), 5'000u);
+	EXPECT_EQ(map.key_span(), 5'000u);
+	EXPECT_FALSE(map.insert(10, "a").second);
+	EXPECT_EQ(map.at(10), "10");
+
+	map.insert_or_assign(10, "a");
+	EXPECT_EQ(map.at(10), "a");
+	map[5'000] = "b";
+	EXPECT_EQ(map.at_unchecked(5'000), "b");
+	EXPECT_EQ(map.count(5'000), 1u);
+	EXPECT_FALSE(map.contains(5'001));
+
+	// Erasing moves the last value.
+	EXPECT_EQ(map.erase(5'001), 0u);
+	EXPECT_EQ(map.erase(0), 1u);
+	EXPECT_EQ(map.keys()[0], 5'000u);
+	EXPECT_EQ(*map.begin(), "b");
+	EXPECT_EQ(map.size(), 5'000u);
+	for (size_t i = 0; i < map.size(); ++i) {
+		unsigned k = map.keys()[i];
+		EXPECT_EQ(&map.at(k), map.data() + i);
+	}
+
+	fea::adaptive_unsigned_map<unsigned, std::string> other;
+	other.swap(map);
+	EXPECT_TRUE(map.empty());
+	EXPECT_EQ(other.at(42), "42");
+	other.clear();
+	EXPECT_TRUE(other.empty());
+	EXPECT_FALSE(other.contains(42));
+}
+
+TEST(adaptive_unsigned_map, migrations) {
+	fea::adaptive_unsigned_map<size_t, std::unique_ptr<size_t>> map;
+	for (size_t i = 0; i < 2'000; ++i) {
+		map.insert(i, std::make_unique<size_t>(i));
+	}
+	EXPECT_TRUE(map.is_direct());
+
+	// A far away key doesn't grow the table, values don't move.
+	const size_t* addr = map.at(100).get();
+	const std::unique_ptr<size_t>* data = map.data();
+	size_t far = (std::numeric_limits<size_t>::max)() - 1;
+	map.insert(far, std::make_unique<size_t>(far));
+	EXPECT_FALSE(map.is_direct());
+	EXPECT_EQ(map.data(), data);
+	EXPECT_EQ(map.at(100).get(), addr);
+	EXPECT_EQ(*map.at(far), far);
+	for (size_t i = 0; i < map.size(); ++i) {
+		size_t k = map.keys()[i];
+		EXPECT_EQ(*map.data()[i], k);
+		EXPECT_EQ(map.find(k) - map.begin(), std::ptrdiff_t(i));
+	}
+
+	// Dense again once the far key is gone and keys fill the span.
+	map.erase(far);
+	EXPECT_FALSE(map.is_direct());
+	for (size_t i = 2'000; i < 2'400; ++i) {
+		map.insert(i * 100, std::make_unique<size_t>(i * 100));
+	}
+	EXPECT_FALSE(map.is_direct());
+	for (size_t i = 2'000; i < 40'000; ++i) {
+		map.insert(i, std::make_unique<size_t>(i));
+	}
+	EXPECT_TRUE(map.is_direct());
+	EXPECT_EQ(map.key_span(), 239'901u);
+	for (size_t i = 0; i < map.size(); ++i) {
+		size_t k = map.keys()[i];
+		EXPECT_EQ(*map.data()[i], k);
+		EXPECT_EQ(*map.at(k), k);
+	}
+
+	// Erasing most keys migrates to hashed.
+	for (size_t i = 40'000; i > 0; --i) {
+		map.erase(i - 1);
+	}
+	EXPECT_FALSE(map.is_direct());
+	EXPECT_EQ(map.size(), 400u);
+	EXPECT_EQ(*map.at(239'900), 239'900u);
+}
+
+TEST(adaptive_unsigned_map, erase_span) {
+	// Erasing the biggest keys of a direct map shrinks its span, the
+	// remaining dense keys stay direct.
+	fea::adaptive_unsigned_map<unsigned, unsigned> map;
+	for (unsigned i = 0; i < 20'000; ++i) {
+		map.insert(i, i);
+	}
+	EXPECT_EQ(map.key_span(), 20'000u);
+
+	for (unsigned i = 20'000; i-- > 1'000;) {
+		map.erase(i);
+	}
+	EXPECT_TRUE(map.is_direct());
+	EXPECT_EQ(map.size(), 1'000u);
+	EXPECT_EQ(map.key_span(), 1'000u);
+
+	// Erasing a middle key doesn't change it.
+	map.erase(500);
+	EXPECT_EQ(map.key_span(), 1'000u);
+	for (unsigned i = 0; i < 1'000; ++i) {
+		EXPECT_EQ(map.contains(i), i != 500);
+	}
+}
+
+TEST(adaptive_unsigned_map, thresholds) {
+	fea::adaptive_unsigned_map<unsigned, unsigned> map;
+	EXPECT_LT(map.min_density(), map.max_density());
+	EXPECT_THROW(map.density_thresholds(0.5f, 0.1f), std::invalid_argument);
+	EXPECT_THROW(map.density_thresholds(-1.f, 0.1f), std::invalid_argument);
+
+	// Never hashed.
+	map.density_thresholds(0.f, 1.f);
+	map.insert(1'000'000, 0);
+	EXPECT_TRUE(map.is_direct());
+	EXPECT_EQ(map.key_span(), 1'000'001u);
+
+	// Never direct again.
+	map.clear();
+	map.density_thresholds(0.5f, 2.f);
+	map.insert(0, 0);
+	map.insert(1'000'000, 0);
+	EXPECT_FALSE(map.is_direct());
+	for (unsigned i = 0; i < 10'000; ++i) {
+		map.insert(i, i);
+	}
+	EXPECT_FALSE(map.is_direct());
+	EXPECT_EQ(map.size(), 10'001u);
+}
+
+struct throws_on_copy {
+	throws_on_copy() = default;
+	throws_on_copy(const throws_on_copy&) {
+		throw std::runtime_error{ "" };
+	}
+	throws_on_copy(throws_on_copy&&) = default;
+	throws_on_copy& operator=(const throws_on_copy&) = default;
+	throws_on_copy& operator=(throws_on_copy&&) = default;
+};
+
+TEST(adaptive_unsigned_map, throwing_insert) {
+	fea::adaptive_unsigned_map<unsigned, throws_on_copy> map;
+	throws_on_copy t;
+	map.insert(0, throws_on_copy{});
+	EXPECT_THROW(map.insert(1, t), std::runtime_error);
+	EXPECT_EQ(map.size(), 1u);
+	EXPECT_FALSE(map.contains(1));
+	EXPECT_EQ(map.keys().size(), 1u);
+
+	map.insert(1'000'000, throws_on_copy{});
+	EXPECT_FALSE(map.is_direct());
+	EXPECT_THROW(map.insert(2, t), std::runtime_error);
+	EXPECT_EQ(map.size(), 2u);
+	EXPECT_FALSE(map.contains(2));
+	EXPECT_EQ(map.keys().size(), 2u);
+}
+
+template <class Key>
+void do_random_test(size_t key_max, size_t sparse_max) {
+	fea::adaptive_unsigned_map<Key, size_t> map;
+	std::map<Key, size_t> expected;
+	std::mt19937_64 gen(42);
+	size_t migrations = 0;
+	bool direct = map.is_direct();
+
+	// Phases of dense and sparse keys.
+	for (size_t i = 0; i < 40'000; ++i) {
+		bool sparse = (i / 5'000) % 2 == 1;
+		Key k = Key(gen() % (sparse ? sparse_max : key_max));
+		if (gen() % 3 == 0) {
+			EXPECT_EQ(map.erase(k), expected.erase(k));
+		} else {
+			map.insert_or_assign(k, i);
+			expected[k] = i;
+		}
+
+		if (map.is_direct() != direct) {
+			direct = map.is_direct();
+			++migrations;
+		}
+	}
+	if (sparse_max > 100'000) {
+		EXPECT_GT(migrations, 0u);
+	}
+
+	ASSERT_EQ(map.size(), expected.size());
+	for (const auto& kv : expected) {
+		EXPECT_EQ(map.at(kv.first), kv.second);
+	}
+	for (size_t i = 0; i < map.size(); ++i) {
+		EXPECT_EQ(expected.at(map.keys()[i]), map.data()[i]);
+	}
+}
+
+TEST(adaptive_unsigned_map, random) {
+	do_random_test<uint8_t>(100, 255);
+	do_random_test<uint16_t>(2'000, 65'535);
+	do_random_test<unsigned>(5'000, 100'000'000);
+	do_random_test<size_t>(5'000, (std::numeric_limits<size_t>::max)());
+}
+} // namespace
@@ -0,0 +1,101 @@
+﻿#include <array>
+#include <cstdint>
+#include <fea_unsigned_map/fea_arena_allocator.hpp>
+#include <fea_unsigned_map/fea_flat_unsigned_hashmap.hpp>
+#include <fea_unsigned_map/fea_unsigned_map.hpp>
+#include <gtest/gtest.h>
+
+namespace {
+bool is_in(const void* ptr, const void* buf, size_t size) {
+	auto p = reinterpret_cast<uintptr_t>(ptr);
+	auto b = reinterpret_cast<uintptr_t>(buf);
+	return p >= b && p < b + size;
+}
+
+TEST(arena_allocator, arena) {
+	alignas(64) std::array<char, 256> buf;
+	fea::monotonic_arena arena{ buf.data(), buf.size() };
+
+	void* p1 = arena.allocate(3, 1);
+	void* p2 = arena.allocate(8, 8);
+	void* p3 = arena.allocate(16, 64);
+	EXPECT_TRUE(is_in(p1, buf.data(), buf.size()));
+	EXPECT_TRUE(is_in(p2, buf.data(), buf.size()));
+	EXPECT_TRUE(is_in(p3, buf.data(), buf.size()));
+	EXPECT_EQ(reinterpret_cast<uintptr_t>(p2) % 8, 0u);
+	EXPECT_EQ(reinterpret_cast<uintptr_t>(p3) % 64, 0u);
+	EXPECT_NE(p1, p2);
+	EXPECT_FALSE(arena.overflowed());
+
+	// Doesn't fit, uses an overflow block.
+	void* p4 = arena.allocate(1'000, 16);
+	EXPECT_FALSE(is_in(p4, buf.data(), buf.size()));
+	EXPECT_EQ(reinterpret_cast<uintptr_t>(p4) % 16, 0u);
+	EXPECT_TRUE(arena.overflowed());
+
+	void* p5 = arena.allocate(100'000, 8);
+	EXPECT_NE(p5, nullptr);
+
+	arena.release();
+	EXPECT_FALSE(arena.overflowed());
+	EXPECT_EQ(arena.allocate(3, 1), p1);
+
+	// No buffer, everything from overflow blocks.
+	fea::monotonic_arena heap_arena;
+	EXPECT_NE(heap_arena.allocate(8, 8), nullptr);
+	EXPECT_TRUE(heap_arena.overflowed());
+}
+
+TEST(arena_allocator, maps) {
+	std::array<char, 65'536> buf;
+	fea::monotonic_arena arena{ buf.data(), buf.size() };
+
+	{
+		using alloc_t = fea::arena_allocator<float>;
+		fea::flat_unsigned_hashmap<unsigned, float, alloc_t> map{ alloc_t{
+				arena } };
+		for (unsigned i = 0; i < 200; ++i) {
+			map.insert(i, float(i));
+		}
+		map.erase(5u);
+
+		fea::flat_unsigned_hashmap<unsigned, float, alloc_t> map2{ map };
+		EXPECT_EQ(map, map2);
+		EXPECT_EQ(map2.get_allocator(), alloc_t{ arena });
+		EXPECT_TRUE(is_in(map2.data(), buf.data(), buf.size()));
+		EXPECT_EQ(map2.at(42), 42.f);
+		EXPECT_FALSE(map2.contains(5));
+	}
+
+	{
+		using alloc_t = fea::arena_allocator<std::pair<unsigned, float>>;
+		fea::unsigned_map<unsigned, float, fea::sentinel_indexes, alloc_t> map{
+			alloc_t{ arena }
+		};
+		for (unsigned i = 0; i < 200; ++i) {
+			map.insert({ i, float(i) });
+		}
+		map.clear();
+		map.insert({ 3, 3.f });
+		EXPECT_EQ(map.at(3), 3.f);
+		EXPECT_TRUE(is_in(map.data(), buf.data(), buf.size()));
+	}
+	EXPECT_FALSE(arena.overflowed());
+	arena.release();
+
+	{
+		// Overflows the buffer.
+		using alloc_t = fea::arena_allocator<float>;
+		fea::flat_unsigned_hashmap<unsigned, float, alloc_t> map{ alloc_t{
+				arena } };
+		for (unsigned i = 0; i < 10'000; ++i) {
+			map.insert(i, float(i));
+		}
+		EXPECT_TRUE(arena.overflowed());
+		for (unsigned i = 0; i < 10'000; ++i) {
+			EXPECT_EQ(map.at(i), float(i));
+		}
+	}
+	arena.release();
+}
+} // namespace
@@ -0,0 +1,264 @@
+﻿#if defined(NDEBUG) && defined(FEA_BENCHMARKS)
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <fea_benchmark/fea_benchmark.hpp>
+#include <fea_unsigned_map/fea_adaptive_unsigned_map.hpp>
+#include <fea_unsigned_map/fea_flat_unsigned_hashmap.hpp>
+#include <fea_unsigned_map/fea_unsigned_map.hpp>
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+namespace {
+#if defined(NDEBUG)
+constexpr size_t num_keys = 5'000'000;
+#else
+constexpr size_t num_keys = 100'000;
+#endif
+
+struct small_obj {
+	float x{ 42 };
+	float y{ 42 };
+	float z{ 42 };
+};
+
+// Sparse keys would need a gigantic unsigned_map, it is skipped.
+void benchmarks(const std::vector<size_t>& keys, bool with_unsigned_map) {
+	std::array<char, 128> title;
+	fea::bench::suite suite;
+
+	fea::unsigned_map<size_t, small_obj> unsigned_map;
+	fea::flat_unsigned_hashmap<size_t, small_obj> flat_map;
+	fea::adaptive_unsigned_map<size_t, small_obj> adaptive_map;
+
+
+	// Bench : insert
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(), "Insert %zu small objects",
+			keys.size());
+	suite.title(title.data());
+
+	if (with_unsigned_map) {
+		suite.benchmark("fea::unsigned_map insert", [&]() {
+			for (size_t i = 0; i < keys.size(); ++i) {
+				unsigned_map.insert({ keys[i], { float(i), 0.f, 0.f } });
+			}
+		});
+	}
+	suite.benchmark("fea::flat_unsigned_hashmap insert", [&]() {
+		for (size_t i = 0; i < keys.size(); ++i) {
+			flat_map.insert(keys[i], { float(i), 0.f, 0.f });
+		}
+	});
+	suite.benchmark("fea::adaptive_unsigned_map insert", [&]() {
+		for (size_t i = 0; i < keys.size(); ++i) {
+			adaptive_map.insert(keys[i], { float(i), 0.f, 0.f });
+		}
+	});
+	suite.print();
+	suite.clear();
+	printf("Num unique keys : %zu, adaptive_unsigned_map is %s\n\n",
+			adaptive_map.size(),
+			adaptive_map.is_direct() ? "direct" : "hashed");
+
+
+	// Bench : find
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(), "Find %zu keys", keys.size());
+	suite.title(title.data());
+
+	// Sink, so the loops aren't optimized away.
+	float total = 0.f;
+	if (with_unsigned_map) {
+		suite.benchmark("fea::unsigned_map at_unchecked", [&]() {
+			for (size_t k : keys) {
+				total += unsigned_map.at_unchecked(k).x;
+			}
+		});
+	}
+	suite.benchmark("fea::flat_unsigned_hashmap at_unchecked", [&]() {
+		for (size_t k : keys) {
+			total += flat_map.at_unchecked(k).x;
+		}
+	});
+	suite.benchmark("fea::adaptive_unsigned_map at_unchecked", [&]() {
+		for (size_t k : keys) {
+			total += adaptive_map.at_unchecked(k).x;
+		}
+	});
+	suite.print();
+	suite.clear();
+
+
+	// Bench : iterate
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(), "Iterate %zu small objects",
+			adaptive_map.size());
+	suite.title(title.data());
+
+	if (with_unsigned_map) {
+		suite.benchmark("fea::unsigned_map iterate", [&]() {
+			for (const auto& kv : unsigned_map) {
+				total += kv.second.x;
+			}
+		});
+	}
+	suite.benchmark("fea::flat_unsigned_hashmap iterate", [&]() {
+		for (const small_obj& v : flat_map) {
+			total += v.x;
+		}
+	});
+	suite.benchmark("fea::adaptive_unsigned_map iterate", [&]() {
+		for (const small_obj& v : adaptive_map) {
+			total += v.x;
+		}
+	});
+	suite.print();
+	suite.clear();
+
+
+	// Bench : erase
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"Erase %zu (all) small objects at random", adaptive_map.size());
+	suite.title(title.data());
+
+	std::vector<size_t> random_keys = keys;
+
+	std::random_device rng;
+	std::mt19937_64 urng(rng());
+	std::shuffle(random_keys.begin(), random_keys.end(), urng);
+
+	if (with_unsigned_map) {
+		suite.benchmark("fea::unsigned_map erase", [&]() {
+			for (size_t k : random_keys) {
+				unsigned_map.erase(k);
+			}
+		});
+	}
+	suite.benchmark("fea::flat_unsigned_hashmap erase", [&]() {
+		for (size_t k : random_keys) {
+			flat_map.erase(k);
+		}
+	});
+	suite.benchmark("fea::adaptive_unsigned_map erase", [&]() {
+		for (size_t k : random_keys) {
+			adaptive_map.erase(k);
+		}
+	});
+	suite.print();
+	suite.clear();
+
+	printf("%f\n", total);
+}
+
+
+TEST(adaptive_unsigned_map, benchmarks) {
+	srand(static_cast<unsigned int>(
+			std::chrono::system_clock::now().time_since_epoch().count()));
+	std::vector<size_t> keys;
+	keys.reserve(num_keys);
+
+	std::array<char, 128> title;
+	title.fill('\0');
+
+	// Linear keys, 0 to N
+	{
+		keys.clear();
+		for (size_t i = 0; i < num_keys / 2; ++i) {
+			keys.push_back(i);
+		}
+
+		title.fill('\0');
+		std::snprintf(title.data(), title.size(),
+				"Benchmark using linear keys, 0 to %zu, no duplicates",
+				num_keys / 2);
+		fea::bench::title(title.data());
+
+		benchmarks(keys, true);
+	}
+
+
+	// Linear keys, N to 0
+	{
+		keys.clear();
+		for (long long i = (long long)(num_keys / 2 - 1); i >= 0; --i) {
+			keys.push_back(size_t(i));
+		}
+
+		printf("\n\n");
+		title.fill('\0');
+		std::snprintf(title.data(), title.size(),
+				"Benchmark using linear keys, %zu to 0, no duplicates",
+				num_keys / 2);
+		fea::bench::title(title.data());
+
+		benchmarks(keys, true);
+	}
+
+
+	// Random keys.
+	{
+		std::random_device rd{};
+		std::mt19937_64 gen{ rd() };
+		std::uniform_int_distribution<size_t> dis{ 0, num_keys / 4 };
+
+		keys.clear();
+		for (size_t i = 0; i < num_keys; ++i) {
+			keys.push_back(dis(gen));
+		}
+
+		printf("\n\n");
+		title.fill('\0');
+		std::snprintf(title.data(), title.size(),
+				"Benchmark using %zu random uniform distribution keys, with "
+				"duplicates",
+				num_keys);
+		fea::bench::title(title.data());
+
+		benchmarks(keys, true);
+	}
+
+
+	// Random keys.
+	{
+		keys.clear();
+		for (size_t i = 0; i < num_keys; ++i) {
+			keys.push_back(rand() % num_keys);
+		}
+
+		printf("\n\n");
+		title.fill('\0');
+		std::snprintf(title.data(), title.size(),
+				"Benchmark using %zu rand() keys, many duplicates", num_keys);
+		fea::bench::title(title.data());
+
+		benchmarks(keys, true);
+	}
+
+
+	// Sparse keys, spread over 2^40.
+	{
+		std::random_device rd{};
+		std::mt19937_64 gen{ rd() };
+		std::uniform_int_distribution<size_t> dis{ 0, size_t(1) << 40 };
+
+		keys.clear();
+		for (size_t i = 0; i < num_keys / 2; ++i) {
+			keys.push_back(dis(gen));
+		}
+
+		printf("\n\n");
+		title.fill('\0');
+		std::snprintf(title.data(), title.size(),
+				"Benchmark using %zu sparse keys, 0 to 2^40", num_keys / 2);
+		fea::bench::title(title.data());
+
+		benchmarks(keys, false);
+	}
+}
+} // namespace
+#endif // NDEBUG
@@ -4,7 +4,14 @@
 #include <array>
 #include <cstdio>
 #include <fea_benchmark/fea_benchmark.hpp>
+#include <fea_unsigned_map/fea_arena_allocator.hpp>
+#include <fea_unsigned_map/fea_cow_unsigned_map.hpp>
+#include <fea_unsigned_map/fea_flat_unsigned_column_hashmap.hpp>
 #include <fea_unsigned_map/fea_flat_unsigned_hashmap.hpp>
+#include <fea_unsigned_map/fea_frozen_flat_unsigned_hashmap_view.hpp>
+#include <fea_unsigned_map/fea_huge_page_allocator.hpp>
+#include <fea_unsigned_map/fea_perfect_unsigned_hashmap.hpp>
+#include <fea_unsigned_map/fea_static_unsigned_map.hpp>
 #include <gtest/gtest.h>
 #include <map>
 #include <random>
@@ -46,6 +53,26 @@ struct big_obj {
 	std::array<uint8_t, 1024> data{};
 };
 
+// Prints the heap memory of a map, per internal buffer.
+template <class Map>
+void print_memory_usage(const char* name, const Map& map) {
+	auto mb = [](size_t bytes) { return double(bytes) / (1024.0 * 1024.0); };
+	auto usage = map.memory_usage();
+
+	printf("%s memory usage\n", name);
+	printf("%-20s%15s%15s\n", "buffer", "used (MB)", "reserved (MB)");
+	printf("%-20s%15.3f%15.3f\n", "lookup", mb(usage.lookup.used),
+			mb(usage.lookup.reserved));
+	printf("%-20s%15.3f%15.3f\n", "reverse_lookup",
+			mb(usage.reverse_lookup.used), mb(usage.reverse_lookup.reserved));
+	printf("%-20s%15.3f%15.3f\n", "values", mb(usage.values.used),
+			mb(usage.values.reserved));
+	printf("%-20s%15.3f%15.3f\n", "total", mb(usage.used()),
+			mb(usage.reserved()));
+	printf("%-20s%15.3f%15.3f\n\n", "bytes per element",
+			usage.used_per_element(), usage.reserved_per_element());
+}
+
 void benchmarks(const std::vector<size_t>& keys) {
 	using namespace std::chrono_literals;
 
@@ -86,6 +113,11 @@ void benchmarks(const std::vector<size_t>& keys) {
 		unsigned_map_big.insert(keys[i], {});
 	}
 	printf("Num unique keys : %zu\n\n", map_small.size());
+
+	print_memory_usage(
+			"fea::flat_unsigned_hashmap small objects", unsigned_map_small);
+	print_memory_usage(
+			"fea::flat_unsigned_hashmap big objects", unsigned_map_big);
 	// printf("%zu\n", unordered_map_small.size());
 	// printf("%zu\n", unsigned_map_small.size());
 
@@ -447,6 +479,774 @@ void benchmarks(const std::vector<size_t>& keys) {
 	unsigned_map_big.clear();
 }
 
+// Many small maps, built then thrown away, like per-request scratch maps.
+void short_lived_benchmarks() {
+	constexpr size_t num_requests = 100'000;
+	constexpr size_t entries_per_request = 8;
+
+	std::array<char, 128> title;
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"Build and discard %zu maps of %zu small objects", num_requests,
+			entries_per_request);
+
+	fea::bench::suite suite;
+	suite.title(title.data());
+
+	// Sink, so the maps aren't optimized away.
+	float total = 0.f;
+
+	suite.benchmark("std::unordered_map", [&]() {
+		for (size_t r = 0; r < num_requests; ++r) {
+			std::unordered_map<size_t, small_obj> map;
+			for (size_t i = 0; i < entries_per_request; ++i) {
+				map.insert({ (r + i * 7) % 64, { float(i), 0.f, 0.f } });
+			}
+			total += map.begin()->second.x;
+		}
+	});
+
+	suite.benchmark("fea::flat_unsigned_hashmap", [&]() {
+		for (size_t r = 0; r < num_requests; ++r) {
+			fea::flat_unsigned_hashmap<size_t, small_obj> map;
+			for (size_t i = 0; i < entries_per_request; ++i) {
+				map.insert((r + i * 7) % 64, { float(i), 0.f, 0.f });
+			}
+			total += map.begin()->x;
+		}
+	});
+
+	std::array<char, 16'384> buf;
+	fea::monotonic_arena arena{ buf.data(), buf.size() };
+	suite.benchmark("fea::flat_unsigned_hashmap arena_allocator", [&]() {
+		using alloc_t = fea::arena_allocator<small_obj>;
+		for (size_t r = 0; r < num_requests; ++r) {
+			{
+				fea::flat_unsigned_hashmap<size_t, small_obj, alloc_t> map{
+					alloc_t{ arena }
+				};
+				for (size_t i = 0; i < entries_per_request; ++i) {
+					map.insert((r + i * 7) % 64, { float(i), 0.f, 0.f });
+				}
+				total += map.begin()->x;
+			}
+			arena.release();
+		}
+	});
+	suite.print();
+	suite.clear();
+
+
+	// Bench : find in a tiny map
+	constexpr size_t num_finds = 10'000'000;
+	std::unordered_map<size_t, small_obj> unordered_map_tiny;
+	fea::flat_unsigned_hashmap<size_t, small_obj> unsigned_map_tiny;
+	for (size_t i = 0; i < entries_per_request; ++i) {
+		unordered_map_tiny.insert({ i * 113, { float(i), 0.f, 0.f } });
+		unsigned_map_tiny.insert(i * 113, { float(i), 0.f, 0.f });
+	}
+
+	// Unpredictable order, so early exits can't be learned.
+	std::vector<size_t> tiny_keys;
+	for (size_t i = 0; i < 4'096; ++i) {
+		tiny_keys.push_back((i % entries_per_request) * 113);
+	}
+	std::mt19937_64 gen{ std::random_device{}() };
+	std::shuffle(tiny_keys.begin(), tiny_keys.end(), gen);
+
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"Find %zu keys in a map of %zu small objects", num_finds,
+			entries_per_request);
+	suite.title(title.data());
+
+	suite.benchmark("std::unordered_map find", [&]() {
+		for (size_t i = 0; i < num_finds; ++i) {
+			auto it = unordered_map_tiny.find(tiny_keys[i % 4'096]);
+			total += it->second.x;
+		}
+	});
+	suite.benchmark("fea::flat_unsigned_hashmap find", [&]() {
+		for (size_t i = 0; i < num_finds; ++i) {
+			auto it = unsigned_map_tiny.find(tiny_keys[i % 4'096]);
+			total += it->x;
+		}
+	});
+	suite.print();
+	suite.clear();
+
+	printf("%f\n", total);
+}
+
+
+// Random lookups in a big map, with and without huge page backed tables.
+void huge_page_benchmarks() {
+	std::random_device rd{};
+	std::mt19937_64 gen{ rd() };
+	std::uniform_int_distribution<size_t> dis{ 0, num_keys * 4 };
+
+	std::vector<size_t> keys;
+	keys.reserve(num_keys);
+	for (size_t i = 0; i < num_keys; ++i) {
+		keys.push_back(dis(gen));
+	}
+
+	fea::flat_unsigned_hashmap<size_t, small_obj> map;
+	fea::flat_unsigned_hashmap<size_t, small_obj,
+			fea::huge_page_allocator<small_obj>> huge_map;
+	for (size_t i = 0; i < keys.size(); ++i) {
+		map.insert(keys[i], { float(i), 0.f, 0.f });
+	}
+	for (size_t i = 0; i < keys.size(); ++i) {
+		huge_map.insert(keys[i], { float(i), 0.f, 0.f });
+	}
+	std::shuffle(keys.begin(), keys.end(), gen);
+
+	std::array<char, 128> title;
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"Find %zu random keys in %zu small objects", keys.size(),
+			map.size());
+
+	fea::bench::suite suite;
+	suite.title(title.data());
+
+	// Sink, so the lookups aren't optimized away.
+	float total = 0.f;
+	suite.benchmark("fea::flat_unsigned_hashmap find", [&]() {
+		for (size_t i = 0; i < keys.size(); ++i) {
+			auto it = map.find(keys[i]);
+			total += it->x;
+		}
+	});
+	suite.benchmark(
+			"fea::flat_unsigned_hashmap huge_page_allocator find", [&]() {
+				for (size_t i = 0; i < keys.size(); ++i) {
+					auto it = huge_map.find(keys[i]);
+					total += it->x;
+				}
+			});
+	suite.print();
+	suite.clear();
+
+	printf("%f\n", total);
+}
+
+
+// Opening a frozen image versus building the map.
+void frozen_benchmarks() {
+	const char* path = "fea_flat_unsigned_hashmap_benchmark.bin";
+
+	std::random_device rd{};
+	std::mt19937_64 gen{ rd() };
+	std::uniform_int_distribution<size_t> dis{ 0, num_keys * 4 };
+
+	std::vector<size_t> keys;
+	keys.reserve(num_keys);
+	for (size_t i = 0; i < num_keys; ++i) {
+		keys.push_back(dis(gen));
+	}
+
+	fea::flat_unsigned_hashmap<size_t, small_obj> map;
+	for (size_t i = 0; i < keys.size(); ++i) {
+		map.insert(keys[i], { float(i), 0.f, 0.f });
+	}
+	map.freeze(path);
+	std::shuffle(keys.begin(), keys.end(), gen);
+
+	std::array<char, 128> title;
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"Load %zu small objects and find %zu random keys", map.size(),
+			keys.size());
+
+	fea::bench::suite suite;
+	suite.title(title.data());
+
+	// Sink, so the lookups aren't optimized away.
+	float total = 0.f;
+	suite.benchmark("fea::flat_unsigned_hashmap build", [&]() {
+		fea::flat_unsigned_hashmap<size_t, small_obj> built;
+		for (size_t i = 0; i < keys.size(); ++i) {
+			built.insert(keys[i], { float(i), 0.f, 0.f });
+		}
+		for (size_t k : keys) {
+			total += built.find(k)->x;
+		}
+	});
+	suite.benchmark("fea::flat_unsigned_hashmap freeze",
+			[&]() { map.freeze(path); });
+	suite.benchmark("fea::frozen_flat_unsigned_hashmap_view open", [&]() {
+		fea::frozen_flat_unsigned_hashmap_view<size_t, small_obj> view{
+			path
+		};
+		for (size_t k : keys) {
+			total += view.find(k)->x;
+		}
+	});
+	suite.print();
+	suite.clear();
+
+	std::remove(path);
+	printf("%f\n", total);
+}
+
+
+// Static key set, minimal perfect hash versus the dynamic map.
+// Every benchmark does num_keys lookups.
+void perfect_hash_benchmarks(size_t count) {
+	std::random_device rd{};
+	std::mt19937_64 gen{ rd() };
+	std::uniform_int_distribution<size_t> dis{ 0, count * 4 };
+
+	std::vector<size_t> keys;
+	keys.reserve(count);
+	for (size_t i = 0; i < count; ++i) {
+		keys.push_back(dis(gen));
+	}
+	std::sort(keys.begin(), keys.end());
+	keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+	std::shuffle(keys.begin(), keys.end(), gen);
+
+	std::vector<small_obj> values(keys.size());
+	for (size_t i = 0; i < values.size(); ++i) {
+		values[i].x = float(i);
+	}
+
+	std::array<char, 128> title;
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(), "Build with %zu unique keys",
+			keys.size());
+
+	fea::bench::suite suite;
+	suite.title(title.data());
+
+	fea::flat_unsigned_hashmap<size_t, small_obj> map;
+	fea::perfect_unsigned_hashmap<size_t, small_obj> perfect_map;
+	suite.benchmark("fea::flat_unsigned_hashmap build", [&]() {
+		for (size_t i = 0; i < keys.size(); ++i) {
+			map.insert(keys[i], values[i]);
+		}
+	});
+	suite.benchmark("fea::perfect_unsigned_hashmap build", [&]() {
+		perfect_map = fea::perfect_unsigned_hashmap<size_t, small_obj>{
+			keys.data(), values.data(), keys.size()
+		};
+	});
+	suite.print();
+	suite.clear();
+
+	std::shuffle(keys.begin(), keys.end(), gen);
+	size_t repeat = num_keys / keys.size();
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"Find %zu random keys in %zu keys", repeat * keys.size(),
+			keys.size());
+	suite.title(title.data());
+
+	// Sink, so the lookups aren't optimized away.
+	float total = 0.f;
+	suite.benchmark("fea::flat_unsigned_hashmap find", [&]() {
+		for (size_t r = 0; r < repeat; ++r) {
+			for (size_t k : keys) {
+				total += map.find(k)->x;
+			}
+		}
+	});
+	suite.benchmark("fea::perfect_unsigned_hashmap find", [&]() {
+		for (size_t r = 0; r < repeat; ++r) {
+			for (size_t k : keys) {
+				total += perfect_map.find(k)->x;
+			}
+		}
+	});
+	suite.benchmark("fea::perfect_unsigned_hashmap at_unchecked", [&]() {
+		for (size_t r = 0; r < repeat; ++r) {
+			for (size_t k : keys) {
+				total += perfect_map.at_unchecked(k).x;
+			}
+		}
+	});
+	suite.print();
+	suite.clear();
+
+	printf("%f\n", total);
+}
+
+
+void kv_iteration_benchmarks() {
+	std::random_device rd{};
+	std::mt19937_64 gen{ rd() };
+	std::uniform_int_distribution<size_t> dis{ 0, num_keys * 4 };
+
+	fea::flat_unsigned_hashmap<size_t, small_obj> map;
+	std::unordered_map<size_t, small_obj> unordered_map;
+	for (size_t i = 0; i < num_keys; ++i) {
+		size_t k = dis(gen);
+		map.insert(k, { float(i), 0.f, 0.f });
+		unordered_map.insert({ k, { float(i), 0.f, 0.f } });
+	}
+
+	std::array<char, 128> title;
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"Iterate %zu keys and small objects", map.size());
+
+	fea::bench::suite suite;
+	suite.title(title.data());
+
+	// Sink, so the loops aren't optimized away.
+	size_t total = 0;
+	suite.benchmark("std::unordered_map iterate pairs", [&]() {
+		for (const auto& kv : unordered_map) {
+			total += kv.first + size_t(kv.second.x);
+		}
+	});
+	suite.benchmark("fea::flat_unsigned_hashmap iterate values", [&]() {
+		for (const small_obj& v : map) {
+			total += size_t(v.x);
+		}
+	});
+	suite.benchmark("fea::flat_unsigned_hashmap iterate keys()", [&]() {
+		for (size_t k : map.keys()) {
+			total += k;
+		}
+	});
+	suite.benchmark("fea::flat_unsigned_hashmap zip keys() and values",
+			[&]() {
+				const small_obj* values = map.data();
+				for (size_t k : map.keys()) {
+					total += k + size_t(values->x);
+					++values;
+				}
+			});
+	suite.benchmark("fea::flat_unsigned_hashmap iterate kvs()", [&]() {
+		for (auto kv : map.kvs()) {
+			total += kv.first + size_t(kv.second.x);
+		}
+	});
+	suite.print();
+	suite.clear();
+
+	printf("%zu\n", total);
+}
+
+
+void increment_benchmarks() {
+	std::random_device rd{};
+	std::mt19937_64 gen{ rd() };
+	std::uniform_int_distribution<size_t> dis{ 0, num_keys / 8 };
+
+	// Counter accumulation, many increments per key.
+	std::vector<size_t> keys;
+	keys.reserve(num_keys);
+	for (size_t i = 0; i < num_keys; ++i) {
+		keys.push_back(dis(gen));
+	}
+
+	std::array<char, 128> title;
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"Increment %zu counters by key, %zu unique keys", keys.size(),
+			num_keys / 8);
+
+	fea::bench::suite suite;
+	suite.title(title.data());
+
+	std::unordered_map<size_t, size_t> unordered_map;
+	fea::flat_unsigned_hashmap<size_t, size_t> find_map;
+	fea::flat_unsigned_hashmap<size_t, size_t> subscript_map;
+	fea::flat_unsigned_hashmap<size_t, size_t> compute_map;
+	suite.benchmark("std::unordered_map operator[]", [&]() {
+		for (size_t k : keys) {
+			++unordered_map[k];
+		}
+	});
+	suite.benchmark("fea::flat_unsigned_hashmap find & insert", [&]() {
+		auto& map = find_map;
+		for (size_t k : keys) {
+			auto it = map.find(k);
+			if (it == map.end()) {
+				map.insert(k, 1);
+			} else {
+				++*it;
+			}
+		}
+	});
+	suite.benchmark("fea::flat_unsigned_hashmap operator[]", [&]() {
+		for (size_t k : keys) {
+			++subscript_map[k];
+		}
+	});
+	suite.benchmark("fea::flat_unsigned_hashmap compute", [&]() {
+		for (size_t k : keys) {
+			compute_map.compute(k, [](size_t& c) { ++c; });
+		}
+	});
+	suite.print();
+	suite.clear();
+
+	printf("%zu\n", compute_map.size() + subscript_map.size());
+}
+
+
+void merge_benchmarks() {
+	constexpr size_t count = num_keys / 10;
+	std::random_device rd{};
+	std::mt19937_64 gen{ rd() };
+	std::uniform_int_distribution<size_t> dis{ 0, count * 4 };
+
+	// Heap allocated values, so copies aren't free.
+	using map_t = fea::flat_unsigned_hashmap<size_t, std::string>;
+	map_t pending_src;
+	map_t active_src;
+	std::vector<size_t> pending_keys;
+	const std::string value(64, 'a');
+	for (map_t* m : { &pending_src, &active_src }) {
+		map_t& map = *m;
+		while (map.size() < count) {
+			size_t k = dis(gen);
+			map.insert(k, value);
+		}
+	}
+	for (size_t k : pending_src.keys()) {
+		pending_keys.push_back(k);
+	}
+
+	std::array<char, 128> title;
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"Move %zu entries to a map of %zu entries", count, count);
+
+	fea::bench::suite suite;
+	suite.title(title.data());
+
+	map_t pending = pending_src;
+	map_t active = active_src;
+	suite.benchmark(
+			"fea::flat_unsigned_hashmap find, copy, erase & insert", [&]() {
+				for (size_t k : pending_keys) {
+					if (active.contains(k)) {
+						continue;
+					}
+					auto it = pending.find(k);
+					active.insert(k, *it);
+					pending.erase(k);
+				}
+			});
+	size_t size = active.size() + pending.size();
+
+	pending = pending_src;
+	active = active_src;
+	suite.benchmark("fea::flat_unsigned_hashmap extract & insert", [&]() {
+		for (size_t k : pending_keys) {
+			if (active.contains(k)) {
+				continue;
+			}
+			active.insert(pending.extract(k));
+		}
+	});
+	size += active.size() + pending.size();
+
+	pending = pending_src;
+	active = active_src;
+	suite.benchmark("fea::flat_unsigned_hashmap merge",
+			[&]() { active.merge(pending); });
+	size += active.size() + pending.size();
+
+	suite.print();
+	suite.clear();
+
+	printf("%zu\n", size);
+}
+
+
+void snapshot_benchmarks() {
+	using map_t = fea::flat_unsigned_hashmap<size_t, small_obj>;
+	map_t src;
+	for (size_t i = 0; i < num_keys; ++i) {
+		src.insert(i, small_obj{});
+	}
+
+	std::array<char, 128> title;
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"Snapshot a map of %zu small objects", src.size());
+
+	fea::bench::suite suite;
+	suite.title(title.data());
+
+	fea::cow_unsigned_map<map_t> cow{ src };
+	size_t total = 0;
+	suite.benchmark("fea::flat_unsigned_hashmap copy ctor", [&]() {
+		map_t cpy(src);
+		total += cpy.size();
+	});
+	suite.benchmark("fea::cow_unsigned_map snapshot", [&]() {
+		fea::cow_unsigned_map<map_t> snap = cow.snapshot();
+		total += snap.size();
+	});
+
+	// The first write pays for the copy, the next ones don't.
+	fea::cow_unsigned_map<map_t> snap = cow.snapshot();
+	suite.benchmark("fea::cow_unsigned_map snapshot, then 1 write", [&]() {
+		snap = cow.snapshot();
+		cow.write().at(0).x += 1.f;
+	});
+	suite.benchmark("fea::cow_unsigned_map snapshot, then all writes", [&]() {
+		snap = cow.snapshot();
+		for (size_t k = 0; k < num_keys; ++k) {
+			cow.write().at(k).x += 1.f;
+		}
+	});
+	suite.print();
+	suite.clear();
+
+	printf("%zu\n", total + size_t(snap.at(0).x));
+}
+
+
+void static_map_benchmarks(bool dense) {
+	constexpr size_t count = 64;
+	std::random_device rd{};
+	std::mt19937 gen{ rd() };
+
+	// Enum like ids with a few holes, or sparse handles.
+	std::array<std::pair<uint32_t, uint32_t>, count> kvs{};
+	std::unordered_map<uint32_t, uint32_t> unique;
+	for (size_t i = 0; i < count; ++i) {
+		uint32_t k = dense ? uint32_t(i + i / 4) : gen();
+		while (!unique.insert({ k, uint32_t(i) }).second) {
+			k = gen();
+		}
+		kvs[i] = { k, uint32_t(i) };
+	}
+
+	std::vector<uint32_t> keys;
+	std::vector<uint32_t> values;
+	for (const auto& kv : kvs) {
+		keys.push_back(kv.first);
+		values.push_back(kv.second);
+	}
+
+	fea::static_unsigned_map<uint32_t, uint32_t, count> static_map{ kvs };
+	fea::perfect_unsigned_hashmap<uint32_t, uint32_t> perfect_map{
+		keys.data(), values.data(), keys.size()
+	};
+	fea::flat_unsigned_hashmap<uint32_t, uint32_t> map;
+	for (const auto& kv : kvs) {
+		map.insert(kv.first, kv.second);
+	}
+
+	std::vector<uint32_t> lookups;
+	lookups.reserve(num_keys);
+	std::uniform_int_distribution<size_t> dis{ 0, count - 1 };
+	for (size_t i = 0; i < num_keys; ++i) {
+		lookups.push_back(keys[dis(gen)]);
+	}
+
+	std::array<char, 128> title;
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"Find %zu random keys in %zu %s keys", lookups.size(), count,
+			dense ? "dense" : "sparse");
+
+	fea::bench::suite suite;
+	suite.title(title.data());
+
+	// Sink, so the lookups aren't optimized away.
+	size_t total = 0;
+	suite.benchmark("fea::flat_unsigned_hashmap find", [&]() {
+		for (uint32_t k : lookups) {
+			total += *map.find(k);
+		}
+	});
+	suite.benchmark("fea::perfect_unsigned_hashmap find", [&]() {
+		for (uint32_t k : lookups) {
+			total += *perfect_map.find(k);
+		}
+	});
+	suite.benchmark("fea::static_unsigned_map find", [&]() {
+		for (uint32_t k : lookups) {
+			total += static_map.find(k)->second;
+		}
+	});
+	suite.benchmark("fea::static_unsigned_map at_unchecked", [&]() {
+		for (uint32_t k : lookups) {
+			total += static_map.at_unchecked(k);
+		}
+	});
+	suite.print();
+	suite.clear();
+
+	printf("%zu\n", total);
+}
+
+
+void compact_benchmarks() {
+	constexpr size_t key_span = num_keys * 2;
+	std::random_device rd{};
+	std::mt19937_64 gen{ rd() };
+	std::uniform_int_distribution<size_t> dis{ 0, key_span - 1 };
+
+	// Random inserts and erases scatter neighbouring keys across the values.
+	using map_t = fea::flat_unsigned_hashmap<size_t, small_obj>;
+	map_t src;
+	src.reserve(num_keys);
+	while (src.size() < num_keys) {
+		src.insert(dis(gen), small_obj{});
+	}
+	for (size_t i = 0; i < num_keys / 2; ++i) {
+		src.erase(dis(gen));
+		src.insert(dis(gen), small_obj{});
+	}
+
+	std::array<char, 128> title;
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"Find %zu neighbouring keys, before and after compact",
+			src.size());
+
+	fea::bench::suite suite;
+	suite.title(title.data());
+
+	size_t total = 0;
+	auto find_all = [&](const map_t& map) {
+		for (size_t k = 0; k < key_span; ++k) {
+			auto it = map.find(k);
+			if (it != map.end()) {
+				total += k + size_t(it->x);
+			}
+		}
+	};
+
+	map_t map = src;
+	suite.benchmark("fea::flat_unsigned_hashmap find, scattered",
+			[&]() { find_all(map); });
+	suite.benchmark("fea::flat_unsigned_hashmap compact(key_order)",
+			[&]() { map.compact(fea::key_order); });
+	suite.benchmark("fea::flat_unsigned_hashmap find, key order",
+			[&]() { find_all(map); });
+
+	map = src;
+	suite.benchmark("fea::flat_unsigned_hashmap compact(hash_order)",
+			[&]() { map.compact(fea::hash_order); });
+	suite.benchmark("fea::flat_unsigned_hashmap find, hash order",
+			[&]() { find_all(map); });
+
+	map = src;
+	suite.benchmark("fea::flat_unsigned_hashmap incremental compact", [&]() {
+		map_t::compact_cursor cursor;
+		while (!map.compact(fea::key_order, cursor, 1'000)) {
+		}
+	});
+	suite.print();
+	suite.clear();
+
+	printf("%zu\n", total);
+}
+
+
+void column_benchmarks() {
+	constexpr size_t count = num_keys / 10;
+	std::random_device rd{};
+	std::mt19937_64 gen{ rd() };
+	std::uniform_int_distribution<size_t> dis{ 0, count * 4 };
+
+	// 200 bytes per value, of which the hot loops read 16.
+	struct hot_obj {
+		float x{ 1 };
+		float y{ 1 };
+		float z{ 1 };
+		float w{ 1 };
+	};
+	struct cold_obj {
+		std::array<char, 184> data{};
+	};
+	struct big_obj {
+		hot_obj hot;
+		cold_obj cold;
+	};
+
+	std::vector<size_t> keys;
+	keys.reserve(count);
+	for (size_t i = 0; i < count; ++i) {
+		keys.push_back(dis(gen));
+	}
+
+	std::array<char, 128> title;
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"%zu keys, 200 byte values with 16 hot bytes", count);
+
+	fea::bench::suite suite;
+	suite.title(title.data());
+
+	fea::flat_unsigned_hashmap<size_t, big_obj> map;
+	fea::flat_unsigned_column_hashmap<size_t, hot_obj, cold_obj> col_map;
+	suite.benchmark("fea::flat_unsigned_hashmap insert", [&]() {
+		for (size_t k : keys) {
+			map.insert(k, big_obj{});
+		}
+	});
+	suite.benchmark("fea::flat_unsigned_column_hashmap insert", [&]() {
+		for (size_t k : keys) {
+			col_map.insert(k, hot_obj{}, cold_obj{});
+		}
+	});
+	suite.print();
+	suite.clear();
+
+	// Sink, so the loops aren't optimized away.
+	float total = 0.f;
+	suite.benchmark("fea::flat_unsigned_hashmap iterate hot fields", [&]() {
+		for (size_t i = 0; i < 10; ++i) {
+			for (const big_obj& v : map) {
+				total += v.hot.x + v.hot.w;
+			}
+		}
+	});
+	suite.benchmark(
+			"fea::flat_unsigned_column_hashmap iterate hot column", [&]() {
+				for (size_t i = 0; i < 10; ++i) {
+					for (const hot_obj& v : col_map.column<0>()) {
+						total += v.x + v.w;
+					}
+				}
+			});
+	suite.print();
+	suite.clear();
+
+	suite.benchmark("fea::flat_unsigned_hashmap find hot fields", [&]() {
+		for (size_t k : keys) {
+			total += map.at_unchecked(k).hot.x;
+		}
+	});
+	suite.benchmark("fea::flat_unsigned_column_hashmap find hot column",
+			[&]() {
+				for (size_t k : keys) {
+					total += col_map.at_unchecked<0>(k).x;
+				}
+			});
+	suite.print();
+	suite.clear();
+
+	suite.benchmark("fea::flat_unsigned_hashmap erase", [&]() {
+		for (size_t k : keys) {
+			map.erase(k);
+		}
+	});
+	suite.benchmark("fea::flat_unsigned_column_hashmap erase", [&]() {
+		for (size_t k : keys) {
+			col_map.erase(k);
+		}
+	});
+	suite.print();
+	suite.clear();
+
+	printf("%f\n", total);
+}
+
 
 TEST(flat_unsigned_hashmap, benchmarks) {
 	srand(static_cast<unsigned int>(
@@ -530,6 +1330,53 @@ TEST(flat_unsigned_hashmap, benchmarks) {
 
 		benchmarks(keys);
 	}
+
+	printf("\n\n");
+	fea::bench::title("Benchmark using short-lived maps");
+	short_lived_benchmarks();
+
+	printf("\n\n");
+	fea::bench::title("Benchmark using huge pages");
+	huge_page_benchmarks();
+
+	printf("\n\n");
+	fea::bench::title("Benchmark using a frozen map");
+	frozen_benchmarks();
+
+	printf("\n\n");
+	fea::bench::title("Benchmark using a minimal perfect hash");
+	perfect_hash_benchmarks(16);
+	perfect_hash_benchmarks(100'000);
+	perfect_hash_benchmarks(num_keys);
+
+	printf("\n\n");
+	fea::bench::title("Benchmark using a static map");
+	static_map_benchmarks(true);
+	static_map_benchmarks(false);
+
+	printf("\n\n");
+	fea::bench::title("Benchmark using key / value iterators");
+	kv_iteration_benchmarks();
+
+	printf("\n\n");
+	fea::bench::title("Benchmark incrementing counters");
+	increment_benchmarks();
+
+	printf("\n\n");
+	fea::bench::title("Benchmark moving entries between maps");
+	merge_benchmarks();
+
+	printf("\n\n");
+	fea::bench::title("Benchmark copy-on-write snapshots");
+	snapshot_benchmarks();
+
+	printf("\n\n");
+	fea::bench::title("Benchmark compact");
+	compact_benchmarks();
+
+	printf("\n\n");
+	fea::bench::title("Benchmark hot / cold columns");
+	column_benchmarks();
 }
 } // namespace
 
@@ -2,10 +2,15 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <cstdio>
 #include <fea_benchmark/fea_benchmark.hpp>
+#include <fea_unsigned_map/fea_cow_unsigned_map.hpp>
+#include <fea_unsigned_map/fea_huge_page_allocator.hpp>
 #include <fea_unsigned_map/fea_unsigned_map.hpp>
+#include <fea_unsigned_map/fea_unsigned_map_view.hpp>
 #include <gtest/gtest.h>
+#include <limits>
 #include <map>
 #include <random>
 #include <string>
@@ -46,6 +51,24 @@ struct big_obj {
 	std::array<uint8_t, 1024> data{};
 };
 
+// Prints the heap memory of a map, per internal buffer.
+template <class Map>
+void print_memory_usage(const char* name, const Map& map) {
+	auto mb = [](size_t bytes) { return double(bytes) / (1024.0 * 1024.0); };
+	auto usage = map.memory_usage();
+
+	printf("%s memory usage\n", name);
+	printf("%-20s%15s%15s\n", "buffer", "used (MB)", "reserved (MB)");
+	printf("%-20s%15.3f%15.3f\n", "value_indexes", mb(usage.value_indexes.used),
+			mb(usage.value_indexes.reserved));
+	printf("%-20s%15.3f%15.3f\n", "values", mb(usage.values.used),
+			mb(usage.values.reserved));
+	printf("%-20s%15.3f%15.3f\n", "total", mb(usage.used()),
+			mb(usage.reserved()));
+	printf("%-20s%15.3f%15.3f\n\n", "bytes per element",
+			usage.used_per_element(), usage.reserved_per_element());
+}
+
 void benchmarks(const std::vector<size_t>& keys) {
 	std::array<char, 128> title;
 	title.fill('\0');
@@ -84,6 +107,9 @@ void benchmarks(const std::vector<size_t>& keys) {
 		unsigned_map_big.insert({ keys[i], {} });
 	}
 	printf("Num unique keys : %zu\n\n", map_small.size());
+
+	print_memory_usage("fea::unsigned_map small objects", unsigned_map_small);
+	print_memory_usage("fea::unsigned_map big objects", unsigned_map_big);
 	// printf("%zu\n", unordered_map_small.size());
 	// printf("%zu\n", unsigned_map_small.size());
 
@@ -131,6 +157,37 @@ void benchmarks(const std::vector<size_t>& keys) {
 	suite.clear();
 
 
+	// Bench : range ctor
+	{
+		std::vector<std::pair<size_t, small_obj>> kvs;
+		kvs.reserve(keys.size());
+		for (size_t i = 0; i < keys.size(); ++i) {
+			kvs.push_back({ keys[i], { float(i), float(i), float(i) } });
+		}
+
+		title.fill('\0');
+		std::snprintf(title.data(), title.size(),
+				"Range ctor %zu small objects", kvs.size());
+		suite.title(title.data());
+
+		suite.benchmark("std::map range ctor", [&]() {
+			std::map<size_t, small_obj> m(kvs.begin(), kvs.end());
+		});
+		suite.benchmark("std::unordered_map range ctor", [&]() {
+			std::unordered_map<size_t, small_obj> m(kvs.begin(), kvs.end());
+		});
+		suite.benchmark("fea::unsigned_map range ctor", [&]() {
+			fea::unsigned_map<size_t, small_obj> m(kvs.begin(), kvs.end());
+		});
+		suite.benchmark("fea::unsigned_map multithreaded range ctor", [&]() {
+			fea::unsigned_map<size_t, small_obj> m(
+					fea::multithreaded, kvs.begin(), kvs.end());
+		});
+		suite.print();
+		suite.clear();
+	}
+
+
 	// Bench : clear small
 	title.fill('\0');
 	std::snprintf(title.data(), title.size(), "Clear %zu small objects",
@@ -160,6 +217,57 @@ void benchmarks(const std::vector<size_t>& keys) {
 	suite.clear();
 
 
+	// Bench : clear and refill small_obj
+	{
+		constexpr size_t num_cycles = 10;
+
+		std::unordered_map<size_t, small_obj> unordered_map_refill;
+		fea::unsigned_map<size_t, small_obj> unsigned_map_refill;
+		fea::unsigned_map<size_t, small_obj, fea::epoch_indexes>
+				epoch_map_refill;
+
+		for (size_t i = 0; i < keys.size(); ++i) {
+			unordered_map_refill.insert({ keys[i], {} });
+			unsigned_map_refill.insert({ keys[i], {} });
+			epoch_map_refill.insert({ keys[i], {} });
+		}
+
+		title.fill('\0');
+		std::snprintf(title.data(), title.size(),
+				"Clear and refill %zu small objects %zu times", keys.size(),
+				num_cycles);
+		suite.title(title.data());
+
+		suite.benchmark("std::unordered_map clear & refill", [&]() {
+			for (size_t c = 0; c < num_cycles; ++c) {
+				unordered_map_refill.clear();
+				for (size_t i = 0; i < keys.size(); ++i) {
+					unordered_map_refill.insert({ keys[i], {} });
+				}
+			}
+		});
+		suite.benchmark("fea::unsigned_map clear & refill", [&]() {
+			for (size_t c = 0; c < num_cycles; ++c) {
+				unsigned_map_refill.clear();
+				for (size_t i = 0; i < keys.size(); ++i) {
+					unsigned_map_refill.insert({ keys[i], {} });
+				}
+			}
+		});
+		suite.benchmark(
+				"fea::unsigned_map epoch_indexes clear & refill", [&]() {
+					for (size_t c = 0; c < num_cycles; ++c) {
+						epoch_map_refill.clear();
+						for (size_t i = 0; i < keys.size(); ++i) {
+							epoch_map_refill.insert({ keys[i], {} });
+						}
+					}
+				});
+		suite.print();
+		suite.clear();
+	}
+
+
 	// Bench : insert small_obj
 	title.fill('\0');
 	std::snprintf(title.data(), title.size(), "Insert %zu small objects",
@@ -448,6 +556,621 @@ void benchmarks(const std::vector<size_t>& keys) {
 }
 
 
+// Random lookups in a big map, with and without huge page backed tables.
+void huge_page_benchmarks() {
+	std::random_device rd{};
+	std::mt19937_64 gen{ rd() };
+	std::uniform_int_distribution<size_t> dis{ 0, num_keys * 4 };
+
+	std::vector<size_t> keys;
+	keys.reserve(num_keys);
+	for (size_t i = 0; i < num_keys; ++i) {
+		keys.push_back(dis(gen));
+	}
+
+	fea::unsigned_map<size_t, small_obj> map;
+	fea::unsigned_map<size_t, small_obj, fea::sentinel_indexes,
+			fea::huge_page_allocator<std::pair<size_t, small_obj>>> huge_map;
+	for (size_t i = 0; i < keys.size(); ++i) {
+		map.insert({ keys[i], { float(i), 0.f, 0.f } });
+	}
+	for (size_t i = 0; i < keys.size(); ++i) {
+		huge_map.insert({ keys[i], { float(i), 0.f, 0.f } });
+	}
+	std::shuffle(keys.begin(), keys.end(), gen);
+
+	std::array<char, 128> title;
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"Find %zu random keys in %zu small objects", keys.size(),
+			map.size());
+
+	fea::bench::suite suite;
+	suite.title(title.data());
+
+	// Sink, so the lookups aren't optimized away.
+	float total = 0.f;
+	suite.benchmark("fea::unsigned_map find", [&]() {
+		for (size_t i = 0; i < keys.size(); ++i) {
+			auto it = map.find(keys[i]);
+			total += it->second.x;
+		}
+	});
+	suite.benchmark("fea::unsigned_map huge_page_allocator find", [&]() {
+		for (size_t i = 0; i < keys.size(); ++i) {
+			auto it = huge_map.find(keys[i]);
+			total += it->second.x;
+		}
+	});
+	suite.print();
+	suite.clear();
+
+	printf("%f\n", total);
+}
+
+
+// Inserts big objects one at a time, returns the slowest insert in ms.
+template <class Map>
+double insert_big_objs(Map& map, size_t count) {
+	double slowest = 0.0;
+	for (size_t i = 0; i < count; ++i) {
+		auto start = std::chrono::steady_clock::now();
+		map.insert({ i, {} });
+		std::chrono::duration<double, std::milli> elapsed
+				= std::chrono::steady_clock::now() - start;
+		slowest = (std::max)(slowest, elapsed.count());
+	}
+	return slowest;
+}
+
+// Growth copies every big_obj with contiguous values, never with chunked
+// values.
+void chunked_values_benchmarks() {
+	using chunked_map_t = fea::unsigned_map<size_t, big_obj,
+			fea::sentinel_indexes, std::allocator<std::pair<size_t, big_obj>>,
+			fea::chunked_values<256>>;
+	constexpr size_t count = num_keys / 25;
+
+	std::array<char, 128> title;
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"Insert %zu big objects without reserve", count);
+
+	fea::bench::suite suite;
+	suite.title(title.data());
+
+	double slowest = 0.0;
+	double chunked_slowest = 0.0;
+	suite.benchmark("fea::unsigned_map insert", [&]() {
+		fea::unsigned_map<size_t, big_obj> map;
+		slowest = insert_big_objs(map, count);
+	});
+	suite.benchmark("fea::unsigned_map chunked_values insert", [&]() {
+		chunked_map_t map;
+		chunked_slowest = insert_big_objs(map, count);
+	});
+	suite.print();
+	suite.clear();
+
+	printf("slowest insert : %f ms\n", slowest);
+	printf("slowest insert, chunked_values : %f ms\n\n", chunked_slowest);
+
+	using pair_t = std::pair<size_t, small_obj>;
+	fea::unsigned_map<size_t, small_obj> map;
+	fea::unsigned_map<size_t, small_obj, fea::sentinel_indexes,
+			std::allocator<pair_t>, fea::chunked_values<>>
+			chunked_map;
+	for (size_t i = 0; i < num_keys; ++i) {
+		map.insert({ i, { float(i), 0.f, 0.f } });
+		chunked_map.insert({ i, { float(i), 0.f, 0.f } });
+	}
+
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"Iterate %zu small objects", map.size());
+	suite.title(title.data());
+
+	// Sink, so the loops aren't optimized away.
+	float total = 0.f;
+	suite.benchmark("fea::unsigned_map iterate", [&]() {
+		for (const auto& kv : map) {
+			total += kv.second.x;
+		}
+	});
+	suite.benchmark("fea::unsigned_map chunked_values iterate", [&]() {
+		for (const auto& kv : chunked_map) {
+			total += kv.second.x;
+		}
+	});
+	suite.benchmark("fea::unsigned_map chunked_values iterate_chunks", [&]() {
+		chunked_map.iterate_chunks([&](const pair_t* f, const pair_t* l) {
+			for (; f != l; ++f) {
+				total += f->second.x;
+			}
+		});
+	});
+	suite.print();
+	suite.clear();
+
+	printf("%f\n", total);
+}
+
+
+// Reloading a saved map versus rebuilding it.
+void view_benchmarks() {
+	using pair_t = std::pair<size_t, small_obj>;
+	const char* path = "fea_unsigned_map_benchmark.bin";
+
+	std::random_device rd{};
+	std::mt19937_64 gen{ rd() };
+	std::uniform_int_distribution<size_t> dis{ 0, num_keys * 4 };
+
+	std::vector<pair_t> kvs;
+	kvs.reserve(num_keys);
+	for (size_t i = 0; i < num_keys; ++i) {
+		kvs.push_back({ dis(gen), { float(i), 0.f, 0.f } });
+	}
+
+	fea::unsigned_map<size_t, small_obj> map{ kvs.begin(), kvs.end() };
+	map.save(path);
+
+	std::vector<size_t> keys;
+	keys.reserve(map.size());
+	for (const pair_t& kv : map) {
+		keys.push_back(kv.first);
+	}
+	std::shuffle(keys.begin(), keys.end(), gen);
+
+	std::array<char, 128> title;
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"Load %zu small objects and find every key", map.size());
+
+	fea::bench::suite suite;
+	suite.title(title.data());
+
+	// Sink, so the lookups aren't optimized away.
+	float total = 0.f;
+	suite.benchmark("fea::unsigned_map rebuild", [&]() {
+		fea::unsigned_map<size_t, small_obj> loaded{ kvs.begin(), kvs.end() };
+		for (size_t k : keys) {
+			total += loaded.at_unchecked(k).x;
+		}
+	});
+	suite.benchmark("fea::unsigned_map save", [&]() { map.save(path); });
+	suite.benchmark("fea::unsigned_map_view open", [&]() {
+		fea::unsigned_map_view<size_t, small_obj> view{ path };
+		for (size_t k : keys) {
+			total += view.at_unchecked(k).x;
+		}
+	});
+	suite.print();
+	suite.clear();
+
+	std::remove(path);
+	printf("%f\n", total);
+}
+
+
+void gather_scatter_benchmarks() {
+	std::random_device rd{};
+	std::mt19937_64 gen{ rd() };
+
+	fea::unsigned_map<size_t, small_obj> map;
+	map.reserve(num_keys);
+	for (size_t i = 0; i < num_keys; ++i) {
+		map.insert({ i, { float(i), 0.f, 0.f } });
+	}
+
+	// A tick's worth of random bodies, every key exists.
+	std::uniform_int_distribution<size_t> dis{ 0, num_keys - 1 };
+	std::vector<size_t> keys;
+	keys.reserve(num_keys / 2);
+	for (size_t i = 0; i < num_keys / 2; ++i) {
+		keys.push_back(dis(gen));
+	}
+	std::vector<small_obj> objs(keys.size());
+
+	std::array<char, 128> title;
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"Read and write %zu random small objects by key", keys.size());
+
+	fea::bench::suite suite;
+	suite.title(title.data());
+
+	suite.benchmark("fea::unsigned_map find", [&]() {
+		for (size_t i = 0; i < keys.size(); ++i) {
+			objs[i] = map.find(keys[i])->second;
+		}
+	});
+	suite.benchmark("fea::unsigned_map at_unchecked", [&]() {
+		for (size_t i = 0; i < keys.size(); ++i) {
+			objs[i] = map.at_unchecked(keys[i]);
+		}
+	});
+	suite.benchmark("fea::unsigned_map gather", [&]() {
+		map.gather(keys.data(), keys.size(), objs.data());
+	});
+	suite.benchmark("fea::unsigned_map operator[]", [&]() {
+		for (size_t i = 0; i < keys.size(); ++i) {
+			map[keys[i]] = objs[i];
+		}
+	});
+	suite.benchmark("fea::unsigned_map at_unchecked assign", [&]() {
+		for (size_t i = 0; i < keys.size(); ++i) {
+			map.at_unchecked(keys[i]) = objs[i];
+		}
+	});
+	suite.benchmark("fea::unsigned_map scatter", [&]() {
+		map.scatter(keys.data(), keys.size(), objs.data());
+	});
+	suite.print();
+	suite.clear();
+
+	float total = 0.f;
+	for (const small_obj& o : objs) {
+		total += o.x;
+	}
+	printf("%f\n", total);
+}
+
+
+void increment_benchmarks() {
+	std::random_device rd{};
+	std::mt19937_64 gen{ rd() };
+	std::uniform_int_distribution<size_t> dis{ 0, num_keys / 8 };
+
+	// Counter accumulation, many increments per key.
+	std::vector<size_t> keys;
+	keys.reserve(num_keys);
+	for (size_t i = 0; i < num_keys; ++i) {
+		keys.push_back(dis(gen));
+	}
+
+	std::array<char, 128> title;
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"Increment %zu counters by key, %zu unique keys", keys.size(),
+			num_keys / 8);
+
+	fea::bench::suite suite;
+	suite.title(title.data());
+
+	std::unordered_map<size_t, size_t> unordered_map;
+	fea::unsigned_map<size_t, size_t> find_map;
+	fea::unsigned_map<size_t, size_t> subscript_map;
+	fea::unsigned_map<size_t, size_t> compute_map;
+	suite.benchmark("std::unordered_map operator[]", [&]() {
+		for (size_t k : keys) {
+			++unordered_map[k];
+		}
+	});
+	suite.benchmark("fea::unsigned_map find & insert", [&]() {
+		auto& map = find_map;
+		for (size_t k : keys) {
+			auto it = map.find(k);
+			if (it == map.end()) {
+				map.insert({ k, 1 });
+			} else {
+				++it->second;
+			}
+		}
+	});
+	suite.benchmark("fea::unsigned_map operator[]", [&]() {
+		for (size_t k : keys) {
+			++subscript_map[k];
+		}
+	});
+	suite.benchmark("fea::unsigned_map compute", [&]() {
+		for (size_t k : keys) {
+			compute_map.compute(k, [](size_t& c) { ++c; });
+		}
+	});
+	suite.print();
+	suite.clear();
+
+	printf("%zu\n", compute_map.size() + subscript_map.size());
+}
+
+
+void merge_benchmarks() {
+	constexpr size_t count = num_keys / 10;
+	std::random_device rd{};
+	std::mt19937_64 gen{ rd() };
+	std::uniform_int_distribution<size_t> dis{ 0, count * 4 };
+
+	// Heap allocated values, so copies aren't free.
+	using map_t = fea::unsigned_map<size_t, std::string>;
+	map_t pending_src;
+	map_t active_src;
+	std::vector<size_t> pending_keys;
+	const std::string value(64, 'a');
+	for (map_t* m : { &pending_src, &active_src }) {
+		map_t& map = *m;
+		while (map.size() < count) {
+			size_t k = dis(gen);
+			map.insert({ k, value });
+		}
+	}
+	for (const auto& kv : pending_src) {
+		pending_keys.push_back(kv.first);
+	}
+
+	std::array<char, 128> title;
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"Move %zu entries to a map of %zu entries", count, count);
+
+	fea::bench::suite suite;
+	suite.title(title.data());
+
+	map_t pending = pending_src;
+	map_t active = active_src;
+	suite.benchmark("fea::unsigned_map find, copy, erase & insert", [&]() {
+		for (size_t k : pending_keys) {
+			if (active.contains(k)) {
+				continue;
+			}
+			auto it = pending.find(k);
+			active.insert({ k, it->second });
+			pending.erase(k);
+		}
+	});
+	size_t size = active.size() + pending.size();
+
+	pending = pending_src;
+	active = active_src;
+	suite.benchmark("fea::unsigned_map extract & insert", [&]() {
+		for (size_t k : pending_keys) {
+			if (active.contains(k)) {
+				continue;
+			}
+			active.insert(pending.extract(k));
+		}
+	});
+	size += active.size() + pending.size();
+
+	pending = pending_src;
+	active = active_src;
+	suite.benchmark(
+			"fea::unsigned_map merge", [&]() { active.merge(pending); });
+	size += active.size() + pending.size();
+
+	suite.print();
+	suite.clear();
+
+	printf("%zu\n", size);
+}
+
+
+void snapshot_benchmarks() {
+	using map_t = fea::unsigned_map<size_t, small_obj>;
+	map_t src;
+	for (size_t i = 0; i < num_keys; ++i) {
+		src.insert({ i, small_obj{} });
+	}
+
+	std::array<char, 128> title;
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"Snapshot a map of %zu small objects", src.size());
+
+	fea::bench::suite suite;
+	suite.title(title.data());
+
+	fea::cow_unsigned_map<map_t> cow{ src };
+	size_t total = 0;
+	suite.benchmark("fea::unsigned_map copy ctor", [&]() {
+		map_t cpy(src);
+		total += cpy.size();
+	});
+	suite.benchmark("fea::cow_unsigned_map snapshot", [&]() {
+		fea::cow_unsigned_map<map_t> snap = cow.snapshot();
+		total += snap.size();
+	});
+
+	// The first write pays for the copy, the next ones don't.
+	fea::cow_unsigned_map<map_t> snap = cow.snapshot();
+	suite.benchmark("fea::cow_unsigned_map snapshot, then 1 write", [&]() {
+		snap = cow.snapshot();
+		cow.write().at(0).x += 1.f;
+	});
+	suite.benchmark("fea::cow_unsigned_map snapshot, then all writes", [&]() {
+		snap = cow.snapshot();
+		for (size_t k = 0; k < num_keys; ++k) {
+			cow.write().at(k).x += 1.f;
+		}
+	});
+	suite.print();
+	suite.clear();
+
+	printf("%zu\n", total + size_t(snap.at(0).x));
+}
+
+
+void ordered_benchmarks(size_t key_span) {
+	std::random_device rd{};
+	std::mt19937_64 gen{ rd() };
+	std::uniform_int_distribution<size_t> dis{ 0, key_span - 1 };
+
+	fea::unsigned_map<size_t, small_obj> map;
+	map.reserve(num_keys);
+	while (map.size() < num_keys) {
+		map.insert({ dis(gen), small_obj{} });
+	}
+
+	std::array<char, 128> title;
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"Iterate %zu keys in order, key span %zu", map.size(), key_span);
+
+	fea::bench::suite suite;
+	suite.title(title.data());
+
+	size_t total = 0;
+	suite.benchmark("std::vector copy & sort", [&]() {
+		std::vector<std::pair<size_t, small_obj>> sorted(
+				map.begin(), map.end());
+		std::sort(sorted.begin(), sorted.end(),
+				[](const auto& lhs, const auto& rhs) {
+					return lhs.first < rhs.first;
+				});
+		for (const auto& kv : sorted) {
+			total += kv.first + size_t(kv.second.x);
+		}
+	});
+	suite.benchmark("fea::unsigned_map contains() on every key", [&]() {
+		for (size_t k = 0; k < key_span; ++k) {
+			if (map.contains(k)) {
+				total += k + size_t(map.at_unchecked(k).x);
+			}
+		}
+	});
+	suite.benchmark("fea::unsigned_map for_each_ordered", [&]() {
+		map.for_each_ordered([&](const std::pair<size_t, small_obj>& kv) {
+			total += kv.first + size_t(kv.second.x);
+		});
+	});
+	suite.benchmark("fea::unsigned_map ordered iterators", [&]() {
+		for (const auto& kv : map.ordered()) {
+			total += kv.first + size_t(kv.second.x);
+		}
+	});
+	suite.benchmark("fea::unsigned_map 1000 range() of 0.1%", [&]() {
+		size_t width = key_span / 1'000;
+		for (size_t i = 0; i < 1'000; ++i) {
+			for (const auto& kv : map.range(i * width, (i + 1) * width)) {
+				total += kv.first + size_t(kv.second.x);
+			}
+		}
+	});
+	suite.print();
+	suite.clear();
+
+	printf("%zu\n", total);
+}
+
+
+template <class Key>
+void small_key_benchmarks() {
+	constexpr size_t key_space = size_t((std::numeric_limits<Key>::max)()) + 1;
+
+	std::random_device rd{};
+	std::mt19937_64 gen{ rd() };
+	std::uniform_int_distribution<size_t> dis{ 0, key_space - 1 };
+
+	// Half the key space is present.
+	fea::unsigned_map<Key, small_obj> map;
+	fea::unsigned_map<uint32_t, small_obj> wide_map;
+	std::unordered_map<Key, small_obj> unordered_map;
+	for (size_t i = 0; i < key_space / 2; ++i) {
+		size_t k = dis(gen);
+		map.insert({ Key(k), { float(k), 0.f, 0.f } });
+		wide_map.insert({ uint32_t(k), { float(k), 0.f, 0.f } });
+		unordered_map.insert({ Key(k), { float(k), 0.f, 0.f } });
+	}
+
+	std::vector<Key> keys;
+	keys.reserve(num_keys);
+	for (size_t i = 0; i < num_keys; ++i) {
+		keys.push_back(Key(dis(gen)));
+	}
+
+	std::array<char, 128> title;
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"Find %zu random %zu bit keys, half are present", num_keys,
+			sizeof(Key) * 8);
+
+	fea::bench::suite suite;
+	suite.title(title.data());
+
+	// Sink, so the lookups aren't optimized away.
+	float total = 0.f;
+	suite.benchmark("std::unordered_map find", [&]() {
+		for (Key k : keys) {
+			auto it = unordered_map.find(k);
+			if (it != unordered_map.end()) {
+				total += it->second.x;
+			}
+		}
+	});
+	suite.benchmark("fea::unsigned_map 32 bit keys find", [&]() {
+		for (Key k : keys) {
+			auto it = wide_map.find(uint32_t(k));
+			if (it != wide_map.end()) {
+				total += it->second.x;
+			}
+		}
+	});
+	suite.benchmark("fea::unsigned_map find", [&]() {
+		for (Key k : keys) {
+			auto it = map.find(k);
+			if (it != map.end()) {
+				total += it->second.x;
+			}
+		}
+	});
+	suite.print();
+	suite.clear();
+
+	printf("%f\n", total);
+}
+
+
+void compact_benchmarks() {
+	constexpr size_t key_span = num_keys * 2;
+	std::random_device rd{};
+	std::mt19937_64 gen{ rd() };
+	std::uniform_int_distribution<size_t> dis{ 0, key_span - 1 };
+
+	// Random inserts and erases scatter neighbouring keys across the values.
+	fea::unsigned_map<size_t, small_obj> src;
+	src.reserve(num_keys);
+	while (src.size() < num_keys) {
+		src.insert({ dis(gen), small_obj{} });
+	}
+	for (size_t i = 0; i < num_keys / 2; ++i) {
+		src.erase(dis(gen));
+		src.insert({ dis(gen), small_obj{} });
+	}
+
+	std::array<char, 128> title;
+	title.fill('\0');
+	std::snprintf(title.data(), title.size(),
+			"Iterate %zu keys in order, before and after compact", src.size());
+
+	fea::bench::suite suite;
+	suite.title(title.data());
+
+	size_t total = 0;
+	fea::unsigned_map<size_t, small_obj> map = src;
+	suite.benchmark("fea::unsigned_map for_each_ordered, scattered", [&]() {
+		map.for_each_ordered([&](const std::pair<size_t, small_obj>& kv) {
+			total += kv.first + size_t(kv.second.x);
+		});
+	});
+	suite.benchmark("fea::unsigned_map compact", [&]() { map.compact(); });
+	suite.benchmark("fea::unsigned_map for_each_ordered, compacted", [&]() {
+		map.for_each_ordered([&](const std::pair<size_t, small_obj>& kv) {
+			total += kv.first + size_t(kv.second.x);
+		});
+	});
+
+	map = src;
+	suite.benchmark("fea::unsigned_map incremental compact", [&]() {
+		fea::unsigned_map<size_t, small_obj>::compact_cursor cursor;
+		while (!map.compact(cursor, 1'000)) {
+		}
+	});
+	suite.print();
+	suite.clear();
+
+	printf("%zu\n", total);
+}
+
+
 TEST(unsigned_map, benchmarks) {
 	srand(static_cast<unsigned int>(
 			std::chrono::system_clock::now().time_since_epoch().count()));
@@ -530,6 +1253,48 @@ TEST(unsigned_map, benchmarks) {
 
 		benchmarks(keys);
 	}
+
+	printf("\n\n");
+	fea::bench::title("Benchmark using huge pages");
+	huge_page_benchmarks();
+
+	printf("\n\n");
+	fea::bench::title("Benchmark using chunked values");
+	chunked_values_benchmarks();
+
+	printf("\n\n");
+	fea::bench::title("Benchmark using a saved map");
+	view_benchmarks();
+
+	printf("\n\n");
+	fea::bench::title("Benchmark using small keys");
+	small_key_benchmarks<uint8_t>();
+	small_key_benchmarks<uint16_t>();
+
+	printf("\n\n");
+	fea::bench::title("Benchmark using gather and scatter");
+	gather_scatter_benchmarks();
+
+	printf("\n\n");
+	fea::bench::title("Benchmark incrementing counters");
+	increment_benchmarks();
+
+	printf("\n\n");
+	fea::bench::title("Benchmark moving entries between maps");
+	merge_benchmarks();
+
+	printf("\n\n");
+	fea::bench::title("Benchmark copy-on-write snapshots");
+	snapshot_benchmarks();
+
+	printf("\n\n");
+	fea::bench::title("Benchmark ordered iteration");
+	ordered_benchmarks(num_keys * 2);
+	ordered_benchmarks(num_keys * 16);
+
+	printf("\n\n");
+	fea::bench::title("Benchmark compact");
+	compact_benchmarks();
 }
 } // namespace
 #endif // NDEBUG
@@ -0,0 +1,162 @@
+﻿#include <algorithm>
+#include <array>
+#include <fea_unsigned_map/fea_arena_allocator.hpp>
+#include <fea_unsigned_map/fea_chunked_vector.hpp>
+#include <gtest/gtest.h>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+namespace {
+TEST(chunked_vector, basics) {
+	using vec_t = fea::chunked_vector<std::string, 4>;
+
+	vec_t vec;
+	EXPECT_TRUE(vec.empty());
+	EXPECT_EQ(vec.capacity(), 0u);
+	EXPECT_EQ(vec.begin(), vec.end());
+
+	vec.reserve(5);
+	EXPECT_EQ(vec.capacity(), 8u);
+	vec.shrink_to_fit();
+	EXPECT_EQ(vec.capacity(), 0u);
+
+	// Growing never moves existing elements.
+	std::vector<const std::string*> addresses;
+	for (size_t i = 0; i < 21; ++i) {
+		vec.push_back(std::to_string(i));
+		addresses.push_back(&vec.back());
+	}
+	EXPECT_EQ(vec.size(), 21u);
+	EXPECT_EQ(vec.capacity(), 24u);
+	for (size_t i = 0; i < vec.size(); ++i) {
+		EXPECT_EQ(&vec[i], addresses[i]);
+		EXPECT_EQ(vec[i], std::to_string(i));
+	}
+
+	EXPECT_EQ(vec.end() - vec.begin(), 21);
+	EXPECT_EQ(*(vec.begin() + 9), "9");
+	EXPECT_EQ(vec.begin()[13], "13");
+	EXPECT_EQ(*vec.rbegin(), "20");
+	EXPECT_EQ(std::distance(vec.cbegin(), vec.cend()), 21);
+
+	vec_t::const_iterator cit = vec.begin();
+	EXPECT_TRUE(cit == vec.begin());
+	EXPECT_TRUE(vec.begin() < vec.end());
+
+	size_t i = 0;
+	for (const std::string& s : vec) {
+		EXPECT_EQ(s, std::to_string(i++));
+	}
+	EXPECT_EQ(i, 21u);
+
+	// Erase across chunks.
+	auto it = vec.erase(vec.begin() + 2, vec.begin() + 7);
+	EXPECT_EQ(*it, "7");
+	EXPECT_EQ(vec.size(), 16u);
+	EXPECT_EQ(vec[1], "1");
+	EXPECT_EQ(vec[2], "7");
+	EXPECT_EQ(vec.back(), "20");
+	EXPECT_EQ(&vec[0], addresses[0]);
+
+	it = vec.erase(vec.begin() + 3, vec.begin() + 3);
+	EXPECT_EQ(*it, "8");
+	EXPECT_EQ(vec.size(), 16u);
+
+	vec.pop_back();
+	EXPECT_EQ(vec.back(), "19");
+
+	vec.resize(3);
+	EXPECT_EQ(vec.size(), 3u);
+	vec.resize(6);
+	EXPECT_EQ(vec.size(), 6u);
+	EXPECT_EQ(vec[5], "");
+
+	vec.shrink_to_fit();
+	EXPECT_EQ(vec.capacity(), 8u);
+
+	vec.clear();
+	EXPECT_TRUE(vec.empty());
+	EXPECT_EQ(vec.capacity(), 8u);
+}
+
+TEST(chunked_vector, copy_move) {
+	using vec_t = fea::chunked_vector<std::unique_ptr<int>, 2>;
+	using copy_vec_t = fea::chunked_vector<int, 2>;
+
+	copy_vec_t vec1;
+	for (int i = 0; i < 7; ++i) {
+		vec1.push_back(i);
+	}
+
+	copy_vec_t vec2{ vec1 };
+	EXPECT_EQ(vec2.size(), 7u);
+	EXPECT_TRUE(std::equal(vec1.begin(), vec1.end(), vec2.begin()));
+
+	copy_vec_t vec3;
+	vec3.push_back(42);
+	vec3 = vec1;
+	EXPECT_TRUE(std::equal(vec1.begin(), vec1.end(), vec3.begin()));
+
+	const int* first = &vec3[0];
+	copy_vec_t vec4{ std::move(vec3) };
+	EXPECT_EQ(&vec4[0], first);
+	EXPECT_TRUE(vec3.empty());
+
+	vec3 = std::move(vec4);
+	EXPECT_EQ(&vec3[0], first);
+	EXPECT_EQ(vec3.size(), 7u);
+
+	vec3.swap(vec2);
+	EXPECT_EQ(&vec2[0], first);
+
+	vec_t ptrs;
+	for (int i = 0; i < 5; ++i) {
+		ptrs.emplace_back(std::make_unique<int>(i));
+	}
+	ptrs.erase(ptrs.begin(), ptrs.begin() + 1);
+	vec_t ptrs2 = std::move(ptrs);
+	EXPECT_EQ(ptrs2.size(), 4u);
+	EXPECT_EQ(*ptrs2.front(), 1);
+	EXPECT_EQ(*ptrs2.back(), 4);
+}
+
+TEST(chunked_vector, iterate_chunks) {
+	fea::chunked_vector<int, 8> vec;
+	size_t calls = 0;
+	vec.iterate_chunks([&](int*, int*) { ++calls; });
+	EXPECT_EQ(calls, 0u);
+
+	for (int i = 0; i < 20; ++i) {
+		vec.push_back(i);
+	}
+
+	std::vector<size_t> spans;
+	int sum = 0;
+	const auto& cvec = vec;
+	cvec.iterate_chunks([&](const int* first, const int* last) {
+		spans.push_back(size_t(last - first));
+		sum = std::accumulate(first, last, sum);
+	});
+	EXPECT_EQ(spans, (std::vector<size_t>{ 8, 8, 4 }));
+	EXPECT_EQ(sum, 190);
+}
+
+TEST(chunked_vector, allocator) {
+	std::array<char, 4'096> buf;
+	fea::monotonic_arena arena{ buf.data(), buf.size() };
+
+	using alloc_t = fea::arena_allocator<int>;
+	fea::chunked_vector<int, 16, alloc_t> vec{ alloc_t{ arena } };
+	for (int i = 0; i < 100; ++i) {
+		vec.push_back(i);
+	}
+	EXPECT_FALSE(arena.overflowed());
+	EXPECT_EQ(vec.get_allocator(), alloc_t{ arena });
+
+	fea::chunked_vector<int, 16, alloc_t> vec2{ vec };
+	EXPECT_EQ(vec2.size(), 100u);
+	EXPECT_EQ(vec2[99], 99);
+}
+} // namespace
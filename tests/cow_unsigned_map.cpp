@@ -0,0 +1,152 @@
+﻿#include <fea_unsigned_map/fea_cow_unsigned_map.hpp>
+#include <fea_unsigned_map/fea_flat_unsigned_hashmap.hpp>
+#include <fea_unsigned_map/fea_unsigned_map.hpp>
+#include <gtest/gtest.h>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+template <class Map, class Insert>
+void do_cow_test(Insert insert) {
+	using cow_t = fea::cow_unsigned_map<Map>;
+
+	cow_t map;
+	EXPECT_TRUE(map.empty());
+	EXPECT_FALSE(map.shared());
+	for (unsigned i = 0; i < 100; ++i) {
+		insert(map.write(), i, i * 2);
+	}
+	EXPECT_EQ(map.size(), 100u);
+	EXPECT_EQ(map.at(10), 20u);
+	EXPECT_NE(map.find(10), map.end());
+	EXPECT_EQ(map.find(100), map.end());
+	EXPECT_TRUE(map.contains(99));
+	EXPECT_EQ(map.count(100), 0u);
+
+	// Writing to an unshared map doesn't copy it.
+	const Map* addr = &map.get();
+	map.write().erase(99);
+	EXPECT_EQ(&map.get(), addr);
+
+	// Snapshots share the map.
+	cow_t snap = map.snapshot();
+	cow_t copy = map;
+	EXPECT_TRUE(map.shared());
+	EXPECT_EQ(map.use_count(), 3u);
+	EXPECT_EQ(&snap.get(), addr);
+	EXPECT_EQ(&copy.get(), addr);
+
+	// The first write copies, snapshots keep their version.
+	insert(map.write(), 1'000, 42);
+	EXPECT_NE(&map.get(), addr);
+	EXPECT_EQ(&snap.get(), addr);
+	EXPECT_FALSE(map.shared());
+	EXPECT_EQ(snap.use_count(), 2u);
+	EXPECT_EQ(map.size(), 100u);
+	EXPECT_EQ(snap.size(), 99u);
+	EXPECT_FALSE(snap.contains(1'000));
+	EXPECT_EQ(map.at(1'000), 42u);
+
+	const Map* new_addr = &map.get();
+	insert(map.write(), 1'001, 43);
+	EXPECT_EQ(&map.get(), new_addr);
+
+	// The last handle writes in place.
+	copy.write().erase(0);
+	EXPECT_NE(&copy.get(), addr);
+	EXPECT_EQ(&snap.get(), addr);
+	snap.write().erase(1);
+	EXPECT_EQ(&snap.get(), addr);
+	EXPECT_TRUE(map.contains(0));
+	EXPECT_TRUE(map.contains(1));
+	EXPECT_FALSE(copy.contains(0));
+	EXPECT_TRUE(copy.contains(1));
+
+	// Assignment and moves.
+	copy = map;
+	EXPECT_EQ(&copy.get(), &map.get());
+	EXPECT_EQ(map.use_count(), 2u);
+	cow_t moved = std::move(copy);
+	EXPECT_EQ(map.use_count(), 2u);
+	copy = std::move(moved);
+	moved = snap;
+	swap(moved, copy);
+	EXPECT_EQ(&moved.get(), &map.get());
+	EXPECT_EQ(&copy.get(), &snap.get());
+
+	cow_t from_map{ Map{ map.get() } };
+	EXPECT_EQ(from_map.size(), map.size());
+	EXPECT_FALSE(from_map.shared());
+
+	// Readers keep their snapshots while the map is written.
+	std::vector<std::thread> readers;
+	std::vector<size_t> sums(4, 0);
+	for (size_t t = 0; t < sums.size(); ++t) {
+		readers.emplace_back([snap = map.snapshot(), &sums, t]() {
+			for (unsigned i = 0; i < 99; ++i) {
+				sums[t] += snap.at(i);
+			}
+		});
+	}
+	for (unsigned i = 0; i < 99; ++i) {
+		map.write().at(i) = 0;
+	}
+	for (std::thread& t : readers) {
+		t.join();
+	}
+	for (size_t sum : sums) {
+		EXPECT_EQ(sum, 9'702u);
+	}
+	EXPECT_EQ(map.at(50), 0u);
+	EXPECT_FALSE(map.shared());
+}
+
+TEST(cow_unsigned_map, basics) {
+	do_cow_test<fea::unsigned_map<unsigned, unsigned>>(
+			[](fea::unsigned_map<unsigned, unsigned>& map, unsigned k,
+					unsigned v) { map.insert({ k, v }); });
+	do_cow_test<fea::flat_unsigned_hashmap<unsigned, unsigned>>(
+			[](fea::flat_unsigned_hashmap<unsigned, unsigned>& map,
+					unsigned k, unsigned v) { map.insert(k, v); });
+}
+
+TEST(cow_unsigned_map, moved_from) {
+	using cow_t = fea::cow_unsigned_map<fea::unsigned_map<unsigned, int>>;
+
+	cow_t map;
+	map.write().insert({ 1, 10 });
+	cow_t moved{ std::move(map) };
+	EXPECT_EQ(moved.at(1), 10);
+
+	// Reads as an empty map.
+	EXPECT_TRUE(map.empty());
+	EXPECT_EQ(map.size(), 0u);
+	EXPECT_FALSE(map.contains(1));
+	EXPECT_EQ(map.find(1), map.end());
+	EXPECT_FALSE(map.shared());
+	EXPECT_EQ(map.use_count(), 0u);
+
+	// Copies and snapshots are moved from too.
+	cow_t copy{ map };
+	EXPECT_TRUE(copy.empty());
+	cow_t snap = map.snapshot();
+	EXPECT_TRUE(snap.empty());
+	copy = map;
+	EXPECT_EQ(copy.use_count(), 0u);
+
+	// Writing gives it a new map.
+	map.write().insert({ 2, 20 });
+	EXPECT_EQ(map.at(2), 20);
+	EXPECT_EQ(map.use_count(), 1u);
+	EXPECT_TRUE(copy.empty());
+	EXPECT_FALSE(moved.contains(2));
+
+	moved = std::move(map);
+	EXPECT_EQ(moved.at(2), 20);
+	map = moved;
+	EXPECT_EQ(map.at(2), 20);
+	EXPECT_TRUE(map.shared());
+}
+} // namespace
@@ -0,0 +1,146 @@
+﻿#include <fea_unsigned_map/fea_flat_unsigned_column_hashmap.hpp>
+#include <gtest/gtest.h>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace {
+struct hot {
+	float x = 0.f;
+	float y = 0.f;
+};
+
+struct throws_on_copy {
+	throws_on_copy() = default;
+	throws_on_copy(const throws_on_copy&) {
+		throw std::runtime_error{ "" };
+	}
+	throws_on_copy(throws_on_copy&&) = default;
+	throws_on_copy& operator=(const throws_on_copy&) = default;
+	throws_on_copy& operator=(throws_on_copy&&) = default;
+};
+
+TEST(flat_unsigned_column_hashmap, basics) {
+	using map_t = fea::flat_unsigned_column_hashmap<unsigned, hot, std::string,
+			std::unique_ptr<unsigned>>;
+	static_assert(map_t::column_count() == 3, "");
+	static_assert(
+			std::is_same<map_t::column_type<1>, std::string>::value, "");
+
+	map_t map;
+	EXPECT_TRUE(map.empty());
+	EXPECT_EQ(map.index_of(0), 0u);
+	EXPECT_FALSE(map.contains(0));
+	EXPECT_THROW(map.at<0>(0), std::out_of_range);
+
+	for (unsigned i = 0; i < 100; ++i) {
+		auto ret = map.insert(i * 3, hot{ float(i), 0.f }, std::to_string(i),
+				std::make_unique<unsigned>(i));
+		EXPECT_TRUE(ret.second);
+		EXPECT_EQ(ret.first, i);
+	}
+	EXPECT_EQ(map.size(), 100u);
+	EXPECT_GE(map.capacity(), 100u);
+
+	// Existing keys keep their values.
+	auto ret = map.insert(
+			3, hot{}, std::string{}, std::make_unique<unsigned>(0));
+	EXPECT_FALSE(ret.second);
+	EXPECT_EQ(ret.first, 1u);
+	EXPECT_EQ(map.at<1>(3), "1");
+
+	// Columns are packed and aligned with the keys.
+	EXPECT_EQ(map.column<0>().size(), 100u);
+	EXPECT_EQ(map.column<2>().size(), 100u);
+	EXPECT_EQ(&map.column<1>()[5], map.data<1>() + 5);
+	for (size_t i = 0; i < map.size(); ++i) {
+		unsigned k = map.keys()[i];
+		EXPECT_EQ(map.index_of(k), i);
+		EXPECT_EQ(map.data<0>()[i].x, float(k / 3));
+		EXPECT_EQ(map.column<1>()[i], std::to_string(k / 3));
+		EXPECT_EQ(*map.column<2>()[i], k / 3);
+	}
+
+	for (hot& h : map.column<0>()) {
+		h.y = h.x * 2.f;
+	}
+	EXPECT_EQ(map.at<0>(30).y, 20.f);
+	EXPECT_EQ(map.at_unchecked<0>(30).y, 20.f);
+
+	map.insert_or_assign(
+			30, hot{ 1.f, 1.f }, std::string{ "a" }, nullptr);
+	EXPECT_EQ(map.size(), 100u);
+	EXPECT_EQ(map.at<0>(30).x, 1.f);
+	EXPECT_EQ(map.at<1>(30), "a");
+	EXPECT_EQ(map.at<2>(30), nullptr);
+	ret = map.insert_or_assign(
+			1'000, hot{}, std::string{ "b" }, std::make_unique<unsigned>(7));
+	EXPECT_TRUE(ret.second);
+	EXPECT_EQ(*map.at<2>(1'000), 7u);
+
+	// Erasing moves the last element of every column.
+	EXPECT_EQ(map.erase(1), 0u);
+	EXPECT_EQ(map.erase(0), 1u);
+	EXPECT_EQ(map.keys()[0], 1'000u);
+	EXPECT_EQ(map.at<1>(1'000), "b");
+	EXPECT_EQ(map.index_of(1'000), 0u);
+	EXPECT_EQ(map.erase(1'000), 1u);
+	EXPECT_EQ(map.size(), 99u);
+	EXPECT_EQ(map.column<1>().size(), 99u);
+
+	map_t other;
+	other.swap(map);
+	EXPECT_TRUE(map.empty());
+	EXPECT_EQ(*other.at<2>(297), 99u);
+
+	other.clear();
+	EXPECT_TRUE(other.empty());
+	EXPECT_TRUE(other.column<0>().empty());
+	other.shrink_to_fit();
+}
+
+TEST(flat_unsigned_column_hashmap, throwing_insert) {
+	fea::flat_unsigned_column_hashmap<unsigned, std::string, throws_on_copy,
+			hot>
+			map;
+	map.insert(0, std::string{ "a" }, throws_on_copy{}, hot{});
+
+	// A throwing value leaves the map untouched.
+	throws_on_copy t;
+	EXPECT_THROW(map.insert(1, std::string{ "b" }, t, hot{}),
+			std::runtime_error);
+	EXPECT_EQ(map.size(), 1u);
+	EXPECT_FALSE(map.contains(1));
+	EXPECT_EQ(map.column<0>().size(), 1u);
+	EXPECT_EQ(map.column<1>().size(), 1u);
+	EXPECT_EQ(map.column<2>().size(), 1u);
+	EXPECT_EQ(map.at<0>(0), "a");
+}
+
+TEST(flat_unsigned_column_hashmap, random) {
+	fea::flat_unsigned_column_hashmap<size_t, size_t, std::string> map(10);
+	std::map<size_t, size_t> expected;
+	std::mt19937_64 gen(42);
+	for (size_t i = 0; i < 10'000; ++i) {
+		size_t k = size_t(gen() % 2'000) * 7'919;
+		if (gen() % 3 == 0) {
+			EXPECT_EQ(map.erase(k), expected.erase(k));
+		} else {
+			map.insert_or_assign(k, i, std::to_string(i));
+			expected[k] = i;
+		}
+	}
+
+	ASSERT_EQ(map.size(), expected.size());
+	for (const auto& kv : expected) {
+		EXPECT_EQ(map.at<0>(kv.first), kv.second);
+		EXPECT_EQ(map.at<1>(kv.first), std::to_string(kv.second));
+	}
+	for (size_t i = 0; i < map.size(); ++i) {
+		EXPECT_EQ(expected.at(map.keys()[i]), map.column<0>()[i]);
+	}
+}
+} // namespace
@@ -1,9 +1,14 @@
-﻿#include <fea_unsigned_map/fea_flat_unsigned_hashmap.hpp>
+﻿#include <array>
+#include <fea_unsigned_map/fea_flat_unsigned_hashmap.hpp>
 #include <gtest/gtest.h>
+#include <map>
 #include <memory>
 #include <random>
+#include <stdexcept>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 namespace {
 struct test2 {
@@ -28,6 +33,40 @@ bool operator!=(const test2& lhs, const test2& rhs) {
 	return !operator==(lhs, rhs);
 }
 
+template <class T>
+struct counting_allocator {
+	using value_type = T;
+
+	counting_allocator(size_t* live)
+			: live(live) {
+	}
+	template <class U>
+	counting_allocator(const counting_allocator<U>& other)
+			: live(other.live) {
+	}
+
+	T* allocate(size_t n) {
+		++*live;
+		return std::allocator<T>{}.allocate(n);
+	}
+	void deallocate(T* p, size_t n) {
+		--*live;
+		std::allocator<T>{}.deallocate(p, n);
+	}
+
+	size_t* live;
+};
+template <class T, class U>
+bool operator==(
+		const counting_allocator<T>& lhs, const counting_allocator<U>& rhs) {
+	return lhs.live == rhs.live;
+}
+template <class T, class U>
+bool operator!=(
+		const counting_allocator<T>& lhs, const counting_allocator<U>& rhs) {
+	return !(lhs == rhs);
+}
+
 template <class KeyT>
 void do_basic_test() {
 	constexpr KeyT small_num = 10;
@@ -487,6 +526,735 @@ void do_fuzz_test() {
 	test_it(rand_numbers);
 }
 
+template <class KeyT>
+void do_bulk_erase_test() {
+	constexpr size_t num = 200;
+
+	fea::flat_unsigned_hashmap<KeyT, size_t> map;
+	for (size_t i = 0; i < num; ++i) {
+		// Some collisions.
+		map.insert(KeyT(i * 3), i * 3);
+	}
+
+	auto check = [&](const fea::flat_unsigned_hashmap<KeyT, size_t>& m,
+						 auto is_erased) {
+		size_t expected_size = 0;
+		for (size_t i = 0; i < num; ++i) {
+			KeyT k = KeyT(i * 3);
+			if (is_erased(k)) {
+				EXPECT_FALSE(m.contains(k));
+				continue;
+			}
+
+			++expected_size;
+			EXPECT_TRUE(m.contains(k));
+			EXPECT_EQ(m.at(k), k);
+		}
+		EXPECT_EQ(m.size(), expected_size);
+	};
+
+	{
+		// Rebuilds lookup.
+		fea::flat_unsigned_hashmap<KeyT, size_t> map1 = map;
+		size_t erased = map1.erase_if(
+				[](KeyT k, size_t v) { return k % 2 == 0 && v == k; });
+		EXPECT_EQ(erased, num / 2);
+		check(map1, [](KeyT k) { return k % 2 == 0; });
+
+		// Still usable.
+		map1.insert(KeyT(0), 0u);
+		map1.insert(KeyT(1), 1u);
+		EXPECT_EQ(map1.at(0), 0u);
+		EXPECT_EQ(map1.at(1), 1u);
+		map1.erase(KeyT(1));
+		map1.erase(KeyT(0));
+		check(map1, [](KeyT k) { return k % 2 == 0; });
+
+		EXPECT_EQ(map1.erase_if([](KeyT, size_t) { return true; }), num / 2);
+		EXPECT_TRUE(map1.empty());
+	}
+
+	{
+		// Patches lookup.
+		fea::flat_unsigned_hashmap<KeyT, size_t> map1 = map;
+		size_t erased
+				= map1.erase_if([](KeyT k, size_t) { return k % 27 == 0; });
+		EXPECT_EQ(erased, (num + 8) / 9);
+		check(map1, [](KeyT k) { return k % 27 == 0; });
+	}
+
+	{
+		// Duplicate and missing keys are ignored.
+		fea::flat_unsigned_hashmap<KeyT, size_t> map1 = map;
+		std::vector<KeyT> keys{ 0, 3, 3, 1, 2, 597, 300, 6 };
+		size_t erased = map1.erase(keys.data(), keys.size());
+		EXPECT_EQ(erased, 5u);
+		check(map1, [&](KeyT k) {
+			return std::find(keys.begin(), keys.end(), k) != keys.end();
+		});
+
+		EXPECT_EQ(map1.erase(keys.data(), keys.size()), 0u);
+		EXPECT_EQ(map1.erase(keys.data(), 0), 0u);
+		EXPECT_EQ(map1.size(), num - 5);
+
+		keys.clear();
+		for (size_t i = 0; i < num; ++i) {
+			keys.push_back(KeyT(i * 3));
+		}
+		EXPECT_EQ(map1.erase(keys.data(), keys.size()), num - 5);
+		EXPECT_TRUE(map1.empty());
+	}
+
+	{
+		// Ranges overlapping the end.
+		fea::flat_unsigned_hashmap<KeyT, size_t> map1 = map;
+		map1.erase(map1.begin() + 190, map1.begin() + 195);
+		EXPECT_EQ(map1.size(), num - 5);
+		check(map1, [](KeyT k) { return k >= 570 && k < 585; });
+
+		map1.erase(map1.begin() + 10, map1.end());
+		EXPECT_EQ(map1.size(), 10u);
+		check(map1, [](KeyT k) { return k >= 30; });
+	}
+}
+
+TEST(flat_unsigned_hashmap, bulk_erase) {
+	do_bulk_erase_test<uint16_t>();
+	do_bulk_erase_test<uint32_t>();
+	do_bulk_erase_test<uint64_t>();
+}
+
+TEST(flat_unsigned_hashmap, allocator) {
+	size_t live = 0;
+	{
+		using alloc_t = counting_allocator<test2>;
+		using map_t = fea::flat_unsigned_hashmap<unsigned, test2, alloc_t>;
+
+		map_t map{ alloc_t{ &live } };
+		EXPECT_EQ(live, 0u);
+		for (unsigned i = 0; i < 100; ++i) {
+			map.insert(i, i);
+		}
+
+		// Lookup, reverse lookup and values.
+		EXPECT_EQ(live, 3u);
+		EXPECT_EQ(map.get_allocator(), alloc_t{ &live });
+
+		map_t map2{ map, alloc_t{ &live } };
+		EXPECT_EQ(live, 6u);
+		EXPECT_EQ(map, map2);
+
+		// Small maps have no lookup and keep their keys inline.
+		map_t map3{ { { 0u, 0u }, { 1u, 1u } }, alloc_t{ &live } };
+		EXPECT_EQ(live, 7u);
+		EXPECT_EQ(map3.at(1), test2{ 1 });
+	}
+	EXPECT_EQ(live, 0u);
+
+#if __cplusplus >= 201703L
+	{
+		// Everything must come from the buffer.
+		std::array<std::byte, 65'536> buf;
+		std::pmr::monotonic_buffer_resource res{ buf.data(), buf.size(),
+			std::pmr::null_memory_resource() };
+
+		fea::pmr::flat_unsigned_hashmap<unsigned, test2> map{ &res };
+		for (unsigned i = 0; i < 100; ++i) {
+			map.insert(i, i);
+		}
+		map.erase(5u);
+		EXPECT_EQ(map.size(), 99u);
+		EXPECT_EQ(map.at(42), test2{ 42 });
+		EXPECT_EQ(map.get_allocator().resource(), &res);
+	}
+#endif
+}
+
+TEST(flat_unsigned_hashmap, memory_usage) {
+	fea::flat_unsigned_hashmap<uint16_t, double> map;
+	auto usage = map.memory_usage();
+	EXPECT_EQ(usage.used(), 0u);
+	EXPECT_EQ(usage.used_per_element(), 0.0);
+
+	for (uint16_t i = 0; i < 100; ++i) {
+		map.insert(i, double(i));
+	}
+	usage = map.memory_usage();
+	EXPECT_EQ(usage.size, 100u);
+	EXPECT_EQ(usage.values.used, 100 * sizeof(double));
+	EXPECT_EQ(usage.values.reserved, map.capacity() * sizeof(double));
+	EXPECT_EQ(usage.reverse_lookup.used, 100 * sizeof(uint16_t));
+	EXPECT_GE(usage.reverse_lookup.reserved, usage.reverse_lookup.used);
+
+	// Key and index per slot, at least one slot per element.
+	EXPECT_GE(usage.lookup.used, 100 * 2 * sizeof(uint16_t));
+	EXPECT_EQ(usage.lookup.used % (2 * sizeof(uint16_t)), 0u);
+	EXPECT_GE(usage.lookup.reserved, usage.lookup.used);
+
+	EXPECT_EQ(usage.used(),
+			usage.lookup.used + usage.reverse_lookup.used + usage.values.used);
+	EXPECT_GE(usage.reserved(), usage.used());
+	EXPECT_EQ(usage.used_per_element(), double(usage.used()) / 100.0);
+	EXPECT_GE(usage.reserved_per_element(), usage.used_per_element());
+
+	map.clear();
+	map.shrink_to_fit();
+	usage = map.memory_usage();
+	EXPECT_EQ(usage.values.reserved, 0u);
+	EXPECT_EQ(usage.reverse_lookup.reserved, 0u);
+}
+
+TEST(flat_unsigned_hashmap, small) {
+	using map_t = fea::flat_unsigned_hashmap<unsigned, test2>;
+	map_t map;
+	EXPECT_EQ(map.load_factor(), 0.f);
+
+	// Small maps don't allocate a lookup, their keys are inline.
+	for (unsigned i = 0; i < 8; ++i) {
+		EXPECT_TRUE(map.insert(i * 100, i).second);
+		EXPECT_FALSE(map.insert(i * 100, 42u).second);
+		EXPECT_EQ(map.load_factor(), (i + 1) / 8.f);
+	}
+	EXPECT_EQ(map.size(), 8u);
+	EXPECT_EQ(map.memory_usage().lookup.reserved, 0u);
+	EXPECT_EQ(map.memory_usage().reverse_lookup.reserved, 0u);
+	for (unsigned i = 0; i < 8; ++i) {
+		EXPECT_TRUE(map.contains(i * 100));
+		EXPECT_EQ(map.at(i * 100), test2{ i });
+	}
+	EXPECT_FALSE(map.contains(1));
+	EXPECT_EQ(map.find(1), map.end());
+	EXPECT_THROW(map.at(1), std::out_of_range);
+
+	map.insert_or_assign(500, 42u);
+	EXPECT_EQ(map.at(500), test2{ 42 });
+	map.insert_or_assign(500, 5u);
+	EXPECT_FALSE(map.try_emplace(300, 42u).second);
+	EXPECT_EQ(map.at(300), test2{ 3 });
+
+	// Swap & pop.
+	EXPECT_EQ(map.erase(0u), 1u);
+	EXPECT_EQ(map.erase(0u), 0u);
+	EXPECT_EQ(map.size(), 7u);
+	EXPECT_EQ(map.at(700), test2{ 7 });
+	EXPECT_TRUE(map.try_emplace(0u, 0u).second);
+	EXPECT_EQ(map.memory_usage().lookup.reserved, 0u);
+
+	// Overflow switches to the hashed layout.
+	map_t small_map = map;
+	EXPECT_TRUE(map.insert(800, 8u).second);
+	EXPECT_GT(map.memory_usage().lookup.reserved, 0u);
+	for (unsigned i = 0; i < 9; ++i) {
+		EXPECT_EQ(map.at(i * 100), test2{ i });
+	}
+	EXPECT_NE(map, small_map);
+	map.erase(800u);
+	EXPECT_EQ(map, small_map);
+	EXPECT_EQ(small_map, map);
+
+	// Erasing by position reports where the last element moved.
+	for (map_t m : { small_map, map }) {
+		size_t pos = size_t(m.find(300) - m.begin());
+		unsigned last_key = m.keys()[m.size() - 1];
+		EXPECT_EQ(m.erase_index(300), std::make_pair(pos, true));
+		EXPECT_EQ(m.erase_index(300), std::make_pair(m.size(), false));
+		EXPECT_EQ(size_t(m.find(last_key) - m.begin()), pos);
+	}
+
+	// Bulk erase.
+	const std::array<unsigned, 4> keys{ 100, 100, 200, 7 };
+	EXPECT_EQ(small_map.erase(keys.data(), keys.size()), 2u);
+	EXPECT_EQ(small_map.erase_if(
+					  [](unsigned k, const test2&) { return k >= 600; }),
+			2u);
+	EXPECT_EQ(small_map.size(), 4u);
+	for (unsigned k : { 0u, 300u, 400u, 500u }) {
+		EXPECT_TRUE(small_map.contains(k));
+	}
+	EXPECT_EQ(small_map.memory_usage().lookup.reserved, 0u);
+
+	// Clear returns to the small layout.
+	map.clear();
+	map.shrink_to_fit();
+	map.insert(1, 1u);
+	EXPECT_EQ(map.memory_usage().lookup.reserved, 0u);
+	EXPECT_EQ(map.at(1), test2{ 1 });
+
+	// Explicit rehash builds the lookup.
+	map.rehash(32);
+	EXPECT_GT(map.memory_usage().lookup.reserved, 0u);
+	EXPECT_EQ(map.at(1), test2{ 1 });
+}
+
+TEST(flat_unsigned_hashmap, chunked_values) {
+	using map_t = fea::flat_unsigned_hashmap<unsigned, test2,
+			std::allocator<test2>, fea::chunked_values<8>>;
+
+	map_t map;
+	map.insert(0, test2{ 0 });
+	const test2* first = &map.at(0);
+	for (unsigned i = 1; i < 50; ++i) {
+		map.insert(i * 113, test2{ i });
+	}
+
+	// Growth doesn't move values.
+	EXPECT_EQ(&map.at(0), first);
+	EXPECT_EQ(map.size(), 50u);
+
+	// Reserved memory counts the chunk table.
+	EXPECT_GT(map.memory_usage().values.reserved,
+			map.capacity() * sizeof(test2));
+	for (unsigned i = 0; i < 50; ++i) {
+		EXPECT_EQ(map.at(i * 113), test2{ i });
+	}
+
+	map.erase(3u * 113);
+	map.erase(10u * 113);
+	EXPECT_FALSE(map.contains(3u * 113));
+	EXPECT_EQ(map.at(49u * 113), test2{ 49 });
+	EXPECT_EQ(std::distance(map.begin(), map.end()), 48);
+
+	size_t count = 0;
+	size_t sum = 0;
+	map.iterate_chunks([&](const test2* f, const test2* l) {
+		EXPECT_LE(l - f, 8);
+		for (; f != l; ++f) {
+			++count;
+			sum += f->val;
+		}
+	});
+	EXPECT_EQ(count, 48u);
+	EXPECT_EQ(sum, 49u * 50u / 2u - 13u);
+
+	map_t map2{ map };
+	EXPECT_EQ(map, map2);
+	map2.erase(49u * 113);
+	EXPECT_NE(map, map2);
+
+	map.clear();
+	map.shrink_to_fit();
+	EXPECT_EQ(map.capacity(), 0u);
+}
+
+template <class ValueStorage>
+void do_kv_iterators_test() {
+	using map_t = fea::flat_unsigned_hashmap<unsigned, test2,
+			std::allocator<test2>, ValueStorage>;
+
+	std::vector<std::pair<unsigned, test2>> kvs;
+	for (unsigned i = 0; i < 100; ++i) {
+		kvs.push_back({ i * 7, test2{ i } });
+	}
+	kvs.push_back({ 14, test2{ 42 } });
+
+	// Range constructor, the first duplicate wins.
+	map_t map{ kvs.begin(), kvs.end() };
+	EXPECT_EQ(map.size(), 100u);
+	EXPECT_EQ(map.at(14), test2{ 2 });
+
+	EXPECT_EQ(map.keys().size(), map.size());
+	EXPECT_EQ(map.kvs().size(), map.size());
+	EXPECT_EQ(size_t(std::distance(map.kv_begin(), map.kv_end())), map.size());
+
+	// Keys and values are in value order.
+	size_t i = 0;
+	for (auto kv : map.kvs()) {
+		EXPECT_EQ(kv.first, map.keys()[i]);
+		EXPECT_EQ(kv.second, *(map.begin() + i));
+		EXPECT_EQ(map.at(kv.first), kv.second);
+		EXPECT_EQ(kv.first, kv.second.val * 7);
+		++i;
+	}
+	EXPECT_EQ(i, map.size());
+
+	// Values are mutable through the proxy.
+	for (auto kv : map.kvs()) {
+		kv.second.val += 1;
+	}
+	for (auto it = map.kv_begin(); it != map.kv_end(); ++it) {
+		EXPECT_EQ(it->second.val, it->first / 7 + 1);
+	}
+
+	// Random access.
+	typename map_t::kv_iterator it = map.kv_begin() + 10;
+	EXPECT_EQ(it->first, map.keys()[10]);
+	EXPECT_EQ((*(it - 3)).first, map.keys()[7]);
+	EXPECT_EQ(it[5].first, map.keys()[15]);
+	EXPECT_EQ(map.kv_end() - it, 90);
+	EXPECT_TRUE(it < map.kv_end());
+	--it;
+	EXPECT_EQ(it->first, map.keys()[9]);
+
+	const map_t& cmap = map;
+	typename map_t::const_kv_iterator cit = map.kv_begin();
+	EXPECT_EQ(cit, cmap.kv_cbegin());
+	EXPECT_EQ(cmap.kv_cend() - cit, 100);
+
+	// Build and insert from kv iterators.
+	map_t map2{ cmap.kv_begin(), cmap.kv_end() };
+	EXPECT_EQ(map, map2);
+
+	map_t map3;
+	map3.insert(0u, test2{ 1000 });
+	map3.insert(map.kv_begin(), map.kv_end());
+	EXPECT_EQ(map3.size(), 100u);
+	EXPECT_EQ(map3.at(0), test2{ 1000 });
+	EXPECT_EQ(map3.at(7), map.at(7));
+
+	map.erase(7u);
+	EXPECT_EQ(map.keys().size(), 99u);
+	for (auto kv : cmap.kvs()) {
+		EXPECT_NE(kv.first, 7u);
+		EXPECT_EQ(cmap.at(kv.first), kv.second);
+	}
+
+	map.clear();
+	EXPECT_TRUE(map.kvs().empty());
+	EXPECT_TRUE(map.keys().empty());
+	EXPECT_EQ(map.kv_begin(), map.kv_end());
+}
+
+TEST(flat_unsigned_hashmap, kv_iterators) {
+	do_kv_iterators_test<fea::contiguous_values>();
+	do_kv_iterators_test<fea::chunked_values<8>>();
+}
+
+TEST(flat_unsigned_hashmap, upsert_compute) {
+	// Through the small linear scan and the hashed lookup.
+	fea::flat_unsigned_hashmap<unsigned, size_t> counts;
+	std::unordered_map<unsigned, size_t> expected;
+	for (unsigned i = 0; i < 5'000; ++i) {
+		unsigned k = (i * 7919) % 1'009;
+		auto ret = counts.compute(k, [](size_t& c) { ++c; });
+		EXPECT_EQ(ret.second, expected.count(k) == 0);
+		++expected[k];
+		EXPECT_EQ(*ret.first, expected[k]);
+	}
+	EXPECT_EQ(counts.size(), expected.size());
+	for (const auto& kv : expected) {
+		EXPECT_EQ(counts.at(kv.first), kv.second);
+	}
+
+	fea::flat_unsigned_hashmap<unsigned, test2> map;
+	size_t made = 0;
+	size_t updated = 0;
+	auto make = [&]() {
+		++made;
+		return test2{ 1 };
+	};
+	auto update = [&](test2& t) {
+		++updated;
+		t.val *= 2;
+	};
+	for (unsigned k = 0; k < 100; ++k) {
+		EXPECT_TRUE(map.upsert(k, make, update).second);
+		EXPECT_FALSE(map.upsert(k, make, update).second);
+	}
+	EXPECT_EQ(made, 100u);
+	EXPECT_EQ(updated, 100u);
+	for (unsigned k = 0; k < 100; ++k) {
+		EXPECT_EQ(map.at(k), test2{ 2 });
+	}
+
+	// operator[] value initializes.
+	EXPECT_EQ(map[1000], test2{});
+	EXPECT_EQ(map.size(), 101u);
+}
+
+TEST(flat_unsigned_hashmap, extract_merge) {
+	using ptr = std::unique_ptr<unsigned>;
+	using map_t = fea::flat_unsigned_hashmap<unsigned, ptr>;
+
+	map_t pending;
+	for (unsigned i = 0; i < 100; ++i) {
+		pending.insert(i, std::make_unique<unsigned>(i));
+	}
+
+	map_t::node_type node = pending.extract(500);
+	EXPECT_TRUE(node.empty());
+	EXPECT_FALSE(pending.insert(std::move(node)).second);
+
+	// Values move in and out of nodes without copies.
+	const unsigned* addr = pending.at(10).get();
+	node = pending.extract(10);
+	EXPECT_FALSE(node.empty());
+	EXPECT_EQ(node.key(), 10u);
+	EXPECT_EQ(node.mapped().get(), addr);
+	EXPECT_FALSE(pending.contains(10));
+	EXPECT_EQ(pending.size(), 99u);
+
+	// Into a small map.
+	map_t active;
+	auto ret = active.insert(std::move(node));
+	EXPECT_TRUE(ret.second);
+	EXPECT_TRUE(node.empty());
+	EXPECT_EQ(ret.first->get(), addr);
+
+	// A node with an existing key keeps its value.
+	node = pending.extract(pending.begin() + 3);
+	unsigned k = node.key();
+	active.insert(k, std::make_unique<unsigned>(0));
+	EXPECT_FALSE(active.insert(std::move(node)).second);
+	EXPECT_FALSE(node.empty());
+	EXPECT_EQ(*node.mapped(), k);
+	node.key() = 1'000;
+	EXPECT_TRUE(active.insert(std::move(node)).second);
+	EXPECT_EQ(*active.at(1'000), k);
+
+	// Merging a small map in a small map.
+	map_t small;
+	small.insert(2'000, std::make_unique<unsigned>(2'000));
+	small.insert(10, std::make_unique<unsigned>(0));
+	active.merge(small);
+	EXPECT_EQ(active.size(), 4u);
+	EXPECT_EQ(small.size(), 1u);
+	EXPECT_EQ(*small.at(10), 0u);
+	EXPECT_EQ(*active.at(2'000), 2'000u);
+
+	for (unsigned i = 200; i < 300; ++i) {
+		active.insert(i, std::make_unique<unsigned>(i));
+	}
+	active.insert(50, std::make_unique<unsigned>(0));
+	active.insert(60, std::make_unique<unsigned>(0));
+
+	// Keys already in active stay in pending.
+	std::vector<const unsigned*> addrs;
+	for (const ptr& p : pending) {
+		addrs.push_back(p.get());
+	}
+	size_t expected_size = active.size() + pending.size() - 2;
+	active.merge(pending);
+	EXPECT_EQ(active.size(), expected_size);
+	EXPECT_EQ(pending.size(), 2u);
+	EXPECT_EQ(*pending.at(50), 50u);
+	EXPECT_EQ(*pending.at(60), 60u);
+	EXPECT_FALSE(pending.contains(0));
+	EXPECT_EQ(*active.at(50), 0u);
+	for (const unsigned* a : addrs) {
+		if (*a == 50 || *a == 60) {
+			continue;
+		}
+		EXPECT_EQ(active.at(*a).get(), a);
+	}
+	for (auto kv : active.kvs()) {
+		if (kv.first < 100 && kv.first != 50 && kv.first != 60
+				&& kv.first != k) {
+			EXPECT_EQ(*kv.second, kv.first);
+		}
+	}
+
+	active.merge(active);
+	EXPECT_EQ(active.size(), expected_size);
+	pending.erase(50);
+	pending.erase(60);
+	active.merge(pending);
+	EXPECT_EQ(active.size(), expected_size);
+	EXPECT_TRUE(pending.empty());
+
+	// Everything moves into an empty map.
+	map_t empty;
+	empty.merge(std::move(active));
+	EXPECT_EQ(empty.size(), expected_size);
+	EXPECT_TRUE(active.empty());
+	EXPECT_FALSE(active.contains(200));
+	EXPECT_EQ(*empty.at(200), 200u);
+	EXPECT_EQ(*empty.at(2'000), 2'000u);
+}
+
+// Copies throw when countdown reaches 0.
+struct copy_thrower {
+	copy_thrower(unsigned v_)
+			: v(v_) {
+	}
+	copy_thrower(const copy_thrower& other)
+			: v(other.v) {
+		if (--countdown == 0) {
+			throw std::runtime_error{ "" };
+		}
+	}
+	copy_thrower& operator=(const copy_thrower&) = default;
+
+	unsigned v;
+	static int countdown;
+};
+int copy_thrower::countdown = -1;
+
+TEST(flat_unsigned_hashmap, throwing_merge) {
+	using map_t = fea::flat_unsigned_hashmap<unsigned, copy_thrower>;
+
+	map_t dst;
+	dst.reserve(1'000);
+	for (unsigned i = 0; i < 50; ++i) {
+		dst.insert(i, copy_thrower{ i });
+	}
+	map_t src;
+	for (unsigned i = 25; i < 225; ++i) {
+		src.insert(i, copy_thrower{ i });
+	}
+
+	// Throws midway, other keeps the values that weren't moved.
+	copy_thrower::countdown = 60;
+	EXPECT_THROW(dst.merge(src), std::runtime_error);
+	copy_thrower::countdown = -1;
+	EXPECT_EQ(dst.size() + src.size(), 250u);
+	for (unsigned k = 0; k < 225; ++k) {
+		bool in_dst = dst.contains(k);
+		bool in_src = src.contains(k);
+		EXPECT_TRUE(in_dst || in_src);
+		EXPECT_EQ(in_dst && in_src, k >= 25 && k < 50);
+		if (in_src) {
+			EXPECT_EQ(src.at(k).v, k);
+		}
+		if (in_dst) {
+			EXPECT_EQ(dst.at(k).v, k);
+		}
+	}
+	for (auto kv : src.kvs()) {
+		EXPECT_EQ(src.at(kv.first).v, kv.first);
+		EXPECT_EQ(kv.second.v, kv.first);
+	}
+
+	dst.merge(src);
+	EXPECT_EQ(dst.size(), 225u);
+	EXPECT_EQ(src.size(), 25u);
+}
+
+template <class ValueStorage, class Order>
+void do_compact_test(Order order) {
+	using map_t = fea::flat_unsigned_hashmap<unsigned, unsigned,
+			std::allocator<unsigned>, ValueStorage>;
+
+	std::mt19937 gen(42);
+	map_t map;
+	std::map<unsigned, unsigned> expected;
+	auto churn = [&](unsigned key_max) {
+		for (unsigned i = 0; i < 2'000; ++i) {
+			unsigned k = unsigned(gen() % key_max);
+			if (gen() % 3 == 0) {
+				map.erase(k);
+				expected.erase(k);
+			} else {
+				map.insert_or_assign(k, k * 2);
+				expected[k] = k * 2;
+			}
+		}
+	};
+	auto check = [&](bool sorted) {
+		ASSERT_EQ(map.size(), expected.size());
+		auto it = expected.begin();
+		for (unsigned k : map.keys()) {
+			if (sorted) {
+				EXPECT_EQ(k, it->first);
+				++it;
+			}
+			EXPECT_EQ(map.at(k), k * 2);
+		}
+		for (const auto& kv : expected) {
+			EXPECT_EQ(map.at(kv.first), kv.second);
+		}
+	};
+	bool sorted = std::is_same<Order, fea::key_order_t>::value;
+
+	map.compact(order);
+	EXPECT_TRUE(map.empty());
+
+	// Small maps.
+	map.insert(5, 10);
+	map.insert(1, 2);
+	map.insert(3, 6);
+	expected = { { 1, 2 }, { 3, 6 }, { 5, 10 } };
+	map.compact(order);
+	check(false);
+	map.clear();
+	expected.clear();
+
+	churn(1'000);
+	map.compact(order);
+	check(sorted);
+
+	// Incremental, with nothing in between.
+	churn(1'000);
+	typename map_t::compact_cursor cursor;
+	size_t steps = 0;
+	while (!map.compact(order, cursor, 7)) {
+		++steps;
+	}
+	EXPECT_GT(steps, 1u);
+	check(sorted);
+
+	// The map stays valid when it changes between steps, and rehashes.
+	churn(1'000);
+	cursor = {};
+	unsigned key_max = 1'000;
+	while (!map.compact(order, cursor, 50)) {
+		unsigned k = unsigned(gen() % key_max);
+		map.erase(k);
+		expected.erase(k);
+		for (size_t i = 0; i < 10; ++i) {
+			k = unsigned(gen() % key_max);
+			map.insert_or_assign(k, k * 2);
+			expected[k] = k * 2;
+		}
+		key_max += 100;
+		check(false);
+	}
+	map.compact(order);
+	check(sorted);
+}
+
+TEST(flat_unsigned_hashmap, compact) {
+	do_compact_test<fea::contiguous_values>(fea::key_order);
+	do_compact_test<fea::contiguous_values>(fea::hash_order);
+	do_compact_test<fea::chunked_values<16>>(fea::key_order);
+	do_compact_test<fea::chunked_values<16>>(fea::hash_order);
+}
+
+TEST(flat_unsigned_hashmap, trailing_collisions) {
+	// Multiples of a prime pile up collisions. When they reach the end of
+	// the lookup during a rehash, it grows instead of asserting.
+	fea::flat_unsigned_hashmap<size_t, size_t> map;
+	std::unordered_map<size_t, size_t> expected;
+	std::mt19937_64 gen(42);
+	for (size_t i = 0; i < 10'000; ++i) {
+		size_t k = size_t(gen() % 2'000) * 7'919;
+		if (gen() % 3 == 0) {
+			EXPECT_EQ(map.erase(k), expected.erase(k));
+		} else {
+			map.insert_or_assign(k, i);
+			expected[k] = i;
+		}
+	}
+
+	ASSERT_EQ(map.size(), expected.size());
+	for (const auto& kv : expected) {
+		EXPECT_EQ(map.at(kv.first), kv.second);
+	}
+}
+
+TEST(flat_unsigned_hashmap, trailing_collisions_erase) {
+	// Small key types fill the lookup up to its end. Erasing there repacks
+	// the trailing collisions instead of asserting.
+	for (unsigned seed = 0; seed < 5; ++seed) {
+		fea::flat_unsigned_hashmap<uint8_t, size_t> map;
+		std::unordered_map<uint8_t, size_t> expected;
+		std::mt19937_64 gen(seed);
+		for (size_t i = 0; i < 2'000; ++i) {
+			uint8_t k = uint8_t(gen());
+			if (gen() % 3 == 0) {
+				EXPECT_EQ(map.erase(k), expected.erase(k));
+			} else {
+				map.insert_or_assign(k, i);
+				expected[k] = i;
+			}
+		}
+
+		ASSERT_EQ(map.size(), expected.size());
+		for (const auto& kv : expected) {
+			EXPECT_EQ(map.at(kv.first), kv.second);
+		}
+	}
+}
+
 TEST(flat_unsigned_hashmap, fuzzing) {
 	do_fuzz_test<uint8_t>();
 	do_fuzz_test<uint16_t>();
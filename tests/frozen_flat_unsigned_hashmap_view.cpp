@@ -0,0 +1,125 @@
+﻿#include <cstdint>
+#include <cstdio>
+#include <fea_unsigned_map/fea_flat_unsigned_hashmap.hpp>
+#include <fea_unsigned_map/fea_frozen_flat_unsigned_hashmap_view.hpp>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+const char* test_file = "fea_frozen_flat_unsigned_hashmap_test.bin";
+
+template <class Map, class View>
+void check_view(const Map& map, const View& view) {
+	EXPECT_EQ(view.size(), map.size());
+	EXPECT_EQ(view.empty(), map.empty());
+	for (unsigned k = 0; k < 2'000; ++k) {
+		EXPECT_EQ(view.contains(k), map.contains(k));
+		EXPECT_EQ(view.count(k), map.count(k));
+		if (!map.contains(k)) {
+			EXPECT_EQ(view.find(k), view.end());
+			EXPECT_THROW(view.at(k), std::out_of_range);
+			continue;
+		}
+		EXPECT_EQ(view.at(k), map.at(k));
+	}
+
+	// Same iteration order, keys match values.
+	auto it = map.begin();
+	for (size_t i = 0; i < view.size(); ++i) {
+		EXPECT_EQ(view.data()[i], *it++);
+		EXPECT_EQ(view.at(view.key_data()[i]), view.data()[i]);
+	}
+}
+
+// Freezes into an aligned heap buffer.
+template <class Map>
+std::vector<uint64_t> freeze(const Map& map) {
+	std::vector<uint64_t> buf(map.frozen_size() / sizeof(uint64_t) + 1);
+	map.freeze(buf.data(), buf.size() * sizeof(uint64_t));
+	return buf;
+}
+
+TEST(frozen_flat_unsigned_hashmap_view, basics) {
+	using map_t = fea::flat_unsigned_hashmap<unsigned, double>;
+	using view_t = fea::frozen_flat_unsigned_hashmap_view<unsigned, double>;
+
+	map_t map;
+	std::vector<uint64_t> buf = freeze(map);
+	check_view(map, view_t{ buf.data(), buf.size() * sizeof(uint64_t) });
+
+	// Small map, no lookup.
+	map.insert(5, 5.0);
+	map.insert(3, 3.0);
+	buf = freeze(map);
+	check_view(map, view_t{ buf.data(), buf.size() * sizeof(uint64_t) });
+
+	// Collisions and erased keys.
+	for (unsigned i = 0; i < 300; ++i) {
+		map.insert(i * 7, double(i));
+	}
+	map.erase(14u);
+	map.erase(700u);
+	buf = freeze(map);
+	check_view(map, view_t{ buf.data(), buf.size() * sizeof(uint64_t) });
+
+	// Position independent, the image can be copied anywhere.
+	std::vector<uint64_t> buf2 = buf;
+	buf.clear();
+	view_t view{ buf2.data(), buf2.size() * sizeof(uint64_t) };
+	check_view(map, view);
+
+	map.freeze(test_file);
+	view_t file_view{ test_file };
+	check_view(map, file_view);
+
+	view_t moved{ std::move(file_view) };
+	EXPECT_TRUE(file_view.empty());
+	check_view(map, moved);
+
+	fea::flat_unsigned_hashmap<unsigned, double, std::allocator<double>,
+			fea::chunked_values<16>>
+			chunked_map;
+	for (unsigned i = 0; i < 100; ++i) {
+		chunked_map.insert(i * 3, double(i));
+	}
+	chunked_map.freeze(test_file);
+	check_view(chunked_map, view_t{ test_file });
+
+	std::remove(test_file);
+}
+
+TEST(frozen_flat_unsigned_hashmap_view, errors) {
+	using map_t = fea::flat_unsigned_hashmap<unsigned, double>;
+	using view_t = fea::frozen_flat_unsigned_hashmap_view<unsigned, double>;
+
+	map_t map;
+	for (unsigned i = 0; i < 20; ++i) {
+		map.insert(i, double(i));
+	}
+
+	std::vector<uint64_t> buf(map.frozen_size() / sizeof(uint64_t) + 2);
+	EXPECT_THROW(map.freeze(buf.data(), map.frozen_size() - 1),
+			std::invalid_argument);
+	char* misaligned = reinterpret_cast<char*>(buf.data()) + 1;
+	EXPECT_THROW(map.freeze(misaligned, map.frozen_size()),
+			std::invalid_argument);
+
+	map.freeze(buf.data(), buf.size() * sizeof(uint64_t));
+	EXPECT_THROW((view_t{ buf.data(), map.frozen_size() - 1 }),
+			std::runtime_error);
+	EXPECT_THROW((fea::frozen_flat_unsigned_hashmap_view<unsigned, float>{
+						 buf.data(), map.frozen_size() }),
+			std::runtime_error);
+	EXPECT_THROW((fea::frozen_flat_unsigned_hashmap_view<uint64_t, double>{
+						 buf.data(), map.frozen_size() }),
+			std::runtime_error);
+
+	// Not a frozen map.
+	buf[0] = 42;
+	EXPECT_THROW((view_t{ buf.data(), map.frozen_size() }),
+			std::runtime_error);
+	EXPECT_THROW(view_t{ "fea_frozen_flat_unsigned_hashmap_missing.bin" },
+			std::runtime_error);
+}
+} // namespace
@@ -0,0 +1,79 @@
+﻿#include <cstdint>
+#include <cstring>
+#include <fea_unsigned_map/fea_flat_unsigned_hashmap.hpp>
+#include <fea_unsigned_map/fea_huge_page_allocator.hpp>
+#include <fea_unsigned_map/fea_unsigned_map.hpp>
+#include <gtest/gtest.h>
+
+namespace {
+TEST(huge_page_allocator, basics) {
+	fea::huge_page_allocator<uint32_t> alloc;
+	EXPECT_FALSE(alloc.uses_huge_pages(4'096));
+
+	uint32_t* small = alloc.allocate(16);
+	small[0] = 0;
+	small[15] = 15;
+	EXPECT_EQ(small[15], 15u);
+	alloc.deallocate(small, 16);
+
+	constexpr size_t big_n = 1'000'000;
+	uint32_t* big = alloc.allocate(big_n);
+	std::memset(big, 0, big_n * sizeof(uint32_t));
+	big[big_n - 1] = 42;
+	EXPECT_EQ(big[big_n - 1], 42u);
+	if (alloc.uses_huge_pages(big_n * sizeof(uint32_t))) {
+		EXPECT_EQ(reinterpret_cast<uintptr_t>(big) % (2 * 1024 * 1024), 0u);
+	}
+	alloc.deallocate(big, big_n);
+
+	fea::huge_page_allocator<double> other{ alloc };
+	EXPECT_TRUE(other == alloc);
+	EXPECT_FALSE(other != alloc);
+}
+
+TEST(huge_page_allocator, maps) {
+	// Big enough for the lookups and indexes to go through huge pages.
+	constexpr unsigned num_keys = 300'000;
+
+	{
+		using alloc_t = fea::huge_page_allocator<float>;
+		fea::flat_unsigned_hashmap<unsigned, float, alloc_t> map;
+		for (unsigned i = 0; i < num_keys; ++i) {
+			map.insert(i, float(i));
+		}
+		for (unsigned i = 0; i < num_keys; i += num_keys / 10) {
+			map.erase(i);
+		}
+
+		fea::flat_unsigned_hashmap<unsigned, float, alloc_t> map2{ map };
+		EXPECT_EQ(map, map2);
+		EXPECT_EQ(map2.size(), num_keys - 10);
+		for (unsigned i = 1; i < num_keys; i += 3) {
+			EXPECT_EQ(map2.at(i), float(i));
+		}
+		map2.clear();
+		map2.shrink_to_fit();
+		EXPECT_TRUE(map2.empty());
+	}
+
+	{
+		using alloc_t = fea::huge_page_allocator<std::pair<unsigned, float>>;
+		fea::unsigned_map<unsigned, float, fea::sentinel_indexes, alloc_t> map;
+		for (unsigned i = 0; i < num_keys; ++i) {
+			map.insert({ i, float(i) });
+		}
+		for (unsigned i = 0; i < num_keys; i += num_keys / 10) {
+			map.erase(i);
+		}
+
+		fea::unsigned_map<unsigned, float, fea::sentinel_indexes, alloc_t> map2{
+			map
+		};
+		EXPECT_EQ(map, map2);
+		EXPECT_EQ(map2.size(), num_keys - 10);
+		for (unsigned i = 1; i < num_keys; i += 3) {
+			EXPECT_EQ(map2.at(i), float(i));
+		}
+	}
+}
+} // namespace
@@ -0,0 +1,117 @@
+﻿#include <cstdint>
+#include <fea_unsigned_map/fea_perfect_unsigned_hashmap.hpp>
+#include <gtest/gtest.h>
+#include <random>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+template <class Key>
+void do_basic_test(const std::vector<Key>& keys) {
+	using map_t = fea::perfect_unsigned_hashmap<Key, double>;
+
+	std::vector<double> values;
+	for (size_t i = 0; i < keys.size(); ++i) {
+		values.push_back(double(i));
+	}
+
+	map_t map{ keys.data(), values.data(), keys.size() };
+	EXPECT_EQ(map.size(), keys.size());
+	EXPECT_EQ(size_t(std::distance(map.begin(), map.end())), keys.size());
+	for (size_t i = 0; i < keys.size(); ++i) {
+		EXPECT_TRUE(map.contains(keys[i]));
+		EXPECT_EQ(map.count(keys[i]), 1u);
+		EXPECT_EQ(map.at(keys[i]), values[i]);
+		EXPECT_EQ(map.at_unchecked(keys[i]), values[i]);
+		EXPECT_EQ(*map.find(keys[i]), values[i]);
+	}
+
+	// Packed, keys match values.
+	for (size_t i = 0; i < map.size(); ++i) {
+		EXPECT_EQ(map.at(map.key_data()[i]), map.data()[i]);
+	}
+
+	std::unordered_set<Key> key_set(keys.begin(), keys.end());
+	std::mt19937_64 gen{ 42 };
+	for (size_t i = 0; i < 2'000; ++i) {
+		Key k = Key(gen());
+		if (key_set.count(k) != 0) {
+			continue;
+		}
+		EXPECT_FALSE(map.contains(k));
+		EXPECT_EQ(map.find(k), map.end());
+		EXPECT_THROW(map.at(k), std::out_of_range);
+	}
+
+	map_t map2 = map;
+	EXPECT_EQ(map, map2);
+	map2.at(keys[0]) = -1.0;
+	EXPECT_NE(map, map2);
+}
+
+TEST(perfect_unsigned_hashmap, basics) {
+	fea::perfect_unsigned_hashmap<unsigned, double> empty;
+	EXPECT_TRUE(empty.empty());
+	EXPECT_FALSE(empty.contains(0));
+	EXPECT_EQ(empty.find(42), empty.end());
+
+	do_basic_test<uint8_t>({ 0, 1, 255 });
+	do_basic_test<uint16_t>({ 42 });
+	do_basic_test<unsigned>({ 7, 14, 21, 28, 35, 42, 49 });
+
+	std::vector<unsigned> linear;
+	for (unsigned i = 0; i < 10'000; ++i) {
+		linear.push_back(i);
+	}
+	do_basic_test(linear);
+
+	std::mt19937_64 gen{ 1 };
+	std::unordered_set<uint64_t> random_set;
+	while (random_set.size() < 20'000) {
+		random_set.insert(gen());
+	}
+	do_basic_test(std::vector<uint64_t>(random_set.begin(), random_set.end()));
+
+	fea::perfect_unsigned_hashmap<unsigned, double> init{ { 5, 0.5 },
+		{ 1'000'000, 1.0 }, { 3, 0.3 } };
+	EXPECT_EQ(init.size(), 3u);
+	EXPECT_EQ(init.at(1'000'000), 1.0);
+	EXPECT_EQ(init.at(3), 0.3);
+
+	fea::perfect_unsigned_hashmap<unsigned, double> swapped;
+	swapped.swap(init);
+	EXPECT_TRUE(init.empty());
+	EXPECT_EQ(swapped.at(5), 0.5);
+}
+
+TEST(perfect_unsigned_hashmap, small_sets) {
+	// Small tables used to spend whole seeds on unsolvable buckets.
+	std::mt19937_64 gen{ 7 };
+	for (size_t count = 1; count <= 40; ++count) {
+		for (size_t i = 0; i < 50; ++i) {
+			std::unordered_set<uint32_t> key_set;
+			while (key_set.size() < count) {
+				key_set.insert(uint32_t(gen()));
+			}
+			std::vector<uint32_t> keys(key_set.begin(), key_set.end());
+			std::vector<float> values(keys.size(), 1.f);
+			fea::perfect_unsigned_hashmap<uint32_t, float> map{
+				keys.data(), values.data(), keys.size()
+			};
+			ASSERT_EQ(map.size(), count);
+			for (uint32_t k : keys) {
+				ASSERT_TRUE(map.contains(k));
+			}
+		}
+	}
+}
+
+TEST(perfect_unsigned_hashmap, duplicates) {
+	std::vector<unsigned> keys{ 1, 2, 3, 2 };
+	std::vector<float> values{ 1.f, 2.f, 3.f, 4.f };
+	using map_t = fea::perfect_unsigned_hashmap<unsigned, float>;
+	EXPECT_THROW((map_t{ keys.data(), values.data(), keys.size() }),
+			std::invalid_argument);
+}
+} // namespace
@@ -0,0 +1,195 @@
+﻿#include <array>
+#include <cstdint>
+#include <fea_unsigned_map/fea_static_unsigned_map.hpp>
+#include <gtest/gtest.h>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <unordered_set>
+#include <utility>
+
+namespace {
+constexpr std::array<std::pair<unsigned, int>, 5> dense_kvs{ {
+		{ 10, 0 },
+		{ 11, 1 },
+		{ 12, 2 },
+		{ 14, 4 },
+		{ 17, 7 },
+} };
+constexpr fea::static_unsigned_map<unsigned, int, 5> dense_map{ dense_kvs };
+
+static_assert(dense_map.is_dense(), "static_unsigned_map.cpp : failed test");
+static_assert(dense_map.size() == 5, "static_unsigned_map.cpp : failed test");
+static_assert(dense_map.at(10) == 0, "static_unsigned_map.cpp : failed test");
+static_assert(dense_map.at(17) == 7, "static_unsigned_map.cpp : failed test");
+static_assert(dense_map.at_unchecked(14) == 4,
+		"static_unsigned_map.cpp : failed test");
+static_assert(dense_map.contains(12), "static_unsigned_map.cpp : failed test");
+static_assert(!dense_map.contains(13), "static_unsigned_map.cpp : failed test");
+static_assert(!dense_map.contains(9), "static_unsigned_map.cpp : failed test");
+static_assert(!dense_map.contains(1000),
+		"static_unsigned_map.cpp : failed test");
+static_assert(dense_map.count(11) == 1,
+		"static_unsigned_map.cpp : failed test");
+
+constexpr std::array<std::pair<uint64_t, int>, 6> sparse_kvs{ {
+		{ 1, 1 },
+		{ 42, 2 },
+		{ 900, 3 },
+		{ 123'456, 4 },
+		{ 0xffff'ffff, 5 },
+		{ 0xffff'ffff'ffff'fffe, 6 },
+} };
+constexpr auto sparse_map = fea::make_static_unsigned_map(sparse_kvs);
+
+static_assert(!sparse_map.is_dense(), "static_unsigned_map.cpp : failed test");
+static_assert(sparse_map.at(1) == 1, "static_unsigned_map.cpp : failed test");
+static_assert(sparse_map.at(42) == 2, "static_unsigned_map.cpp : failed test");
+static_assert(sparse_map.at(900) == 3, "static_unsigned_map.cpp : failed test");
+static_assert(sparse_map.at(123'456) == 4,
+		"static_unsigned_map.cpp : failed test");
+static_assert(sparse_map.at(0xffff'ffff) == 5,
+		"static_unsigned_map.cpp : failed test");
+static_assert(sparse_map.at(0xffff'ffff'ffff'fffe) == 6,
+		"static_unsigned_map.cpp : failed test");
+static_assert(!sparse_map.contains(0), "static_unsigned_map.cpp : failed test");
+static_assert(!sparse_map.contains(43),
+		"static_unsigned_map.cpp : failed test");
+static_assert(!sparse_map.contains(0xffff'ffff'ffff'ffff),
+		"static_unsigned_map.cpp : failed test");
+
+TEST(static_unsigned_map, basics) {
+	for (const auto& kv : dense_kvs) {
+		EXPECT_EQ(dense_map.at(kv.first), kv.second);
+		EXPECT_EQ(dense_map.find(kv.first)->second, kv.second);
+	}
+	EXPECT_EQ(dense_map.find(13), dense_map.end());
+	EXPECT_THROW(dense_map.at(13), std::out_of_range);
+	EXPECT_THROW(sparse_map.at(0), std::out_of_range);
+	EXPECT_EQ(sparse_map.find(7), sparse_map.end());
+
+	int sum = 0;
+	for (const auto& kv : sparse_map) {
+		EXPECT_EQ(sparse_map.find(kv.first)->second, kv.second);
+		sum += kv.second;
+	}
+	EXPECT_EQ(sum, 21);
+
+	// Tiny key types, the key offset wraps.
+	constexpr fea::static_unsigned_map<uint8_t, int, 2> small{ { {
+			{ uint8_t(253), 1 },
+			{ uint8_t(255), 2 },
+	} } };
+	static_assert(small.is_dense(), "static_unsigned_map.cpp : failed test");
+	EXPECT_EQ(small.at(253), 1);
+	EXPECT_EQ(small.at(255), 2);
+	EXPECT_FALSE(small.contains(0));
+	EXPECT_FALSE(small.contains(2));
+	EXPECT_FALSE(small.contains(254));
+
+	// One key.
+	constexpr fea::static_unsigned_map<unsigned, int, 1> one{ { {
+			{ 5u, 1 },
+	} } };
+	static_assert(one.at(5) == 1, "static_unsigned_map.cpp : failed test");
+	EXPECT_FALSE(one.contains(4));
+	EXPECT_FALSE(one.contains(6));
+	EXPECT_FALSE(one.contains(0));
+}
+
+template <size_t N>
+void expect_duplicates(
+		const std::array<std::pair<uint32_t, uint32_t>, N>& kvs) {
+	try {
+		fea::static_unsigned_map<uint32_t, uint32_t, N> map{ kvs };
+		ADD_FAILURE() << "duplicates didn't throw";
+	} catch (const std::invalid_argument& e) {
+		EXPECT_STREQ(e.what(), "static_unsigned_map : duplicate keys");
+	}
+}
+
+TEST(static_unsigned_map, runtime) {
+	constexpr size_t count = 3'000;
+	using map_t = fea::static_unsigned_map<uint32_t, uint32_t, count>;
+
+	std::mt19937 gen{ 42 };
+	std::unordered_set<uint32_t> key_set;
+	std::array<std::pair<uint32_t, uint32_t>, count> kvs{};
+	for (size_t i = 0; i < count; ++i) {
+		uint32_t k = gen();
+		while (!key_set.insert(k).second) {
+			k = gen();
+		}
+		kvs[i] = { k, uint32_t(i) };
+	}
+
+	std::unique_ptr<map_t> map = std::make_unique<map_t>(kvs);
+	EXPECT_FALSE(map->is_dense());
+	for (const auto& kv : kvs) {
+		EXPECT_TRUE(map->contains(kv.first));
+		EXPECT_EQ(map->at(kv.first), kv.second);
+		EXPECT_EQ(map->at_unchecked(kv.first), kv.second);
+	}
+	for (size_t i = 0; i < 10'000; ++i) {
+		uint32_t k = gen();
+		EXPECT_EQ(map->contains(k), key_set.count(k) != 0);
+	}
+
+	// Dense.
+	for (size_t i = 0; i < count; ++i) {
+		kvs[i] = { uint32_t(100 + i * 2), uint32_t(i) };
+	}
+	map = std::make_unique<map_t>(kvs);
+	EXPECT_TRUE(map->is_dense());
+	for (uint32_t k = 0; k < 100 + count * 3; ++k) {
+		bool has = k >= 100 && k % 2 == 0 && k < 100 + count * 2;
+		EXPECT_EQ(map->contains(k), has);
+		if (has) {
+			EXPECT_EQ(map->at(k), (k - 100) / 2);
+		}
+	}
+
+	// Duplicates.
+	kvs[7].first = kvs[3].first;
+	expect_duplicates(kvs);
+	for (size_t i = 0; i < count; ++i) {
+		kvs[i] = { gen(), uint32_t(i) };
+	}
+	kvs[20].first = kvs[2000].first;
+	expect_duplicates(kvs);
+}
+
+template <size_t N>
+void do_random_sets(std::mt19937_64& gen) {
+	using map_t = fea::static_unsigned_map<uint32_t, uint32_t, N>;
+
+	for (size_t attempt = 0; attempt < 500; ++attempt) {
+		std::unordered_set<uint32_t> key_set;
+		std::array<std::pair<uint32_t, uint32_t>, N> kvs{};
+		for (size_t i = 0; i < N; ++i) {
+			uint32_t k = uint32_t(gen());
+			while (!key_set.insert(k).second) {
+				k = uint32_t(gen());
+			}
+			kvs[i] = { k, uint32_t(i) };
+		}
+
+		std::unique_ptr<map_t> map = std::make_unique<map_t>(kvs);
+		for (const auto& kv : kvs) {
+			ASSERT_EQ(map->at(kv.first), kv.second);
+		}
+	}
+}
+
+TEST(static_unsigned_map, random_sets) {
+	// Distinct sparse keys must always build.
+	std::mt19937_64 gen{ 1 };
+	do_random_sets<2>(gen);
+	do_random_sets<3>(gen);
+	do_random_sets<8>(gen);
+	do_random_sets<12>(gen);
+	do_random_sets<17>(gen);
+	do_random_sets<100>(gen);
+	do_random_sets<1'000>(gen);
+}
+} // namespace
@@ -1,7 +1,14 @@
-﻿#include <fea_unsigned_map/fea_unsigned_map.hpp>
+﻿#include <array>
+#include <fea_unsigned_map/fea_unsigned_map.hpp>
 #include <gtest/gtest.h>
+#include <limits>
+#include <list>
+#include <map>
 #include <memory>
+#include <random>
+#include <stdexcept>
 #include <unordered_map>
+#include <vector>
 
 namespace {
 struct test {
@@ -25,10 +32,47 @@ bool operator!=(const test& lhs, const test& rhs) {
 	return !operator==(lhs, rhs);
 }
 
-TEST(unsigned_map, basics) {
+template <class T>
+struct counting_allocator {
+	using value_type = T;
+
+	counting_allocator(size_t* live)
+			: live(live) {
+	}
+	template <class U>
+	counting_allocator(const counting_allocator<U>& other)
+			: live(other.live) {
+	}
+
+	T* allocate(size_t n) {
+		++*live;
+		return std::allocator<T>{}.allocate(n);
+	}
+	void deallocate(T* p, size_t n) {
+		--*live;
+		std::allocator<T>{}.deallocate(p, n);
+	}
+
+	size_t* live;
+};
+template <class T, class U>
+bool operator==(
+		const counting_allocator<T>& lhs, const counting_allocator<U>& rhs) {
+	return lhs.live == rhs.live;
+}
+template <class T, class U>
+bool operator!=(
+		const counting_allocator<T>& lhs, const counting_allocator<U>& rhs) {
+	return !(lhs == rhs);
+}
+
+template <class IndexStorage>
+void do_basic_test() {
+	using map_t = fea::unsigned_map<size_t, test, IndexStorage>;
+
 	constexpr size_t small_num = 10;
 
-	fea::unsigned_map<size_t, test> map1{ small_num };
+	map_t map1{ small_num };
 	map1.reserve(100);
 	EXPECT_EQ(map1.capacity(), 100u);
 	map1.shrink_to_fit();
@@ -61,9 +105,9 @@ TEST(unsigned_map, basics) {
 		EXPECT_EQ(ret_pair.first->second, t);
 	}
 
-	fea::unsigned_map<size_t, test> map2{ map1 };
-	fea::unsigned_map<size_t, test> map_ded{ map1 };
-	fea::unsigned_map<size_t, test> map3{ std::move(map_ded) };
+	map_t map2{ map1 };
+	map_t map_ded{ map1 };
+	map_t map3{ std::move(map_ded) };
 
 	EXPECT_EQ(map1, map2);
 	EXPECT_EQ(map1, map3);
@@ -228,11 +272,11 @@ TEST(unsigned_map, basics) {
 	map1 = map2;
 	map3 = map2;
 
-	map1 = fea::unsigned_map<size_t, test>(
+	map1 = map_t(
 			{ { 0, { 0 } }, { 1, { 1 } }, { 2, { 2 } } });
-	map2 = fea::unsigned_map<size_t, test>(
+	map2 = map_t(
 			{ { 3, { 3 } }, { 4, { 4 } }, { 5, { 5 } } });
-	map3 = fea::unsigned_map<size_t, test>(
+	map3 = map_t(
 			{ { 6, { 6 } }, { 7, { 7 } }, { 8, { 8 } } });
 
 	EXPECT_EQ(map1.size(), 3u);
@@ -262,9 +306,9 @@ TEST(unsigned_map, basics) {
 	EXPECT_EQ(map3.find(8)->second, test{ 8 });
 
 	{
-		fea::unsigned_map<size_t, test> map1_back = map1;
-		fea::unsigned_map<size_t, test> map2_back{ map2 };
-		fea::unsigned_map<size_t, test> map3_back{ map3 };
+		map_t map1_back = map1;
+		map_t map2_back{ map2 };
+		map_t map3_back{ map3 };
 
 		map1.swap(map2);
 		EXPECT_EQ(map1, map2_back);
@@ -299,7 +343,7 @@ TEST(unsigned_map, basics) {
 	EXPECT_EQ(map1[4], test{ 4 });
 	EXPECT_EQ(map1.find(5)->second, test{ 5 });
 
-	map2 = fea::unsigned_map<size_t, test>(map1.begin(), map1.end());
+	map2 = map_t(map1.begin(), map1.end());
 	EXPECT_EQ(map1.size(), map2.size());
 	EXPECT_EQ(map1, map2);
 
@@ -311,6 +355,913 @@ TEST(unsigned_map, basics) {
 	EXPECT_EQ(map2, map3);
 }
 
+TEST(unsigned_map, basics) {
+	do_basic_test<fea::sentinel_indexes>();
+	do_basic_test<fea::epoch_indexes>();
+}
+
+TEST(unsigned_map, epoch_indexes) {
+	fea::unsigned_map<size_t, test, fea::epoch_indexes> map;
+
+	for (size_t frame = 0; frame < 5; ++frame) {
+		EXPECT_TRUE(map.empty());
+		for (size_t i = 0; i < 10; ++i) {
+			EXPECT_FALSE(map.contains(i));
+		}
+
+		// Insert a different subset each frame.
+		for (size_t i = frame; i < 10; i += 2) {
+			map.insert({ i, { i + frame } });
+		}
+		for (size_t i = 0; i < 10; ++i) {
+			bool expected = i >= frame && (i - frame) % 2 == 0;
+			EXPECT_EQ(map.contains(i), expected);
+			if (expected) {
+				EXPECT_EQ(map.at(i), test{ i + frame });
+			}
+		}
+
+		map.erase(8);
+		EXPECT_FALSE(map.contains(8));
+		map.clear();
+	}
+
+	fea::unsigned_map<size_t, test, fea::epoch_indexes> map2{ map };
+	EXPECT_TRUE(map2.empty());
+	map2[3] = test{ 3 };
+	map.swap(map2);
+	EXPECT_EQ(map.at(3), test{ 3 });
+	EXPECT_TRUE(map2.empty());
+	EXPECT_FALSE(map2.contains(3));
+}
+
+template <class Key, class IndexStorage>
+void do_small_keys_test() {
+	using map_t = fea::unsigned_map<Key, size_t, IndexStorage>;
+	constexpr size_t key_max = (std::numeric_limits<Key>::max)();
+
+	// Empty maps don't allocate, but every key can be queried.
+	map_t map;
+	EXPECT_EQ(map.memory_usage().reserved(), 0u);
+	EXPECT_FALSE(map.contains(0));
+	EXPECT_FALSE(map.contains(Key(key_max)));
+	EXPECT_EQ(map.find(Key(key_max)), map.end());
+	EXPECT_EQ(map.max_size(), key_max);
+
+	// The max key is usable.
+	map.insert({ Key(key_max), key_max });
+	EXPECT_TRUE(map.contains(Key(key_max)));
+	EXPECT_EQ(map.at(Key(key_max)), key_max);
+	EXPECT_FALSE(map.contains(Key(key_max - 1)));
+
+	// All keys but one.
+	for (size_t i = 1; i < key_max; ++i) {
+		map.insert({ Key(i), i });
+	}
+	EXPECT_EQ(map.size(), map.max_size());
+	for (size_t i = 1; i <= key_max; ++i) {
+		EXPECT_EQ(map.at(Key(i)), i);
+	}
+	EXPECT_FALSE(map.contains(0));
+	EXPECT_THROW(map.insert({ Key(0), 0 }), std::out_of_range);
+	EXPECT_THROW(map.emplace(Key(0), 0), std::out_of_range);
+	std::vector<std::pair<Key, size_t>> kvs{ { Key(5), 0 }, { Key(0), 0 } };
+	EXPECT_THROW(map.insert(kvs.begin(), kvs.end()), std::out_of_range);
+	EXPECT_FALSE(map.contains(0));
+	EXPECT_EQ(map.size(), map.max_size());
+	EXPECT_EQ(map.at(5), 5u);
+
+	map_t map2{ map };
+	EXPECT_EQ(map, map2);
+	map.erase(Key(key_max));
+	EXPECT_FALSE(map.contains(Key(key_max)));
+	EXPECT_TRUE(map2.contains(Key(key_max)));
+	map.insert({ 0, 42 });
+	EXPECT_EQ(map.at(0), 42u);
+
+	map_t map3{ std::move(map) };
+	EXPECT_EQ(map3.at(0), 42u);
+	map2.swap(map3);
+	EXPECT_EQ(map2.at(0), 42u);
+	EXPECT_FALSE(map3.contains(0));
+	EXPECT_TRUE(map3.contains(Key(key_max)));
+
+	map = map3;
+	EXPECT_EQ(map, map3);
+
+	map2.clear();
+	EXPECT_TRUE(map2.empty());
+	for (size_t i = 0; i <= key_max; ++i) {
+		EXPECT_FALSE(map2.contains(Key(i)));
+	}
+	map2.insert({ 3, 3 });
+	EXPECT_EQ(map2.at(3), 3u);
+	EXPECT_FALSE(map2.contains(4));
+
+	map3.clear();
+	map3.shrink_to_fit();
+	EXPECT_FALSE(map3.contains(0));
+	map3.insert({ 0, 1 });
+	EXPECT_EQ(map3.at(0), 1u);
+}
+
+TEST(unsigned_map, small_keys) {
+	do_small_keys_test<uint8_t, fea::sentinel_indexes>();
+	do_small_keys_test<uint8_t, fea::epoch_indexes>();
+	do_small_keys_test<uint16_t, fea::sentinel_indexes>();
+	do_small_keys_test<uint16_t, fea::epoch_indexes>();
+}
+
+TEST(unsigned_map, range_insert) {
+	using pair_t = std::pair<size_t, test>;
+
+	// Duplicates, first one wins.
+	std::vector<pair_t> kvs{ { 5, { 5 } }, { 2, { 2 } }, { 5, { 42 } },
+		{ 0, { 0 } }, { 2, { 42 } }, { 9, { 9 } } };
+
+	{
+		fea::unsigned_map<size_t, test> map(kvs.begin(), kvs.end());
+		EXPECT_EQ(map.size(), 4u);
+		EXPECT_EQ(map.capacity(), 4u);
+		EXPECT_EQ(map.at(5), test{ 5 });
+		EXPECT_EQ(map.at(2), test{ 2 });
+		EXPECT_EQ(map.at(0), test{ 0 });
+		EXPECT_EQ(map.at(9), test{ 9 });
+		EXPECT_FALSE(map.contains(1));
+
+		// Insertion order is preserved.
+		EXPECT_EQ(map.begin()->first, 5u);
+		EXPECT_EQ(std::prev(map.end())->first, 9u);
+	}
+
+	{
+		// Forward iterators.
+		std::list<pair_t> l(kvs.begin(), kvs.end());
+		fea::unsigned_map<size_t, test> map1(l.begin(), l.end());
+		fea::unsigned_map<size_t, test> map2(kvs.begin(), kvs.end());
+		EXPECT_EQ(map1, map2);
+	}
+
+	{
+		// Existing keys aren't overwritten.
+		fea::unsigned_map<size_t, test> map;
+		map.insert({ 2, { 3 } });
+		map.insert({ 12, { 12 } });
+		map.insert(kvs.begin(), kvs.end());
+		EXPECT_EQ(map.size(), 5u);
+		EXPECT_EQ(map.at(2), test{ 3 });
+		EXPECT_EQ(map.at(12), test{ 12 });
+		EXPECT_EQ(map.at(5), test{ 5 });
+		EXPECT_EQ(map.at(9), test{ 9 });
+		EXPECT_EQ(map.at(0), test{ 0 });
+
+		map.insert(kvs.begin(), kvs.begin());
+		EXPECT_EQ(map.size(), 5u);
+	}
+
+	{
+		// Multi-threaded, big enough to actually use threads.
+		std::vector<pair_t> big_kvs;
+		for (size_t i = 0; i < 100'000; ++i) {
+			size_t k = (i * 7) % 50'000;
+			big_kvs.push_back({ k, { i } });
+		}
+
+		fea::unsigned_map<size_t, test> map1(big_kvs.begin(), big_kvs.end());
+		fea::unsigned_map<size_t, test> map2(
+				fea::multithreaded, big_kvs.begin(), big_kvs.end());
+		EXPECT_EQ(map1.size(), 50'000u);
+		EXPECT_EQ(map1, map2);
+		EXPECT_TRUE(std::equal(map1.begin(), map1.end(), map2.begin()));
+
+		for (size_t i = 0; i < 50'000; ++i) {
+			EXPECT_EQ(map2.at((i * 7) % 50'000), test{ i });
+		}
+
+		map2.insert(fea::multithreaded, big_kvs.begin(), big_kvs.end());
+		EXPECT_EQ(map1, map2);
+	}
+
+	{
+		// Not default constructible, falls back to single threaded fill.
+		std::vector<std::pair<size_t, std::reference_wrapper<const test>>>
+				ref_kvs;
+		for (const pair_t& kv : kvs) {
+			ref_kvs.push_back({ kv.first, std::cref(kv.second) });
+		}
+
+		fea::unsigned_map<size_t, std::reference_wrapper<const test>> map(
+				fea::multithreaded, ref_kvs.begin(), ref_kvs.end());
+		EXPECT_EQ(map.size(), 4u);
+		EXPECT_EQ(map.at(5).get(), test{ 5 });
+		EXPECT_EQ(map.at(2).get(), test{ 2 });
+	}
+}
+
+TEST(unsigned_map, bulk_erase) {
+	constexpr size_t num = 100;
+
+	auto check_indexes = [](const fea::unsigned_map<size_t, test>& map) {
+		for (auto it = map.begin(); it != map.end(); ++it) {
+			EXPECT_EQ(map.find(it->first), it);
+			EXPECT_EQ(it->second, test{ it->first });
+		}
+	};
+
+	fea::unsigned_map<size_t, test> map;
+	for (size_t i = 0; i < num; ++i) {
+		map.insert({ i, { i } });
+	}
+
+	{
+		fea::unsigned_map<size_t, test> map1 = map;
+		size_t erased = map1.erase_if([](const std::pair<size_t, test>& kv) {
+			return kv.first % 3 == 0;
+		});
+		EXPECT_EQ(erased, 34u);
+		EXPECT_EQ(map1.size(), num - 34u);
+		for (size_t i = 0; i < num; ++i) {
+			EXPECT_EQ(map1.contains(i), i % 3 != 0);
+		}
+		check_indexes(map1);
+
+		EXPECT_EQ(map1.erase_if([](const auto&) { return false; }), 0u);
+		EXPECT_EQ(map1.size(), num - 34u);
+
+		EXPECT_EQ(map1.erase_if([](const auto&) { return true; }), num - 34u);
+		EXPECT_TRUE(map1.empty());
+		EXPECT_FALSE(map1.contains(1));
+	}
+
+	{
+		// Throwing predicate leaves the map untouched.
+		fea::unsigned_map<size_t, test> map1 = map;
+		EXPECT_THROW(map1.erase_if([](const std::pair<size_t, test>& kv) {
+			if (kv.first == 50) {
+				throw std::runtime_error{ "" };
+			}
+			return kv.first % 2 == 0;
+		}),
+				std::runtime_error);
+		EXPECT_EQ(map1, map);
+		check_indexes(map1);
+	}
+
+	{
+		// Duplicate and missing keys are ignored.
+		fea::unsigned_map<size_t, test> map1 = map;
+		std::vector<size_t> keys{ 99, 0, 42, 42, 1000, 98, 43, 5 };
+		size_t erased = map1.erase(keys.data(), keys.size());
+		EXPECT_EQ(erased, 6u);
+		EXPECT_EQ(map1.size(), num - 6u);
+		for (size_t k : keys) {
+			EXPECT_FALSE(map1.contains(k));
+		}
+		check_indexes(map1);
+
+		EXPECT_EQ(map1.erase(keys.data(), keys.size()), 0u);
+		EXPECT_EQ(map1.erase(keys.data(), 0), 0u);
+		EXPECT_EQ(map1.size(), num - 6u);
+
+		std::vector<size_t> all_keys;
+		for (const auto& kv : map) {
+			all_keys.push_back(kv.first);
+		}
+		EXPECT_EQ(map1.erase(all_keys.data(), all_keys.size()), num - 6u);
+		EXPECT_TRUE(map1.empty());
+	}
+
+	{
+		// Overlapping the end.
+		fea::unsigned_map<size_t, test> map1 = map;
+		auto it = map1.erase(map1.begin() + 90, map1.begin() + 95);
+		EXPECT_EQ(map1.size(), num - 5u);
+		EXPECT_EQ(it, map1.begin() + 90);
+		for (size_t i = 90; i < 95; ++i) {
+			EXPECT_FALSE(map1.contains(i));
+		}
+		check_indexes(map1);
+
+		it = map1.erase(map1.begin() + 10, map1.end());
+		EXPECT_EQ(it, map1.end());
+		EXPECT_EQ(map1.size(), 10u);
+		check_indexes(map1);
+	}
+
+	{
+		// Move only.
+		fea::unsigned_map<size_t, std::unique_ptr<size_t>> map1;
+		for (size_t i = 0; i < num; ++i) {
+			map1.insert({ i, std::make_unique<size_t>(i) });
+		}
+		map1.erase_if([](const auto& kv) { return *kv.second % 2 == 1; });
+		EXPECT_EQ(map1.size(), num / 2);
+		for (size_t i = 0; i < num; i += 2) {
+			EXPECT_EQ(*map1.at(i), i);
+		}
+	}
+}
+
+TEST(unsigned_map, allocator) {
+	size_t live = 0;
+	{
+		using alloc_t = counting_allocator<std::pair<unsigned, test>>;
+		using map_t = fea::unsigned_map<unsigned, test, fea::sentinel_indexes,
+				alloc_t>;
+
+		map_t map{ alloc_t{ &live } };
+		EXPECT_EQ(live, 0u);
+		for (unsigned i = 0; i < 100; ++i) {
+			map.insert({ i, { i } });
+		}
+
+		// Indexes and values.
+		EXPECT_EQ(live, 2u);
+		EXPECT_EQ(map.get_allocator(), alloc_t{ &live });
+
+		map_t map2{ map, alloc_t{ &live } };
+		EXPECT_EQ(live, 4u);
+		EXPECT_EQ(map, map2);
+
+		map_t map3{ { { 0u, { 0u } }, { 1u, { 1u } } }, alloc_t{ &live } };
+		EXPECT_EQ(live, 6u);
+		EXPECT_EQ(map3.at(1), test{ 1 });
+
+		using epoch_map_t = fea::unsigned_map<unsigned, test,
+				fea::epoch_indexes, alloc_t>;
+		epoch_map_t map4{ map.begin(), map.end(), alloc_t{ &live } };
+		EXPECT_EQ(live, 8u);
+		EXPECT_EQ(map4.size(), 100u);
+	}
+	EXPECT_EQ(live, 0u);
+
+#if __cplusplus >= 201703L
+	{
+		// Everything must come from the buffer.
+		std::array<std::byte, 16'384> buf;
+		std::pmr::monotonic_buffer_resource res{ buf.data(), buf.size(),
+			std::pmr::null_memory_resource() };
+
+		fea::pmr::unsigned_map<unsigned, test> map{ &res };
+		for (unsigned i = 0; i < 100; ++i) {
+			map.insert({ i, { i } });
+		}
+		map.erase(5);
+		EXPECT_EQ(map.size(), 99u);
+		EXPECT_EQ(map.at(42), test{ 42 });
+		EXPECT_EQ(map.get_allocator().resource(), &res);
+	}
+#endif
+}
+
+TEST(unsigned_map, memory_usage) {
+	fea::unsigned_map<unsigned, float> map;
+	auto usage = map.memory_usage();
+	EXPECT_EQ(usage.used(), 0u);
+	EXPECT_EQ(usage.used_per_element(), 0.0);
+
+	map.reserve(64);
+	map.insert({ 99, 1.f });
+	map.insert({ 0, 2.f });
+	usage = map.memory_usage();
+
+	using value_t = std::pair<unsigned, float>;
+	EXPECT_EQ(usage.size, 2u);
+	EXPECT_EQ(usage.values.used, 2 * sizeof(value_t));
+	EXPECT_EQ(usage.values.reserved, map.capacity() * sizeof(value_t));
+
+	// The indexes go up to the max key.
+	EXPECT_EQ(usage.value_indexes.used, 100 * sizeof(unsigned));
+	EXPECT_GE(usage.value_indexes.reserved, usage.value_indexes.used);
+
+	EXPECT_EQ(usage.used(), usage.value_indexes.used + usage.values.used);
+	EXPECT_GE(usage.reserved(), usage.used());
+	EXPECT_EQ(usage.used_per_element(), double(usage.used()) / 2.0);
+	EXPECT_GE(usage.reserved_per_element(), usage.used_per_element());
+
+	map.clear();
+	map.shrink_to_fit();
+	usage = map.memory_usage();
+	EXPECT_EQ(usage.reserved(), 0u);
+
+	fea::unsigned_map<unsigned, float, fea::epoch_indexes> epoch_map;
+	epoch_map.insert({ 9, 1.f });
+	EXPECT_EQ(epoch_map.memory_usage().value_indexes.used,
+			10 * (sizeof(unsigned) + sizeof(uint32_t)));
+}
+
+TEST(unsigned_map, chunked_values) {
+	using map_t = fea::unsigned_map<unsigned, test, fea::sentinel_indexes,
+			std::allocator<std::pair<unsigned, test>>, fea::chunked_values<8>>;
+
+	map_t map;
+	map.insert({ 0, test{ 0 } });
+	const auto* first = &*map.find(0);
+	for (unsigned i = 1; i < 50; ++i) {
+		map.insert({ i, test{ i } });
+	}
+
+	// Growth doesn't move values.
+	EXPECT_EQ(&*map.find(0), first);
+	EXPECT_EQ(map.size(), 50u);
+
+	// Reserved memory counts the chunk table.
+	EXPECT_GT(map.memory_usage().values.reserved,
+			map.capacity() * sizeof(std::pair<unsigned, test>));
+	for (unsigned i = 0; i < 50; ++i) {
+		EXPECT_EQ(map.at(i), test{ i });
+	}
+
+	map.erase(3);
+	map.erase(10);
+	EXPECT_FALSE(map.contains(3));
+	EXPECT_EQ(map.at(49), test{ 49 });
+	EXPECT_EQ(std::distance(map.begin(), map.end()), 48);
+
+	size_t count = 0;
+	size_t sum = 0;
+	map.iterate_chunks([&](const std::pair<unsigned, test>* f,
+							   const std::pair<unsigned, test>* l) {
+		EXPECT_LE(l - f, 8);
+		for (; f != l; ++f) {
+			++count;
+			sum += f->first;
+		}
+	});
+	EXPECT_EQ(count, 48u);
+	EXPECT_EQ(sum, 49u * 50u / 2u - 13u);
+
+	map_t map2{ map };
+	EXPECT_EQ(map, map2);
+	map2.erase(map2.begin(), map2.begin() + 10);
+	EXPECT_EQ(map2.size(), 38u);
+	EXPECT_NE(map, map2);
+
+	fea::unsigned_map<unsigned, test> vec_map;
+	vec_map.insert({ 1, test{ 1 } });
+	count = 0;
+	vec_map.iterate_chunks([&](const std::pair<unsigned, test>* f,
+								   const std::pair<unsigned, test>* l) {
+		count += size_t(l - f);
+	});
+	EXPECT_EQ(count, 1u);
+}
+
+template <class IndexStorage, class ValueStorage>
+void do_gather_scatter_test() {
+	using map_t = fea::unsigned_map<unsigned, test, IndexStorage,
+			std::allocator<std::pair<unsigned, test>>, ValueStorage>;
+
+	map_t map;
+	for (unsigned i = 0; i < 1'000; ++i) {
+		map.insert({ i * 3, test{ i } });
+	}
+
+	// Not a multiple of the block size, with repeated keys.
+	std::vector<unsigned> keys;
+	for (unsigned i = 0; i < 77; ++i) {
+		keys.push_back((i * 37 % 1'000) * 3);
+	}
+	keys.push_back(keys.front());
+
+	std::vector<test> out(keys.size());
+	map.gather(keys.data(), keys.size(), out.data());
+	for (size_t i = 0; i < keys.size(); ++i) {
+		EXPECT_EQ(out[i], map.at(keys[i]));
+		EXPECT_EQ(out[i].val, keys[i] / 3);
+	}
+
+	std::vector<test> in;
+	for (size_t i = 0; i < keys.size() - 1; ++i) {
+		in.push_back(test{ keys[i] + 1 });
+	}
+	map.scatter(keys.data(), in.size(), in.data());
+	for (size_t i = 0; i < in.size(); ++i) {
+		EXPECT_EQ(map.at(keys[i]), in[i]);
+	}
+	EXPECT_EQ(map.at(3), test{ 1 });
+	EXPECT_EQ(map.size(), 1'000u);
+
+	map.gather(keys.data(), 0, out.data());
+	map.scatter(keys.data(), 0, in.data());
+}
+
+TEST(unsigned_map, gather_scatter) {
+	do_gather_scatter_test<fea::sentinel_indexes, fea::contiguous_values>();
+	do_gather_scatter_test<fea::epoch_indexes, fea::contiguous_values>();
+	do_gather_scatter_test<fea::sentinel_indexes, fea::chunked_values<16>>();
+}
+
+template <class Key, class IndexStorage, class ValueStorage>
+void do_ordered_test() {
+	using map_t = fea::unsigned_map<Key, test, IndexStorage,
+			std::allocator<std::pair<Key, test>>, ValueStorage>;
+
+	map_t map;
+	EXPECT_EQ(map.ordered_begin(), map.ordered_end());
+	EXPECT_EQ(map.range(0, 100).begin(), map.range(0, 100).end());
+
+	// Dense runs and long empty runs, inserted out of order.
+	std::map<Key, test> expected;
+	std::mt19937 gen{ 42 };
+	std::uniform_int_distribution<unsigned> dis{ 0, 60'000 };
+	for (unsigned i = 0; i < 2'000; ++i) {
+		Key k = Key(i % 3 == 0 ? dis(gen) : (i * 7) % 500);
+		map.insert({ k, test{ k } });
+		expected.insert({ k, test{ k } });
+	}
+	for (unsigned i = 0; i < 300; ++i) {
+		Key k = Key(dis(gen) % 500);
+		map.erase(k);
+		expected.erase(k);
+	}
+	map.insert({ 0, test{ 0 } });
+	expected.insert({ 0, test{ 0 } });
+	ASSERT_EQ(map.size(), expected.size());
+
+	auto check = [&](auto first, auto last, auto exp_first, auto exp_last) {
+		for (; first != last; ++first, ++exp_first) {
+			ASSERT_NE(exp_first, exp_last);
+			EXPECT_EQ(first->first, exp_first->first);
+			EXPECT_EQ(first->second, exp_first->second);
+		}
+		EXPECT_EQ(exp_first, exp_last);
+	};
+
+	const map_t& cmap = map;
+	check(map.ordered_begin(), map.ordered_end(), expected.begin(),
+			expected.end());
+	check(cmap.ordered_cbegin(), cmap.ordered_cend(), expected.begin(),
+			expected.end());
+
+	for (unsigned i = 0; i < 200; ++i) {
+		Key lo = Key(dis(gen));
+		Key hi = Key(i % 2 == 0 ? lo + dis(gen) % 1'000 : dis(gen));
+		auto r = cmap.range(lo, hi);
+		if (hi <= lo) {
+			EXPECT_EQ(r.begin(), r.end());
+			continue;
+		}
+		check(r.begin(), r.end(), expected.lower_bound(lo),
+				expected.lower_bound(hi));
+	}
+	auto r = map.range(0, 1);
+	ASSERT_NE(r.begin(), r.end());
+	EXPECT_EQ(r.begin()->first, 0u);
+	EXPECT_EQ(std::next(r.begin()), r.end());
+
+	// Writes through ordered iteration.
+	Key prev = 0;
+	bool first = true;
+	map.for_each_ordered([&](std::pair<Key, test>& kv) {
+		EXPECT_TRUE(first || prev < kv.first);
+		first = false;
+		prev = kv.first;
+		kv.second.val += 1;
+	});
+	size_t count = 0;
+	cmap.for_each_ordered([&](const std::pair<Key, test>& kv) {
+		EXPECT_EQ(kv.second.val, size_t(kv.first) + 1);
+		++count;
+	});
+	EXPECT_EQ(count, map.size());
+
+	typename map_t::const_ordered_iterator it = map.ordered_begin();
+	EXPECT_EQ(it, map.ordered_begin());
+	EXPECT_EQ(it->first, 0u);
+
+	map.clear();
+	EXPECT_EQ(map.ordered_begin(), map.ordered_end());
+}
+
+TEST(unsigned_map, ordered) {
+	do_ordered_test<unsigned, fea::sentinel_indexes,
+			fea::contiguous_values>();
+	do_ordered_test<unsigned, fea::epoch_indexes, fea::contiguous_values>();
+	do_ordered_test<unsigned, fea::sentinel_indexes,
+			fea::chunked_values<16>>();
+	do_ordered_test<uint16_t, fea::sentinel_indexes,
+			fea::contiguous_values>();
+	do_ordered_test<uint16_t, fea::epoch_indexes, fea::contiguous_values>();
+}
+
+template <class Key>
+void do_range_max_key_test() {
+	constexpr Key max_key = (std::numeric_limits<Key>::max)();
+	fea::unsigned_map<Key, test> map;
+	map.insert({ Key(max_key - 1), test{ 1 } });
+	map.insert({ max_key, test{ 2 } });
+
+	// hi one past the maximum key includes it.
+	auto r = map.range(Key(max_key - 1), size_t(max_key) + 1);
+	ASSERT_NE(r.begin(), r.end());
+	EXPECT_EQ(r.begin()->first, Key(max_key - 1));
+	EXPECT_EQ(std::next(r.begin())->first, max_key);
+	EXPECT_EQ(std::next(r.begin(), 2), r.end());
+
+	r = map.range(max_key, size_t(max_key) + 1);
+	ASSERT_NE(r.begin(), r.end());
+	EXPECT_EQ(r.begin()->second, test{ 2 });
+	EXPECT_EQ(std::next(r.begin()), r.end());
+
+	r = map.range(0, max_key);
+	ASSERT_NE(r.begin(), r.end());
+	EXPECT_EQ(r.begin()->first, Key(max_key - 1));
+	EXPECT_EQ(std::next(r.begin()), r.end());
+}
+
+TEST(unsigned_map, range_max_key) {
+	do_range_max_key_test<uint8_t>();
+	do_range_max_key_test<uint16_t>();
+}
+
+TEST(unsigned_map, upsert_compute) {
+	fea::unsigned_map<unsigned, size_t> counts;
+	std::unordered_map<unsigned, size_t> expected;
+	for (unsigned i = 0; i < 1'000; ++i) {
+		unsigned k = (i * 37) % 101;
+		auto ret = counts.compute(k, [](size_t& c) { ++c; });
+		EXPECT_EQ(ret.second, expected.count(k) == 0);
+		++expected[k];
+		EXPECT_EQ(ret.first->second, expected[k]);
+	}
+	EXPECT_EQ(counts.size(), expected.size());
+	for (const auto& kv : expected) {
+		EXPECT_EQ(counts.at(kv.first), kv.second);
+	}
+
+	fea::unsigned_map<unsigned, test> map;
+	size_t made = 0;
+	size_t updated = 0;
+	auto make = [&]() {
+		++made;
+		return test{ 1 };
+	};
+	auto update = [&](test& t) {
+		++updated;
+		t.val *= 2;
+	};
+	auto ret = map.upsert(5, make, update);
+	EXPECT_TRUE(ret.second);
+	EXPECT_EQ(ret.first->first, 5u);
+	ret = map.upsert(5, make, update);
+	EXPECT_FALSE(ret.second);
+	ret = map.upsert(5, make, update);
+	EXPECT_EQ(map.at(5), test{ 4 });
+	EXPECT_EQ(made, 1u);
+	EXPECT_EQ(updated, 2u);
+
+	// operator[] value initializes.
+	EXPECT_EQ(map[7], test{});
+	EXPECT_EQ(map.size(), 2u);
+	map[7].val = 3;
+	EXPECT_EQ(map.at(7), test{ 3 });
+
+	// A throwing make leaves the map untouched.
+	EXPECT_THROW(map.upsert(
+						 9, []() -> test { throw std::runtime_error{ "" }; },
+						 update),
+			std::runtime_error);
+	EXPECT_FALSE(map.contains(9));
+	EXPECT_EQ(map.size(), 2u);
+	map.insert({ 9, test{ 9 } });
+	EXPECT_EQ(map.at(9), test{ 9 });
+}
+
+template <class IndexStorage, class ValueStorage>
+void do_extract_merge_test() {
+	using ptr = std::unique_ptr<unsigned>;
+	using map_t = fea::unsigned_map<unsigned, ptr, IndexStorage,
+			std::allocator<std::pair<unsigned, ptr>>, ValueStorage>;
+
+	map_t pending;
+	for (unsigned i = 0; i < 100; ++i) {
+		pending.insert({ i, std::make_unique<unsigned>(i) });
+	}
+
+	typename map_t::node_type node = pending.extract(500);
+	EXPECT_TRUE(node.empty());
+	EXPECT_FALSE(pending.insert(std::move(node)).second);
+
+	// Values move in and out of nodes without copies.
+	const unsigned* addr = pending.at(10).get();
+	node = pending.extract(10);
+	EXPECT_FALSE(node.empty());
+	EXPECT_EQ(node.key(), 10u);
+	EXPECT_EQ(node.mapped().get(), addr);
+	EXPECT_FALSE(pending.contains(10));
+	EXPECT_EQ(pending.size(), 99u);
+
+	map_t active;
+	auto ret = active.insert(std::move(node));
+	EXPECT_TRUE(ret.second);
+	EXPECT_TRUE(node.empty());
+	EXPECT_EQ(ret.first->second.get(), addr);
+
+	// A node with an existing key keeps its value.
+	node = pending.extract(pending.begin() + 3);
+	unsigned k = node.key();
+	active.insert({ k, std::make_unique<unsigned>(0) });
+	EXPECT_FALSE(active.insert(std::move(node)).second);
+	EXPECT_FALSE(node.empty());
+	EXPECT_EQ(*node.mapped(), k);
+	node.key() = 1'000;
+	EXPECT_TRUE(active.insert(std::move(node)).second);
+	EXPECT_EQ(*active.at(1'000), k);
+
+	for (unsigned i = 200; i < 300; ++i) {
+		active.insert({ i, std::make_unique<unsigned>(i) });
+	}
+	active.insert({ 50, std::make_unique<unsigned>(0) });
+	active.insert({ 60, std::make_unique<unsigned>(0) });
+
+	// Keys already in active stay in pending.
+	std::vector<const unsigned*> addrs;
+	for (const auto& kv : pending) {
+		addrs.push_back(kv.second.get());
+	}
+	size_t expected_size = active.size() + pending.size() - 2;
+	active.merge(pending);
+	EXPECT_EQ(active.size(), expected_size);
+	EXPECT_EQ(pending.size(), 2u);
+	EXPECT_EQ(*pending.at(50), 50u);
+	EXPECT_EQ(*pending.at(60), 60u);
+	EXPECT_EQ(*active.at(50), 0u);
+	for (const auto& kv : active) {
+		if (kv.first != 50 && kv.first != 60 && kv.first != k) {
+			EXPECT_EQ(*kv.second, kv.first >= 1'000 ? k : kv.first);
+		}
+	}
+	for (const unsigned* a : addrs) {
+		if (*a == 50 || *a == 60) {
+			continue;
+		}
+		EXPECT_EQ(active.at(*a).get(), a);
+	}
+
+	active.merge(active);
+	EXPECT_EQ(active.size(), expected_size);
+	pending.erase(50);
+	pending.erase(60);
+	active.merge(pending);
+	EXPECT_EQ(active.size(), expected_size);
+	EXPECT_TRUE(pending.empty());
+
+	// Everything moves into an empty map.
+	map_t empty;
+	empty.merge(std::move(active));
+	EXPECT_EQ(empty.size(), expected_size);
+	EXPECT_TRUE(active.empty());
+	EXPECT_FALSE(active.contains(200));
+	EXPECT_EQ(*empty.at(200), 200u);
+}
+
+TEST(unsigned_map, extract_merge) {
+	do_extract_merge_test<fea::sentinel_indexes, fea::contiguous_values>();
+	do_extract_merge_test<fea::epoch_indexes, fea::contiguous_values>();
+	do_extract_merge_test<fea::sentinel_indexes, fea::chunked_values<16>>();
+}
+
+// Copies throw when countdown reaches 0.
+struct copy_thrower {
+	copy_thrower(unsigned v_)
+			: v(v_) {
+	}
+	copy_thrower(const copy_thrower& other)
+			: v(other.v) {
+		if (--countdown == 0) {
+			throw std::runtime_error{ "" };
+		}
+	}
+	copy_thrower& operator=(const copy_thrower&) = default;
+
+	unsigned v;
+	static int countdown;
+};
+int copy_thrower::countdown = -1;
+
+template <class IndexStorage, class ValueStorage>
+void do_throwing_merge_test() {
+	using map_t = fea::unsigned_map<unsigned, copy_thrower, IndexStorage,
+			std::allocator<std::pair<unsigned, copy_thrower>>, ValueStorage>;
+
+	map_t dst;
+	dst.reserve(1'000);
+	for (unsigned i = 0; i < 50; ++i) {
+		dst.insert({ i, copy_thrower{ i } });
+	}
+	map_t src;
+	for (unsigned i = 25; i < 225; ++i) {
+		src.insert({ i, copy_thrower{ i } });
+	}
+
+	// Throws midway, other keeps the values that weren't moved.
+	copy_thrower::countdown = 60;
+	EXPECT_THROW(dst.merge(src), std::runtime_error);
+	copy_thrower::countdown = -1;
+	EXPECT_EQ(dst.size() + src.size(), 250u);
+	for (unsigned k = 0; k < 225; ++k) {
+		bool in_dst = dst.contains(k);
+		bool in_src = src.contains(k);
+		EXPECT_TRUE(in_dst || in_src);
+		EXPECT_EQ(in_dst && in_src, k >= 25 && k < 50);
+		if (in_src) {
+			EXPECT_EQ(src.at(k).v, k);
+			EXPECT_EQ(src.find(k)->first, k);
+		}
+		if (in_dst) {
+			EXPECT_EQ(dst.at(k).v, k);
+		}
+	}
+	for (const auto& kv : src) {
+		EXPECT_EQ(src.find(kv.first)->second.v, kv.first);
+	}
+
+	dst.merge(src);
+	EXPECT_EQ(dst.size(), 225u);
+	EXPECT_EQ(src.size(), 25u);
+}
+
+TEST(unsigned_map, throwing_merge) {
+	do_throwing_merge_test<fea::sentinel_indexes, fea::contiguous_values>();
+	do_throwing_merge_test<fea::epoch_indexes, fea::contiguous_values>();
+	do_throwing_merge_test<fea::sentinel_indexes, fea::chunked_values<16>>();
+}
+
+template <class IndexStorage, class ValueStorage>
+void do_compact_test() {
+	using map_t = fea::unsigned_map<unsigned, unsigned, IndexStorage,
+			std::allocator<std::pair<unsigned, unsigned>>, ValueStorage>;
+
+	std::mt19937 gen(42);
+	map_t map;
+	std::map<unsigned, unsigned> expected;
+	auto churn = [&]() {
+		for (unsigned i = 0; i < 2'000; ++i) {
+			unsigned k = unsigned(gen() % 1'000);
+			if (gen() % 3 == 0) {
+				map.erase(k);
+				expected.erase(k);
+			} else {
+				map.insert_or_assign(k, k * 2);
+				expected[k] = k * 2;
+			}
+		}
+	};
+	auto check = [&](bool sorted) {
+		ASSERT_EQ(map.size(), expected.size());
+		auto it = expected.begin();
+		for (const auto& kv : map) {
+			if (sorted) {
+				EXPECT_EQ(kv.first, it->first);
+				++it;
+			}
+			EXPECT_EQ(map.at(kv.first), kv.first * 2);
+		}
+		for (const auto& kv : expected) {
+			EXPECT_EQ(map.at(kv.first), kv.second);
+		}
+	};
+
+	map.compact();
+	EXPECT_TRUE(map.empty());
+
+	churn();
+	map.compact();
+	check(true);
+
+	// Incremental, with nothing in between.
+	churn();
+	typename map_t::compact_cursor cursor;
+	size_t steps = 0;
+	while (!map.compact(cursor, 7)) {
+		++steps;
+	}
+	EXPECT_GT(steps, 1u);
+	check(true);
+
+	// The map stays valid when it changes between steps.
+	churn();
+	cursor = {};
+	while (!map.compact(cursor, 50)) {
+		unsigned k = unsigned(gen() % 1'000);
+		map.erase(k);
+		expected.erase(k);
+		k = unsigned(gen() % 1'000);
+		map.insert_or_assign(k, k * 2);
+		expected[k] = k * 2;
+		check(false);
+	}
+	map.compact();
+	check(true);
+}
+
+TEST(unsigned_map, compact) {
+	do_compact_test<fea::sentinel_indexes, fea::contiguous_values>();
+	do_compact_test<fea::epoch_indexes, fea::contiguous_values>();
+	do_compact_test<fea::sentinel_indexes, fea::chunked_values<16>>();
+}
+
 TEST(unsigned_map, random) {
 }
 
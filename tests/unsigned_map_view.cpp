@@ -0,0 +1,171 @@
+﻿#include <cstdio>
+#include <fea_unsigned_map/fea_unsigned_map.hpp>
+#include <fea_unsigned_map/fea_unsigned_map_view.hpp>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace {
+const char* test_file = "fea_unsigned_map_view_test.bin";
+
+struct point {
+	float x = 0.f;
+	float y = 0.f;
+};
+
+template <class Map>
+void check_view(const Map& map) {
+	map.save(test_file);
+	fea::unsigned_map_view<unsigned, point> view{ test_file };
+
+	EXPECT_EQ(view.size(), map.size());
+	EXPECT_EQ(view.empty(), map.empty());
+	for (unsigned k = 0; k < 300; ++k) {
+		EXPECT_EQ(view.contains(k), map.contains(k));
+		EXPECT_EQ(view.count(k), map.count(k));
+		if (!map.contains(k)) {
+			EXPECT_EQ(view.find(k), view.end());
+			EXPECT_THROW(view.at(k), std::out_of_range);
+			continue;
+		}
+
+		EXPECT_EQ(view.find(k)->first, k);
+		EXPECT_EQ(view.at(k).x, map.at(k).x);
+		EXPECT_EQ(view.at_unchecked(k).y, map.at(k).y);
+	}
+
+	// Same iteration order.
+	auto it = map.begin();
+	for (const auto& kv : view) {
+		EXPECT_EQ(kv.first, it->first);
+		EXPECT_EQ(kv.second.x, it->second.x);
+		++it;
+	}
+	EXPECT_EQ(it, map.end());
+}
+
+TEST(unsigned_map_view, basics) {
+	fea::unsigned_map<unsigned, point> map;
+	check_view(map);
+
+	for (unsigned i = 0; i < 200; i += 3) {
+		map.insert({ i, { float(i), float(i) * 2.f } });
+	}
+	map.erase(30);
+	map.erase(198);
+	check_view(map);
+
+	fea::unsigned_map<unsigned, point, fea::epoch_indexes> epoch_map;
+	epoch_map.insert({ 5, { 1.f, 1.f } });
+	epoch_map.clear();
+	epoch_map.insert({ 2, { 2.f, 2.f } });
+	epoch_map.insert({ 9, { 9.f, 9.f } });
+	check_view(epoch_map);
+
+	fea::unsigned_map<unsigned, point, fea::sentinel_indexes,
+			std::allocator<std::pair<unsigned, point>>, fea::chunked_values<4>>
+			chunked_map;
+	for (unsigned i = 0; i < 50; ++i) {
+		chunked_map.insert({ i * 5, { float(i), 0.f } });
+	}
+	check_view(chunked_map);
+
+	// Moving keeps the mapping.
+	fea::unsigned_map_view<unsigned, point> view{ test_file };
+	fea::unsigned_map_view<unsigned, point> view2{ std::move(view) };
+	EXPECT_TRUE(view.empty());
+	EXPECT_EQ(view2.size(), 50u);
+	view = std::move(view2);
+	EXPECT_EQ(view.at(45).x, 9.f);
+
+	std::remove(test_file);
+}
+
+TEST(unsigned_map_view, padding) {
+	// uint8_t keys leave padding before the float, it must be written zeroed.
+	using record_t = fea::unsigned_map_record<uint8_t, float>;
+	static_assert(sizeof(record_t) > sizeof(uint8_t) + sizeof(float), "");
+	static_assert(std::is_trivially_copyable<record_t>::value, "");
+
+	fea::unsigned_map<uint8_t, float> map;
+	for (unsigned i = 0; i < 200; i += 3) {
+		map.insert({ uint8_t(i), float(i) });
+	}
+	map.save(test_file);
+
+	std::vector<unsigned char> bytes;
+	{
+		std::FILE* file = fea::detail::open_file(test_file, "rb");
+		ASSERT_NE(file, nullptr);
+		unsigned char c;
+		while (std::fread(&c, 1, 1, file) == 1) {
+			bytes.push_back(c);
+		}
+		std::fclose(file);
+	}
+
+	size_t values_offset = bytes.size() - map.size() * sizeof(record_t);
+	for (size_t i = 0; i < map.size(); ++i) {
+		const unsigned char* rec
+				= bytes.data() + values_offset + i * sizeof(record_t);
+		for (size_t j = sizeof(uint8_t); j < alignof(float); ++j) {
+			EXPECT_EQ(rec[j], 0u);
+		}
+	}
+
+	fea::unsigned_map_view<uint8_t, float> view{ test_file };
+	EXPECT_EQ(view.size(), map.size());
+	for (const record_t& rec : view) {
+		EXPECT_EQ(rec.second, map.at(rec.first));
+	}
+
+	std::remove(test_file);
+}
+
+TEST(unsigned_map_view, errors) {
+	using view_t = fea::unsigned_map_view<unsigned, point>;
+	EXPECT_THROW(view_t{ "fea_unsigned_map_view_missing.bin" },
+			std::runtime_error);
+
+	fea::unsigned_map<unsigned, point> map;
+	map.insert({ 3, { 3.f, 3.f } });
+	map.save(test_file);
+
+	// Wrong types.
+	using wrong_view_t = fea::unsigned_map_view<uint64_t, point>;
+	EXPECT_THROW(wrong_view_t{ test_file }, std::runtime_error);
+	EXPECT_THROW((fea::unsigned_map_view<unsigned, double>{ test_file }),
+			std::runtime_error);
+
+	// Truncated.
+	std::vector<char> bytes;
+	{
+		std::FILE* file = fea::detail::open_file(test_file, "rb");
+		ASSERT_NE(file, nullptr);
+		char c;
+		while (std::fread(&c, 1, 1, file) == 1) {
+			bytes.push_back(c);
+		}
+		std::fclose(file);
+	}
+	{
+		std::FILE* file = fea::detail::open_file(test_file, "wb");
+		ASSERT_NE(file, nullptr);
+		std::fwrite(bytes.data(), 1, bytes.size() - 1, file);
+		std::fclose(file);
+	}
+	EXPECT_THROW(view_t{ test_file }, std::runtime_error);
+
+	// Not a map.
+	{
+		std::FILE* file = fea::detail::open_file(test_file, "wb");
+		ASSERT_NE(file, nullptr);
+		std::fwrite("garbage", 1, 7, file);
+		std::fclose(file);
+	}
+	EXPECT_THROW(view_t{ test_file }, std::runtime_error);
+
+	std::remove(test_file);
+}
+} // namespace